@@ -0,0 +1,122 @@
+#ifndef _CALIBRATION_H_
+#define _CALIBRATION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <MY17_Can_Library.h>
+
+// Bump whenever Calibration_Values_T changes; blocks of another version are
+// ignored and the defaults used instead
+#define CALIBRATION_VERSION 2
+
+// The last 4 kB flash sector, reserved as the CALIBRATION region in gcc.ld
+#define CALIBRATION_SECTOR 7
+#define CALIBRATION_SECTOR_SIZE 4096
+// Smallest amount IAP can program at once
+#define CALIBRATION_PAGE_SIZE 256
+
+#define CALIBRATION_MESSAGE_SLOTS 16
+
+// Requests are frames with this ID, and answers go out with the next one.
+// Neither is in the MY17 library, so requests arrive as unknown frames.
+#define CALIBRATION_REQUEST_ID 0x5F0
+#define CALIBRATION_REPLY_ID 0x5F1
+
+// Values used until a block is loaded, and whenever the stored block is
+// missing or damaged
+
+#define CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND 105
+#define CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND 645
+#define CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND 71
+#define CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND 340
+
+#define CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW 600
+#define CALIBRATION_DEFAULT_BRAKE_ENGAGED_HV_RAW 260
+#define CALIBRATION_DEFAULT_BRAKE_ENGAGED_LV_RAW 220
+
+#define CALIBRATION_DEFAULT_DRIVER_OUTPUT_MSG_MS 20
+#define CALIBRATION_DEFAULT_RAW_VALUES_MSG_MS 100
+#define CALIBRATION_DEFAULT_WHEEL_SPEED_MSG_MS 20
+// Energy over a whole window changes slowly
+#define CALIBRATION_DEFAULT_ENERGY_MSG_MS 1000
+
+// Telemetry records are about 20 bytes on the wire. These rates come to
+// roughly 3.5 kB/s, under a third of what 115200 baud carries, which leaves
+// room for debug text and keeps a pass's records well inside the serial ring.
+#define CALIBRATION_DEFAULT_LOGGING_THROTTLE_MS 20
+#define CALIBRATION_DEFAULT_LOGGING_BRAKE_MS 20
+#define CALIBRATION_DEFAULT_LOGGING_MC_DATA_MS 20
+#define CALIBRATION_DEFAULT_LOGGING_CS_MS 100
+#define CALIBRATION_DEFAULT_LOGGING_MC_STATE_MS 100
+#define CALIBRATION_DEFAULT_LOGGING_LATENCY_MS 1000
+// One stage per run, so each stage is sent once a second
+#define CALIBRATION_DEFAULT_LOGGING_LOOP_TIMING_MS 250
+
+// Everything tunable without a reflash. Every field is a uint16_t so that
+// the CAN protocol can address them by index.
+typedef struct {
+  // 10-bit ADC readings at zero and full pedal travel
+  uint16_t accel_1_lower_bound;
+  uint16_t accel_1_upper_bound;
+  uint16_t accel_2_lower_bound;
+  uint16_t accel_2_upper_bound;
+
+  // brake_1_raw above which the brake counts as pressed for EV2.5
+  uint16_t conflict_brake_raw;
+  // brake_1_raw above which DriverOutput reports the brake engaged, with
+  // the HV light on and off
+  uint16_t brake_engaged_hv_raw;
+  uint16_t brake_engaged_lv_raw;
+
+  // Indexed by Message_T; slots past MESSAGE_LENGTH are unused
+  uint16_t message_period_ms[CALIBRATION_MESSAGE_SLOTS];
+} Calibration_Values_T;
+
+#define CALIBRATION_FIELDS (sizeof(Calibration_Values_T) / sizeof(uint16_t))
+
+// Request layout: command, field, value low byte, value high byte. Answers
+// echo command and field, then status and the field's staged value.
+typedef enum {
+  // Staged value of a field
+  CALIBRATION_CMD_READ,
+  // Stage a new value; nothing changes until it is committed
+  CALIBRATION_CMD_WRITE,
+  // Check the staged values, store them in flash and start using them
+  CALIBRATION_CMD_COMMIT,
+  // Throw the staged values away in favour of the ones in use
+  CALIBRATION_CMD_DISCARD
+} Calibration_Command_T;
+
+typedef enum {
+  CALIBRATION_OK,
+  CALIBRATION_BAD_COMMAND,
+  CALIBRATION_BAD_FIELD,
+  // The staged values failed their range checks
+  CALIBRATION_INVALID,
+  // Flash is not written while the car could be driven
+  CALIBRATION_HV_ON,
+  CALIBRATION_FLASH_ERROR
+} Calibration_Status_T;
+
+/**
+ * @details applies the block in flash if it is intact and of this version,
+ * or the defaults if not. Call once at boot, before the main loop.
+ * @return true if the block in flash was used
+ */
+bool Calibration_load(void);
+
+/**
+ * @details values currently in use
+ */
+const Calibration_Values_T *Calibration_get(void);
+
+/**
+ * @details serves one protocol request from the main loop. A commit holds
+ * off interrupts while the sector is erased and written, so it is only
+ * accepted with HV off.
+ * @return status sent back in the reply
+ */
+Calibration_Status_T Calibration_handle_frame(const Frame *frame, bool hv_enabled);
+
+#endif // _CALIBRATION_H_
@@ -0,0 +1,37 @@
+#ifndef _CAN_CONTROLLER_H_
+#define _CAN_CONTROLLER_H_
+
+#include <stdint.h>
+
+// The C_CAN control and status registers, which CanHealth needs to watch
+// fault confinement and restart the controller after bus-off.
+// lpc_chip_11cxx_lib only wraps the ROM CAN driver, which has no call for
+// either, so they are accessed directly. The simulator models them in
+// sim/src/can_sim.c.
+
+#define CAN_CONTROLLER_CNTL_INIT (1 << 0)
+
+#define CAN_CONTROLLER_STAT_LEC_MASK 0x07
+#define CAN_CONTROLLER_STAT_TXOK (1 << 3)
+#define CAN_CONTROLLER_STAT_RXOK (1 << 4)
+#define CAN_CONTROLLER_STAT_EPASS (1 << 5)
+#define CAN_CONTROLLER_STAT_EWARN (1 << 6)
+#define CAN_CONTROLLER_STAT_BOFF (1 << 7)
+
+/**
+ * @details reads the status register
+ */
+uint32_t CanController_status(void);
+
+/**
+ * @details sets INIT, holding the controller off the bus
+ */
+void CanController_enter_init(void);
+
+/**
+ * @details clears INIT. After bus-off this starts the controller's
+ * recovery sequence.
+ */
+void CanController_leave_init(void);
+
+#endif // _CAN_CONTROLLER_H_
@@ -0,0 +1,64 @@
+#ifndef _CAN_HEALTH_H_
+#define _CAN_HEALTH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wait before the first bus-off recovery attempt, doubled for every bus-off
+// that follows a recovery within CAN_HEALTH_STABLE_MS, up to the maximum
+#define CAN_HEALTH_BACKOFF_MIN_MS 10
+#define CAN_HEALTH_BACKOFF_MAX_MS 1280
+// Error active for this long after a recovery and the backoff starts over
+#define CAN_HEALTH_STABLE_MS 1000
+// The recovery sequence is 128 runs of 11 recessive bits, about 3 ms at
+// 500 kbit/s on a quiet bus. If it has not finished after this the bus is
+// still bad, so the controller goes back into bus-off to wait again.
+#define CAN_HEALTH_RECOVERY_TIMEOUT_MS 100
+
+typedef enum {
+  CAN_HEALTH_ERROR_ACTIVE,
+  CAN_HEALTH_ERROR_PASSIVE,
+  // Off the bus, waiting out the backoff
+  CAN_HEALTH_BUS_OFF,
+  // Off the bus, controller running its recovery sequence
+  CAN_HEALTH_RECOVERING
+} CanHealth_State_T;
+
+typedef struct {
+  uint32_t error_passive_entries;
+  uint32_t bus_offs;
+  uint32_t recoveries;
+  // Recovery sequences given up on after CAN_HEALTH_RECOVERY_TIMEOUT_MS
+  uint32_t recovery_timeouts;
+  // Time from going bus-off to error active again, over every recovery
+  uint32_t recover_min_ms;
+  uint32_t recover_max_ms;
+  uint32_t recover_total_ms;
+  // Wait before the current or latest recovery attempt
+  uint32_t backoff_ms;
+} CanHealth_Stats_T;
+
+void CanHealth_init(void);
+
+/**
+ * @details called from the SysTick interrupt. Reads the controller status
+ * once and takes at most one recovery step, so it never waits on the bus.
+ */
+void CanHealth_isr_update(uint32_t msTicks);
+
+CanHealth_State_T CanHealth_state(void);
+
+/**
+ * @details false while the controller is off the bus, when writes can only
+ * fail
+ */
+bool CanHealth_can_transmit(void);
+
+const CanHealth_Stats_T *CanHealth_get_stats(void);
+
+/**
+ * @details mean time to recover from bus-off, 0 before the first recovery
+ */
+uint32_t CanHealth_mean_recover_ms(void);
+
+#endif // _CAN_HEALTH_H_
@@ -0,0 +1,108 @@
+#ifndef _CAN_RX_H_
+#define _CAN_RX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <MY17_Can_Library.h>
+
+// Must be a power of two so the free-running indices can be masked
+#define CAN_RX_RING_SIZE 16
+#define CAN_RX_RING_MASK (CAN_RX_RING_SIZE - 1)
+
+// The ROM driver numbers the controller's message objects from 0
+#define CAN_RX_MSGOBJ_COUNT 32
+
+// Message objects the library sets up for itself in Can_Init: frames go out
+// through CAN_LIBRARY_TX_MSGOBJ, and CAN_LIBRARY_RX_MSGOBJ is opened with a
+// zero mask to take every frame. The driver cannot be asked for these, so
+// they follow the library's Can_Init and need checking whenever it changes.
+#define CAN_LIBRARY_TX_MSGOBJ 0
+#define CAN_LIBRARY_RX_MSGOBJ 1
+
+// Receive message objects taken by the subscriptions, one each. Starting at
+// the library's catch-all object closes it. CanRx.c checks at compile time
+// that the rest stay clear of the transmit object and within the controller.
+#define CAN_RX_FIRST_MSGOBJ CAN_LIBRARY_RX_MSGOBJ
+// Every bit of a standard ID has to match
+#define CAN_RX_ID_MASK 0x7FF
+
+// Every message the node reads, one row each, so subscribing to a message is
+// a row here plus its handler in Input.c:
+//   X(ID, message type, union member, payload type, read function,
+//     handler in Input.c, pointer to its last_updated field or NULL)
+// CanRx.c opens a receive message object for the ID and reads the frame into
+// its member of CanRx_Msg_T, and update_can hands it to the handler. The
+// library has no type for the calibration request, so it arrives as
+// Can_Unknown_Msg.
+#define CAN_RX_SUBSCRIPTIONS(X) \
+  X(VCU_DASH_HEARTBEAT__id, Can_Vcu_DashHeartbeat_Msg, vcu_dash, \
+      Can_Vcu_DashHeartbeat_T, Can_Vcu_DashHeartbeat_Read, \
+      can_process_vcu_dash, misc_last_updated) \
+  X(MC_DATA_READING__id, Can_MC_DataReading_Msg, mc_data, \
+      Can_MC_DataReading_T, Can_MC_DataReading_Read, \
+      can_process_mc_data, mc_last_updated) \
+  X(CURRENT_SENSOR_VOLTAGE__id, Can_CurrentSensor_Voltage_Msg, cs_voltage, \
+      Can_CurrentSensor_Voltage_T, Can_CurrentSensor_Voltage_Read, \
+      can_process_voltage, cs_voltage_last_updated) \
+  X(CURRENT_SENSOR_CURRENT__id, Can_CurrentSensor_Current_Msg, cs_current, \
+      Can_CurrentSensor_Current_T, Can_CurrentSensor_Current_Read, \
+      can_process_current, cs_current_last_updated) \
+  X(CURRENT_SENSOR_POWER__id, Can_CurrentSensor_Power_Msg, cs_power, \
+      Can_CurrentSensor_Power_T, Can_CurrentSensor_Power_Read, \
+      can_process_power, cs_power_last_updated) \
+  X(CURRENT_SENSOR_ENERGY__id, Can_CurrentSensor_Energy_Msg, cs_energy, \
+      Can_CurrentSensor_Energy_T, Can_CurrentSensor_Energy_Read, \
+      can_process_energy, cs_energy_last_updated) \
+  X(CALIBRATION_REQUEST_ID, Can_Unknown_Msg, unknown, \
+      Frame, Can_Unknown_Read, \
+      can_process_unknown, NULL)
+
+#define CAN_RX_UNION_MEMBER(id, type, member, payload, read, process, last_updated) \
+  payload member;
+
+typedef struct {
+  Can_MsgID_T type;
+  uint32_t received_ms;
+  union {
+    Can_ErrorID_T error;
+    CAN_RX_SUBSCRIPTIONS(CAN_RX_UNION_MEMBER)
+  } data;
+} CanRx_Msg_T;
+
+#undef CAN_RX_UNION_MEMBER
+
+typedef struct {
+  // Frames pushed into the ring since boot
+  uint32_t received;
+  // Frames read out of the controller while the ring was full, and dropped
+  uint32_t overflows;
+  // Highest ring occupancy seen by the producer
+  uint32_t high_water;
+} CanRx_Stats_T;
+
+/**
+ * @details programs one receive message object per subscribed ID. Frames
+ * with any other ID are dropped by the controller and never reach
+ * CanRx_isr_receive. Can_Init opens the catch-all object again, so this has
+ * to follow every Can_Init. CanHealth also runs it before each bus-off
+ * recovery, while the controller is still held in INIT.
+ */
+void CanRx_init(void);
+
+/**
+ * @details producer side, to be called from a single interrupt context.
+ * Pulls every frame the CAN driver has buffered into the ring.
+ * @return number of frames read out of the driver, including dropped ones
+ */
+uint32_t CanRx_isr_receive(uint32_t msTicks);
+
+/**
+ * @details consumer side, to be called from the main loop only
+ * @return false if the ring is empty
+ */
+bool CanRx_pop(CanRx_Msg_T *msg);
+
+const CanRx_Stats_T *CanRx_get_stats(void);
+
+#endif // _CAN_RX_H_
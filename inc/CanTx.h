@@ -0,0 +1,80 @@
+#ifndef _CAN_TX_H_
+#define _CAN_TX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <MY17_Can_Library.h>
+
+// How long a frame may keep failing with anything other than a full
+// transmit buffer before it is dropped, so that one the controller keeps
+// rejecting cannot hold back every slot after it. Well under the shortest
+// message period, so the frame would be stale by then anyway.
+#define CAN_TX_ERROR_TIMEOUT_US 5000
+
+// One slot per message this node sends, in the order they go out. Each slot
+// only ever holds the latest value, so a frame the controller has no room
+// for is replaced by the next one rather than queued behind it.
+typedef enum {
+  CAN_TX_DRIVER_OUTPUT,
+  CAN_TX_RAW_VALUES,
+  CAN_TX_WHEEL_SPEED,
+  CAN_TX_ENERGY,
+  CAN_TX_CALIBRATION_REPLY,
+  CAN_TX_SLOTS
+} CanTx_Slot_T;
+
+typedef struct {
+  // Frames handed to CanTx_queue_* since boot
+  uint32_t queued;
+  // Frames the controller accepted
+  uint32_t sent;
+  // Frames replaced by a newer one of the same type before they went out
+  uint32_t coalesced;
+  // Frames the controller had no room for on their first attempt
+  uint32_t deferred;
+  // Writes that failed for any other reason
+  uint32_t errors;
+  // Frames given up on after failing for CAN_TX_ERROR_TIMEOUT_US
+  uint32_t dropped;
+} CanTx_Stats_T;
+
+void CanTx_init(void);
+
+/**
+ * @details main loop only. Overwrites the slot, the frame goes out on the
+ * next CanTx_flush or CanTx_isr_drain the controller has room for.
+ * @param sampled_us Clock_us of the data the frame carries, reported back
+ * by CanTx_take_sent once the frame is accepted
+ */
+void CanTx_queue_driver_output(const Can_FrontCanNode_DriverOutput_T *msg, uint32_t sampled_us);
+void CanTx_queue_raw_values(const Can_FrontCanNode_RawValues_T *msg, uint32_t sampled_us);
+void CanTx_queue_wheel_speed(const Can_FrontCanNode_WheelSpeed_T *msg, uint32_t sampled_us);
+// Written raw, ENERGY_SUMMARY_ID is not in the MY17 library
+void CanTx_queue_energy(const Frame *frame, uint32_t sampled_us);
+void CanTx_queue_calibration_reply(const Frame *frame, uint32_t sampled_us);
+
+/**
+ * @details main loop only. Writes pending slots in priority order until the
+ * controller refuses one, or none while CanHealth has it off the bus.
+ */
+void CanTx_flush(void);
+
+/**
+ * @details called from the SysTick interrupt to retry deferred frames as
+ * the controller frees up. Does nothing while the main loop is inside
+ * CanTx.
+ */
+void CanTx_isr_drain(void);
+
+/**
+ * @details main loop only
+ * @param age_us set to how old the data in the last accepted frame was at
+ * the time
+ * @return true if a frame from the slot was accepted since the last call
+ */
+bool CanTx_take_sent(CanTx_Slot_T slot, uint32_t *age_us);
+
+const CanTx_Stats_T *CanTx_get_stats(void);
+
+#endif // _CAN_TX_H_
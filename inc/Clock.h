@@ -0,0 +1,29 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+
+// Milliseconds since boot, incremented by SysTick_Handler
+extern volatile uint32_t msTicks;
+
+/**
+ * @details core clock cycles since boot, from msTicks and the SysTick
+ * counter. Wraps every 2^32 cycles, so only differences are meaningful.
+ * Must be called with interrupts enabled.
+ */
+uint32_t Clock_cycles(void);
+
+/**
+ * @details microseconds since boot, from msTicks and the SysTick counter.
+ * Wraps every 2^32 us, so only differences are meaningful. Must be called
+ * with interrupts enabled.
+ */
+uint32_t Clock_us(void);
+
+/**
+ * @details cycles between two reads of SysTick->VAL. Safe in any interrupt,
+ * but only valid for spans shorter than one SysTick period.
+ */
+uint32_t Clock_span(uint32_t start_val, uint32_t end_val);
+
+#endif // _CLOCK_H_
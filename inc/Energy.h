@@ -0,0 +1,42 @@
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+
+#include <stdint.h>
+
+#include <MY17_Can_Library.h>
+
+#include "Types.h"
+
+// Energy and average power over the last complete window go out with this
+// ID, next to the calibration protocol's. Not in the MY17 library.
+// Layout: energy in J, then average power in W, both int32 little endian.
+// Positive while the current sensor reads positive current.
+#define ENERGY_SUMMARY_ID 0x5F2
+
+// Nothing tells the node where a lap starts, so windows are of a fixed
+// length, about one endurance lap
+#define ENERGY_DEFAULT_WINDOW_MS 60000
+
+// Current samples further apart than this, or without a voltage reading
+// this recent, are not integrated across. The sensor sends every 10 ms or
+// so when it is running.
+#define ENERGY_MAX_GAP_MS 500
+
+void Energy_init(Energy_Input_T *energy);
+
+void Energy_set_window_ms(uint32_t window_ms);
+
+/**
+ * @details integrates the current sensor's newest current sample, if there
+ * is one since the last call, and closes the window once it has run its
+ * length. Costs one comparison when neither is due.
+ */
+void Energy_update(Energy_Input_T *energy, const Current_Sensor_Input_T *current_sensor,
+    uint32_t msTicks);
+
+/**
+ * @details the last complete window as sent with ENERGY_SUMMARY_ID
+ */
+void Energy_summary_frame(const Energy_Input_T *energy, Frame *frame);
+
+#endif // _ENERGY_H_
@@ -0,0 +1,75 @@
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Things interrupts can tell the main loop about, one bit each
+typedef enum {
+  EVENT_DEADLINE = 1 << 0,
+  EVENT_CAN_RX = 1 << 1,
+  EVENT_WHEEL_TICK = 1 << 2
+} Event_T;
+
+#define EVENT_COUNT 3
+
+// Wheel ticks are only consumed at the next wheel speed read, which has its
+// own deadline, so they are recorded but do not wake the loop
+#define EVENT_WAKE_MASK (EVENT_DEADLINE | EVENT_CAN_RX)
+
+// The main loop stages whose busy time is accounted separately
+typedef enum {
+  EVENT_TASK_INPUT,
+  EVENT_TASK_STATE,
+  EVENT_TASK_OUTPUT,
+  EVENT_TASK_COUNT
+} Event_Task_T;
+
+typedef struct {
+  uint32_t wakeups;
+  uint32_t deadline_wakeups;
+  uint32_t can_rx_wakeups;
+  // All in core clock cycles, duty cycle of a task is its busy cycles over
+  // the total
+  uint64_t sleep_cycles;
+  uint64_t busy_cycles[EVENT_TASK_COUNT];
+  uint64_t total_cycles;
+} Event_Stats_T;
+
+/**
+ * @details marks an event pending, safe to call from any interrupt priority
+ */
+void Event_post(Event_T event);
+
+/**
+ * @details called from the SysTick interrupt, posts EVENT_DEADLINE once
+ * msTicks reaches the deadline set with Event_set_deadline
+ */
+void Event_tick(uint32_t msTicks);
+
+/**
+ * @details sets the msTicks value the loop next has timed work at. A
+ * deadline that has already passed posts EVENT_DEADLINE straight away.
+ */
+void Event_set_deadline(uint32_t deadline_ms);
+
+/**
+ * @details atomically reads and clears every pending event
+ * @return pending events as a mask of Event_T
+ */
+uint32_t Event_take(void);
+
+/**
+ * @details sleeps with WFI until an event in EVENT_WAKE_MASK is pending
+ * @return pending events as a mask of Event_T, which are cleared
+ */
+uint32_t Event_wait(void);
+
+/**
+ * @details adds cycles spent running task to its busy time
+ */
+void Event_record_task(Event_Task_T task, uint32_t cycles);
+
+const Event_Stats_T *Event_get_stats(void);
+
+#endif // _EVENT_H_
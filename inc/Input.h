@@ -6,4 +6,9 @@
 void Input_initialize(Input_T *input);
 void Input_fill_input(Input_T *input);
 
+/**
+ * @details msTicks value at which Input_fill_input next has periodic work
+ */
+uint32_t Input_next_deadline(Input_T *input);
+
 #endif // _INPUT_H_
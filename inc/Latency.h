@@ -0,0 +1,36 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+// Ages are counted in 1 ms buckets, the last one taking everything from
+// (LATENCY_BUCKETS - 1) ms up. The ADC is read every 10 ms, so ages past
+// that mean a pass ran late.
+#define LATENCY_BUCKET_US 1000
+#define LATENCY_BUCKETS 12
+
+// Age of the pedal sample each DriverOutput frame was computed from, when
+// the frame was handed to the CAN controller
+typedef struct {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t sum_us;
+  uint32_t histogram[LATENCY_BUCKETS];
+} Latency_Stats_T;
+
+void Latency_init(void);
+
+/**
+ * @details adds the age of one sample at transmit, main loop only
+ */
+void Latency_record(uint32_t age_us);
+
+const Latency_Stats_T *Latency_get_stats(void);
+
+/**
+ * @details mean age over every recorded frame, 0 if there are none
+ */
+uint32_t Latency_mean_us(void);
+
+#endif // _LATENCY_H_
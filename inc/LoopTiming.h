@@ -0,0 +1,60 @@
+#ifndef _LOOP_TIMING_H_
+#define _LOOP_TIMING_H_
+
+#include <stdint.h>
+
+// 1 keeps cycle statistics for each main loop stage and sends them in
+// telemetry, 0 compiles all of it out
+#ifndef LOOP_TIMING
+#define LOOP_TIMING 1
+#endif
+
+// Spans shorter than 2^LOOP_TIMING_MIN_SHIFT cycles share the first bucket,
+// and each bucket after covers twice the span of the one before. The last
+// one also takes everything from 2^20 cycles (22 ms) up, past the 20 ms
+// driver output period.
+#define LOOP_TIMING_MIN_SHIFT 7
+#define LOOP_TIMING_BUCKETS 15
+
+typedef enum {
+  LOOP_TIMING_INPUT,
+  LOOP_TIMING_STATE,
+  LOOP_TIMING_OUTPUT,
+  // The three stages back to back
+  LOOP_TIMING_PASS,
+  LOOP_TIMING_STAGE_COUNT
+} LoopTiming_Stage_T;
+
+// All in core clock cycles
+typedef struct {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint32_t histogram[LOOP_TIMING_BUCKETS];
+} LoopTiming_Stats_T;
+
+#if LOOP_TIMING
+
+void LoopTiming_init(void);
+
+/**
+ * @details adds one run of stage taking cycles, main loop only
+ */
+void LoopTiming_record(LoopTiming_Stage_T stage, uint32_t cycles);
+
+const LoopTiming_Stats_T *LoopTiming_get_stats(LoopTiming_Stage_T stage);
+
+/**
+ * @details histogram bucket a span falls into
+ */
+uint8_t LoopTiming_bucket(uint32_t cycles);
+
+#define LOOP_TIMING_RECORD(stage, cycles) LoopTiming_record(stage, cycles)
+
+#else
+
+#define LOOP_TIMING_RECORD(stage, cycles)
+
+#endif // LOOP_TIMING
+
+#endif // _LOOP_TIMING_H_
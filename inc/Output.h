@@ -6,8 +6,23 @@
 
 #include "Types.h"
 
+typedef struct {
+  // DriverOutput frames queued
+  uint32_t driver_outputs;
+  // Of those, the ones that had to be worked out again
+  uint32_t driver_outputs_computed;
+} Output_Stats_T;
+
 void Output_initialize(Output_T *output);
 void Output_process_output(Input_T *input, State_T *state, Output_T *output);
 
+/**
+ * @details brake_1_raw above which DriverOutput reports the brake engaged,
+ * with the HV light on and off
+ */
+void Output_set_brake_engaged_raw(uint16_t hv_raw, uint16_t lv_raw);
+
+const Output_Stats_T *Output_get_stats(void);
+
 #endif
 
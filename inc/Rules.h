@@ -3,9 +3,35 @@
 
 #include "Types.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
-void Rules_update_implausibility(Adc_Input_T *adc, Rules_State_T *rules, uint32_t msTicks);
+/**
+ * @details clears every rule and makes the next Rules_update evaluate
+ * whatever the input
+ */
+void Rules_initialize(Rules_State_T *rules);
+
+/**
+ * @details evaluates both rules if the ADC input has changed since the last
+ * time, the conflict threshold has, or an implausibility is due to be
+ * reported. Otherwise they would come out the same, and are skipped.
+ * @return true if the rules were evaluated
+ */
+bool Rules_update(Input_T *input, Rules_State_T *rules);
+
+/**
+ * @details msTicks at which Rules_update has to run with no new input
+ * @return false if there is no such deadline
+ */
+bool Rules_next_deadline(const Rules_State_T *rules, uint32_t *deadline_ms);
+
+void Rules_update_implausibility(Derived_Input_T *derived, Rules_State_T *rules, uint32_t msTicks);
 void Rules_update_conflict(Input_T *input, Rules_State_T *rules);
 
+/**
+ * @details brake_1_raw above which the brake counts as pressed for EV2.5
+ */
+void Rules_set_conflict_brake_raw(uint16_t brake_raw);
+
 #endif //_RULES_H_
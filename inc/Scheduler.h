@@ -0,0 +1,65 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Due tasks are reported as a bitmask
+#define SCHEDULER_MAX_TASKS 32
+
+// Task i is released at start + phase_ms + k * period_ms for k = 0, 1, ...
+typedef struct {
+  uint32_t period_ms;
+  uint32_t phase_ms;
+} Scheduler_Entry_T;
+
+typedef struct {
+  uint32_t next_due_ms;
+  uint32_t last_run_ms;
+
+  uint32_t runs;
+  // Releases dropped because the task was more than a whole period late
+  uint32_t skipped;
+
+  // How long after its release the task actually ran
+  uint32_t lateness_max_ms;
+  uint32_t lateness_sum_ms;
+
+  // Largest difference between the interval between two runs and the period
+  uint32_t jitter_max_ms;
+} Scheduler_Task_T;
+
+typedef struct {
+  const Scheduler_Entry_T *entries;
+  Scheduler_Task_T *tasks;
+  uint8_t length;
+
+  // Earliest next_due_ms of all tasks, so checking for due work is O(1)
+  uint32_t next_due_ms;
+} Scheduler_T;
+
+/**
+ * @details starts every task's schedule at start_ms. tasks must have room for
+ * length entries, and length must be at most SCHEDULER_MAX_TASKS.
+ */
+void Scheduler_init(Scheduler_T *scheduler, const Scheduler_Entry_T *entries,
+    Scheduler_Task_T *tasks, uint8_t length, uint32_t start_ms);
+
+/**
+ * @details advances every task that is due at msTicks to its next release
+ * @return bit i set iff task i should run now
+ */
+uint32_t Scheduler_poll(Scheduler_T *scheduler, uint32_t msTicks);
+
+/**
+ * @details msTicks value of the earliest upcoming release
+ */
+uint32_t Scheduler_next_due(const Scheduler_T *scheduler);
+
+/**
+ * @details wrap-safe check of whether msTicks has reached deadline_ms, valid
+ * while the two are within 2^31 ms of each other
+ */
+bool Scheduler_reached(uint32_t deadline_ms, uint32_t msTicks);
+
+#endif // _SCHEDULER_H_
@@ -3,8 +3,36 @@
 
 #include <stdint.h>
 
+// Bytes queued for the UART interrupt to send. Must be a power of two.
+#define SERIAL_TX_RING_SIZE 256
+#define SERIAL_TX_RING_MASK (SERIAL_TX_RING_SIZE - 1)
+
+// What to do with a write that does not fit in the ring
+typedef enum {
+  // Drop the whole new write, keeping what is queued intact
+  SERIAL_DROP_NEWEST,
+  // Discard the oldest unsent bytes to make room
+  SERIAL_DROP_OLDEST
+} Serial_Drop_Policy_T;
+
+typedef struct {
+  uint32_t queued_bytes;
+  uint32_t dropped_bytes;
+  uint32_t dropped_writes;
+  uint32_t high_water;
+} Serial_Stats_T;
+
 void Serial_Init(uint32_t baudrate);
 
+void Serial_SetDropPolicy(Serial_Drop_Policy_T policy);
+
+const Serial_Stats_T *Serial_GetStats(void);
+
+/**
+ * @details the print functions only queue bytes and never wait for the UART.
+ * They are to be called from the main loop only.
+ * @return number of bytes queued, 0 if the write was dropped
+ */
 uint32_t Serial_Print(const char *str);
 
 void Serial_Print_Void(const char *str);
@@ -15,4 +43,9 @@ uint32_t Serial_PrintNumber(uint32_t n, uint32_t base);
 
 uint32_t Serial_PrintlnNumber(uint32_t n, uint32_t base);
 
+/**
+ * @details queues len raw bytes as a single write
+ */
+uint32_t Serial_Write(const char *data, uint32_t len);
+
 #endif //SERIAL_H
@@ -6,7 +6,25 @@
 
 #include "Types.h"
 
+typedef struct {
+  uint32_t passes;
+  // Passes Rules_update found something to evaluate on
+  uint32_t rules_runs;
+} State_Stats_T;
+
 void State_initialize(State_T *state);
 void State_update_state(Input_T *input, State_T *state, Output_T *output);
 
+/**
+ * @details msTicks value at which the next periodic message falls due
+ */
+uint32_t State_next_deadline(State_T *state);
+
+/**
+ * @details replaces the period of every message, indexed by Message_T
+ */
+void State_set_message_periods(const uint16_t *periods_ms);
+
+const State_Stats_T *State_get_stats(void);
+
 #endif // STATE_H
@@ -0,0 +1,139 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Latency.h"
+#include "LoopTiming.h"
+
+/**
+ * Binary telemetry records over the UART.
+ *
+ * Each record is
+ *   type (1) | sequence (1) | msTicks (4) | payload | CRC-16/CCITT (2)
+ * with multi-byte fields little endian and the CRC over everything before
+ * it. The record is COBS encoded and followed by a 0x00 delimiter, so a
+ * reader can pick up the stream anywhere. The sequence number counts every
+ * record written, so gaps show records dropped when the ring was full.
+ */
+
+typedef enum {
+  TELEMETRY_THROTTLE,
+  TELEMETRY_BRAKE,
+  // One per Current_Sensor_Values_T, in the same order
+  TELEMETRY_CS_VOLTAGE,
+  TELEMETRY_CS_CURRENT,
+  TELEMETRY_CS_POWER,
+  TELEMETRY_CS_ENERGY,
+  TELEMETRY_MC_DATA,
+  TELEMETRY_MC_STATE,
+  TELEMETRY_LATENCY,
+  // Only sent when built with LOOP_TIMING
+  TELEMETRY_LOOP_TIMING,
+  TELEMETRY_RECORD_LENGTH
+} Telemetry_Record_T;
+
+#define TELEMETRY_HEADER_SIZE 6
+#define TELEMETRY_CRC_SIZE 2
+
+// Payload sizes on the wire
+#define TELEMETRY_THROTTLE_SIZE 11
+#define TELEMETRY_BRAKE_SIZE 6
+#define TELEMETRY_CS_SIZE 8
+#define TELEMETRY_MC_DATA_SIZE 6
+#define TELEMETRY_MC_STATE_SIZE 8
+#define TELEMETRY_LATENCY_SIZE (16 + 4 * LATENCY_BUCKETS)
+#define TELEMETRY_LOOP_TIMING_SIZE (13 + 4 * LOOP_TIMING_BUCKETS)
+#if LOOP_TIMING
+#define TELEMETRY_MAX_PAYLOAD_SIZE TELEMETRY_LOOP_TIMING_SIZE
+#else
+#define TELEMETRY_MAX_PAYLOAD_SIZE TELEMETRY_LATENCY_SIZE
+#endif
+
+#define TELEMETRY_MAX_RECORD_SIZE \
+  (TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD_SIZE + TELEMETRY_CRC_SIZE)
+// COBS adds one byte per 254, and the delimiter one more
+#define TELEMETRY_MAX_FRAME_SIZE (TELEMETRY_MAX_RECORD_SIZE + 2)
+
+// Flag bits of the throttle record
+#define TELEMETRY_THROTTLE_IMPLAUSIBILITY_OBSERVED (1 << 0)
+#define TELEMETRY_THROTTLE_IMPLAUSIBILITY_REPORTED (1 << 1)
+// Flag bits of the brake record
+#define TELEMETRY_BRAKE_CONFLICT (1 << 0)
+// Flag bits of the motor controller state record
+#define TELEMETRY_MC_STATE_HV_ENABLED (1 << 0)
+
+typedef struct {
+  uint16_t accel_1_raw;
+  uint16_t accel_2_raw;
+  uint16_t accel_1_travel;
+  uint16_t accel_2_travel;
+  uint16_t accel_torque;
+  uint8_t flags;
+} Telemetry_Throttle_T;
+
+typedef struct {
+  uint16_t brake_1_raw;
+  uint16_t brake_2_raw;
+  uint8_t brake_pressure;
+  uint8_t flags;
+} Telemetry_Brake_T;
+
+typedef struct {
+  int32_t value;
+  uint32_t last_updated;
+} Telemetry_Current_Sensor_T;
+
+typedef struct {
+  int16_t motor_speed;
+  uint32_t last_updated;
+} Telemetry_Mc_Data_T;
+
+typedef struct {
+  uint8_t limp_state;
+  uint8_t flags;
+  uint16_t lv_voltage;
+  uint32_t last_updated;
+} Telemetry_Mc_State_T;
+
+typedef struct {
+  // Records queued on the UART
+  uint32_t records;
+  // Records dropped whole because the serial ring was full
+  uint32_t dropped;
+  // Encoded bytes queued, delimiters included
+  uint32_t bytes;
+} Telemetry_Stats_T;
+
+/**
+ * @details writes a lone delimiter so the first record is not glued to
+ * whatever text came before it. Call once after Serial_Init.
+ */
+void Telemetry_init(void);
+
+/**
+ * @details the write functions encode one record and queue it on the UART
+ * without waiting. They are to be called from the main loop only.
+ * @return false if the record was dropped
+ */
+bool Telemetry_write_throttle(uint32_t msTicks, const Telemetry_Throttle_T *record);
+bool Telemetry_write_brake(uint32_t msTicks, const Telemetry_Brake_T *record);
+bool Telemetry_write_current_sensor(uint32_t msTicks, Telemetry_Record_T type,
+    const Telemetry_Current_Sensor_T *record);
+bool Telemetry_write_mc_data(uint32_t msTicks, const Telemetry_Mc_Data_T *record);
+bool Telemetry_write_mc_state(uint32_t msTicks, const Telemetry_Mc_State_T *record);
+bool Telemetry_write_latency(uint32_t msTicks, const Latency_Stats_T *record);
+#if LOOP_TIMING
+bool Telemetry_write_loop_timing(uint32_t msTicks, LoopTiming_Stage_T stage,
+    const LoopTiming_Stats_T *record);
+#endif
+
+const Telemetry_Stats_T *Telemetry_get_stats(void);
+
+/**
+ * @details CRC-16/CCITT-FALSE, shared with the host decoder
+ */
+uint16_t Telemetry_crc16(const uint8_t *data, uint32_t len);
+
+#endif // _TELEMETRY_H_
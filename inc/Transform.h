@@ -3,9 +3,52 @@
 
 #include <stdint.h>
 
+// Pedal travel in thousandths, as used by the EV2.3/EV2.5 rules
+#define TRANSFORM_TRAVEL_WIDTH 1000
+// Pedal travel scaled to a motor controller torque request
+#define TRANSFORM_TORQUE_WIDTH 32767
+
+#define TRANSFORM_RECIPROCAL_SHIFT 16
+
+// Precomputed form of Transform_linear_transfer_fn for one bound pair and
+// width. reciprocal is floor(desired_width * 2^16 / diff), which always
+// fits in 32 bits since desired_width < 2^16.
+typedef struct {
+  uint16_t lower_bound;
+  uint16_t upper_bound;
+  uint16_t desired_width;
+  uint32_t reciprocal;
+} Transform_Linear_T;
+
+#define TRANSFORM_LINEAR(lower, upper, width) { \
+  (lower), (upper), (width), \
+  ((uint32_t)(width) << TRANSFORM_RECIPROCAL_SHIFT) / ((upper) - (lower)) }
+
 uint16_t Transform_accel_1(uint16_t reading, uint16_t desired_width);
 uint16_t Transform_accel_2(uint16_t reading, uint16_t desired_width);
 uint16_t Transform_linear_transfer_fn(uint32_t reading, uint16_t desired_width, uint16_t lower_bound, uint16_t upper_bound);
 
+// Division-free versions of Transform_accel_1/2 for the widths above
+uint16_t Transform_accel_1_travel(uint16_t reading);
+uint16_t Transform_accel_2_travel(uint16_t reading);
+uint16_t Transform_accel_1_torque(uint16_t reading);
+uint16_t Transform_accel_2_torque(uint16_t reading);
+uint16_t Transform_linear_apply(const Transform_Linear_T *fn, uint32_t reading);
+
+/**
+ * @details TRANSFORM_LINEAR for bounds only known at runtime. The bounds
+ * must differ.
+ */
+void Transform_linear_init(Transform_Linear_T *fn, uint16_t lower_bound,
+    uint16_t upper_bound, uint16_t desired_width);
+
+/**
+ * @details replaces the pedal bounds used by the accel transforms above
+ */
+void Transform_set_accel_bounds(uint16_t accel_1_lower, uint16_t accel_1_upper,
+    uint16_t accel_2_lower, uint16_t accel_2_upper);
+
+uint32_t Transform_click_time_to_mRPM(uint32_t us_per_click);
+
 
 #endif // _TRANSFORM_H_
@@ -6,6 +6,9 @@
 
 #include <MY17_Can_Library.h>
 
+#include "LoopTiming.h"
+#include "Scheduler.h"
+
 typedef struct {
   uint16_t accel_1_raw;
   uint16_t accel_2_raw;
@@ -13,8 +16,32 @@ typedef struct {
   uint16_t brake_2_raw;
 
   uint32_t last_updated;
+  // Clock_us when the channels were read, for latency tracing
+  uint32_t sampled_us;
 } Adc_Input_T;
 
+// Signals computed from Adc_Input_T, refreshed only when a new ADC sample
+// comes in so that Rules and Output do not each convert the raw values again
+typedef struct {
+  // Pedal travel in thousandths of full travel, and the lower of the two
+  uint16_t accel_1_travel;
+  uint16_t accel_2_travel;
+  uint16_t accel_travel;
+
+  // Lower of the two pedal travels scaled to a torque request
+  uint16_t accel_torque;
+
+  // brake_1_raw scaled from ten bits down to one byte
+  uint8_t brake_pressure;
+  // brake_1_raw itself, as of the last sample, to tell when it changes
+  uint16_t brake_1_raw;
+
+  // Adc_Input_T::last_updated of the sample these were derived from
+  uint32_t adc_updated;
+  // Adc_Input_T::sampled_us of the same sample
+  uint32_t adc_sampled_us;
+} Derived_Input_T;
+
 typedef enum {
   LEFT,
   RIGHT,
@@ -29,6 +56,9 @@ typedef struct {
   uint32_t tick_count[NUM_WHEELS];
   uint32_t tick_us[NUM_WHEELS];
   uint32_t moving_avg_us[NUM_WHEELS];
+  // Tooth period estimate reported on CAN, from whichever estimator main.c
+  // is built with
+  uint32_t period_us[NUM_WHEELS];
   bool wheel_stopped[NUM_WHEELS];
 } Speed_Input_T;
 
@@ -45,23 +75,65 @@ typedef enum {
   CS_VALUES_LENGTH
 } Current_Sensor_Values_T;
 
+// Voltage in mV, current in mA, power in W and energy in Wh, as sent by the
+// current sensor
 typedef struct {
   int32_t data[CS_VALUES_LENGTH];
   uint32_t last_updated[CS_VALUES_LENGTH];
 } Current_Sensor_Input_T;
 
+// Integrated from Current_Sensor_Input_T as current samples come in, so
+// that the VCU and dash are sent energy and average power rather than each
+// integrating the raw stream. 64-bit fixed point in nJ.
+typedef struct {
+  int64_t total_nJ;
+  // Since window_start_ms
+  int64_t window_nJ;
+  // Voltage times current at the last sample integrated, in uW
+  int64_t power_uW;
+  // power_uW is usable as the start of the next trapezoid
+  bool have_power;
+  // Current_Sensor_Input_T::last_updated[CS_Current] of that sample
+  uint32_t sample_ms;
+  uint32_t window_start_ms;
+
+  // The last complete window
+  int32_t window_energy_J;
+  int32_t window_power_W;
+  uint32_t windows;
+  // Samples not integrated across, for a stale voltage or a long gap
+  uint32_t gaps;
+} Energy_Input_T;
+
 typedef struct {
   bool hv_enabled;
   uint16_t lv_voltage;
   Can_Vcu_LimpState_T limp_state;
+  uint32_t last_updated;
 } Misc_Input_T;
 
+// Inputs that Rules and DriverOutput are worked out from. Each has a
+// generation in Input_T that moves only when one of the values they use
+// changes, so that they can skip passes where nothing did.
+typedef enum {
+  // Derived_Input_T, or brake_1_raw
+  INPUT_ADC,
+  // motor_speed
+  INPUT_MC,
+  // Misc_Input_T
+  INPUT_MISC,
+  INPUT_SOURCES
+} Input_Source_T;
+
 typedef struct {
   Adc_Input_T *adc;
+  Derived_Input_T *derived;
   Speed_Input_T *speed;
   Mc_Input_T *mc;
   Current_Sensor_Input_T *current_sensor;
+  Energy_Input_T *energy;
   Misc_Input_T *misc;
+  uint32_t generation[INPUT_SOURCES];
   uint32_t msTicks;
 } Input_T;
 
@@ -83,14 +155,41 @@ typedef struct {
   // for >100ms (EV2.3.5)
   bool implausibility_reported;
 
+  // Input_T::generation[INPUT_ADC] the rules were last evaluated at
+  uint32_t adc_generation;
+
+  // Set by Rules_initialize until the rules are first evaluated
+  bool stale;
+
+  // Generation of the Rules settings they were last evaluated with
+  uint32_t config_generation;
+
 } Rules_State_T;
 
+// Periodic outputs, one scheduler task each
+typedef enum {
+  MESSAGE_CAN_DRIVER_OUTPUT,
+  MESSAGE_CAN_RAW_VALUES,
+  MESSAGE_CAN_WHEEL_SPEED,
+  MESSAGE_CAN_ENERGY,
+  MESSAGE_LOGGING_THROTTLE,
+  MESSAGE_LOGGING_BRAKE,
+  MESSAGE_LOGGING_MC_DATA,
+  MESSAGE_LOGGING_CS_VOLTAGE,
+  MESSAGE_LOGGING_CS_CURRENT,
+  MESSAGE_LOGGING_CS_POWER,
+  MESSAGE_LOGGING_CS_ENERGY,
+  MESSAGE_LOGGING_MC_STATE,
+  MESSAGE_LOGGING_LATENCY,
+#if LOOP_TIMING
+  MESSAGE_LOGGING_LOOP_TIMING,
+#endif
+  MESSAGE_LENGTH
+} Message_T;
+
 typedef struct {
-  uint32_t can_driver_output_ms;
-  uint32_t can_raw_values_ms;
-  uint32_t can_wheel_speed_ms;
-  uint32_t logging_throttle_ms;
-  uint32_t logging_brake_ms;
+  Scheduler_T scheduler;
+  Scheduler_Task_T tasks[MESSAGE_LENGTH];
 } Message_State_T;
 
 typedef struct {
@@ -102,6 +201,7 @@ typedef struct {
   bool send_driver_output_msg;
   bool send_raw_values_msg;
   bool send_wheel_speed_msg;
+  bool send_energy_msg;
 } Can_Output_T;
 
 typedef struct {
@@ -110,6 +210,10 @@ typedef struct {
   bool write_cs_log[CS_VALUES_LENGTH];
   bool write_mc_data_log;
   bool write_mc_state_log;
+  bool write_latency_log;
+#if LOOP_TIMING
+  bool write_loop_timing_log;
+#endif
 } Logging_Output_T;
 
 typedef struct {
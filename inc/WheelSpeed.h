@@ -0,0 +1,102 @@
+#ifndef _WHEEL_SPEED_H_
+#define _WHEEL_SPEED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Types.h"
+
+// The adaptive estimate averages the fewest recent teeth that span at least
+// this long, between 1 and NUM_TEETH of them
+#define WHEEL_SPEED_WINDOW_US 20000
+
+// Spacing corrections are Q16 factors applied to each raw tooth period
+#define WHEEL_SPEED_SPACING_ONE (1UL << 16)
+// Each steady tick moves its tooth's factor 1/2^shift of the way to target
+#define WHEEL_SPEED_SPACING_LEARN_SHIFT 4
+// Only learn while this tooth's period is within 1/2^shift of its period
+// one revolution ago, so acceleration is not mistaken for spacing error
+#define WHEEL_SPEED_SPACING_STEADY_SHIFT 6
+
+// Everything the main loop needs from one wheel, taken as a consistent set
+typedef struct {
+  // Ticks since the wheel last started moving
+  uint32_t count;
+  // Length of the most recent tooth period in us
+  uint32_t latest_us;
+  // Sum of the last NUM_TEETH tooth periods, weighted NUM_TEETH for the
+  // newest down to 1 for the oldest
+  uint64_t big_sum;
+  // msTicks at the most recent tick
+  uint32_t last_updated;
+  // Spacing-corrected tooth periods of the adaptive window, and how many
+  uint32_t window_sum_us;
+  uint8_t window_count;
+} WheelSpeed_Snapshot_T;
+
+typedef struct {
+  uint32_t ticks;
+  // Longest WheelSpeed_isr_tick in core clock cycles
+  uint32_t isr_max_cycles;
+  // Times WheelSpeed_read had to copy again because a tick came in
+  uint32_t read_retries;
+} WheelSpeed_Stats_T;
+
+void WheelSpeed_init(void);
+
+/**
+ * @details records one tooth period, to be called from that wheel's capture
+ * interrupt only. Constant time, except that keeping the adaptive window
+ * drops up to NUM_TEETH - 1 teeth when it is on.
+ */
+void WheelSpeed_isr_tick(Wheel_T wheel, uint32_t tick_us, uint32_t msTicks);
+
+/**
+ * @details copies out the wheel's state without masking interrupts. Retries
+ * if a tick lands during the copy, which at the ~20 cycle copy takes a
+ * tooth rate far beyond anything the car reaches to repeat more than once.
+ */
+void WheelSpeed_read(Wheel_T wheel, WheelSpeed_Snapshot_T *snapshot);
+
+/**
+ * @details tooth period from the weighted sum over the last revolution,
+ * or the latest single period until a full revolution has been seen
+ */
+uint32_t WheelSpeed_weighted_us(const WheelSpeed_Snapshot_T *snapshot);
+
+/**
+ * @details tooth period averaged over the adaptive window. If no tick has
+ * come for longer than that, the wheel is slowing down and the time since
+ * the last tick is the better bound, so it is returned instead.
+ * @param since_last_us lower bound on the time since the latest tick
+ */
+uint32_t WheelSpeed_adaptive_us(const WheelSpeed_Snapshot_T *snapshot,
+    uint32_t since_last_us);
+
+/**
+ * @details turns keeping the adaptive window on or off for every wheel.
+ * While off the window is left as it was, and WheelSpeed_adaptive_us
+ * should not be used until a revolution after turning it back on.
+ */
+void WheelSpeed_set_adaptive(bool enabled);
+
+/**
+ * @details turns online learning and use of per-tooth spacing factors on or
+ * off for every wheel. Factors already learned are kept while off.
+ */
+void WheelSpeed_set_spacing_correction(bool enabled);
+
+/**
+ * @details learned Q16 spacing factor of one tooth, counted from the first
+ * tick after boot
+ */
+uint32_t WheelSpeed_spacing_factor(Wheel_T wheel, uint8_t tooth);
+
+/**
+ * @details while set, each tick just restarts the wheel's averages
+ */
+void WheelSpeed_set_disregard(Wheel_T wheel, bool disregard);
+
+const WheelSpeed_Stats_T *WheelSpeed_get_stats(Wheel_T wheel);
+
+#endif // _WHEEL_SPEED_H_
@@ -0,0 +1,460 @@
+/**
+ * Host micro-benchmarks for the firmware's hot functions.
+ *
+ * Each benchmark sweeps one function over the full range of its inputs,
+ * repeats the sweep until it has run long enough to time, and keeps the
+ * fastest of several runs. Along with the time per call it reports a
+ * checksum of every result, which does not depend on the host and changes
+ * only if the function's behavior does.
+ *
+ * Results are written as JSON, one benchmark per line. Given a baseline in
+ * the same format, the exit status is 1 if any checksum changed. Host
+ * timings only compare on the same machine, so they are never part of the
+ * baseline and never fail the run: given a previous run's output, each
+ * benchmark that got slower than the tolerance is only reported.
+ * "make bench_baseline" refreshes the checksums.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Calibration.h"
+#include "Common.h"
+#include "Sim.h"
+#include "Transform.h"
+#include "Types.h"
+#include "WheelSpeed.h"
+
+#define MIN_RUN_NS 50000000ULL
+#define RUNS 5
+#define DEFAULT_TOLERANCE_PERCENT 25.0
+#define MAX_BENCHMARKS 16
+#define MAX_NAME_LENGTH 64
+
+// Same widths as src/Input.c
+#define ADC_MAX 1023
+#define BYTE_MAX 255
+
+// Firmware entry points from src/output.c, src/Rules.c and src/main.c
+int16_t apply_torque_ramp(int16_t motor_speed, int16_t requested_torque);
+int16_t apply_limp(Can_Vcu_LimpState_T limp, int16_t torque);
+bool check_implausibility(uint16_t accel_1_travel, uint16_t accel_2_travel);
+void handle_interrupt(LPC_TIMER_T *timer, Wheel_T wheel);
+
+// One sweep over the inputs, returning a checksum of the results
+typedef uint32_t (*Sweep_Fn_T)(uint32_t *calls);
+
+typedef struct {
+  const char *name;
+  Sweep_Fn_T sweep;
+} Benchmark_T;
+
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  uint32_t calls;
+  double ns_per_call;
+  uint32_t checksum;
+} Result_T;
+
+static uint32_t mix(uint32_t checksum, uint32_t value) {
+  return checksum * 31 + value;
+}
+
+/*****************************************************************************
+ * Sweeps
+ ****************************************************************************/
+
+static uint32_t sweep_linear_transfer_fn(uint32_t *calls) {
+  static const uint16_t widths[] = { TRANSFORM_TRAVEL_WIDTH, TRANSFORM_TORQUE_WIDTH };
+  uint32_t checksum = 0;
+  uint32_t reading;
+  uint8_t w;
+  *calls = 0;
+  for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+    for (reading = 0; reading <= ADC_MAX; reading++) {
+      checksum = mix(checksum, Transform_linear_transfer_fn(reading, widths[w],
+            CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND,
+            CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND));
+      checksum = mix(checksum, Transform_linear_transfer_fn(reading, widths[w],
+            CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND,
+            CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND));
+      *calls += 2;
+    }
+  }
+  return checksum;
+}
+
+static uint32_t sweep_linear_apply(uint32_t *calls) {
+  uint32_t checksum = 0;
+  uint16_t reading;
+  *calls = 0;
+  for (reading = 0; reading <= ADC_MAX; reading++) {
+    checksum = mix(checksum, Transform_accel_1_travel(reading));
+    checksum = mix(checksum, Transform_accel_2_travel(reading));
+    checksum = mix(checksum, Transform_accel_1_torque(reading));
+    checksum = mix(checksum, Transform_accel_2_torque(reading));
+    *calls += 4;
+  }
+  return checksum;
+}
+
+static uint32_t sweep_apply_torque_ramp(uint32_t *calls) {
+  static const int16_t torques[] = { 0, 8000, 16383, 24000, 32767 };
+  uint32_t checksum = 0;
+  int32_t speed;
+  uint8_t t;
+  *calls = 0;
+  for (t = 0; t < sizeof(torques) / sizeof(torques[0]); t++) {
+    for (speed = INT16_MIN; speed <= INT16_MAX; speed++) {
+      checksum = mix(checksum, (uint16_t)apply_torque_ramp(speed, torques[t]));
+      (*calls)++;
+    }
+  }
+  return checksum;
+}
+
+static uint32_t sweep_apply_limp(uint32_t *calls) {
+  uint32_t checksum = 0;
+  int32_t torque;
+  uint8_t limp;
+  *calls = 0;
+  for (limp = CAN_LIMP_NORMAL; limp <= CAN_LIMP_25; limp++) {
+    for (torque = INT16_MIN; torque <= INT16_MAX; torque++) {
+      checksum = mix(checksum, (uint16_t)apply_limp((Can_Vcu_LimpState_T)limp, torque));
+      (*calls)++;
+    }
+  }
+  return checksum;
+}
+
+// Every period below 2^16 us, then strides across the rest of the range
+static uint32_t sweep_click_time_to_mRPM(uint32_t *calls) {
+  uint32_t checksum = 0;
+  uint32_t us;
+  *calls = 0;
+  for (us = 0; us < (1UL << 16); us++) {
+    checksum = mix(checksum, Transform_click_time_to_mRPM(us));
+    (*calls)++;
+  }
+  for (us = 1UL << 16; us < UINT32_MAX - 65521; us += 65521) {
+    checksum = mix(checksum, Transform_click_time_to_mRPM(us));
+    (*calls)++;
+  }
+  return checksum;
+}
+
+static uint32_t sweep_check_implausibility(uint32_t *calls) {
+  uint32_t checksum = 0;
+  uint16_t accel_1;
+  uint16_t accel_2;
+  *calls = 0;
+  for (accel_1 = 0; accel_1 <= TRANSFORM_TRAVEL_WIDTH; accel_1 += 4) {
+    for (accel_2 = 0; accel_2 <= TRANSFORM_TRAVEL_WIDTH; accel_2 += 4) {
+      checksum = mix(checksum, check_implausibility(accel_1, accel_2));
+      (*calls)++;
+    }
+  }
+  return checksum;
+}
+
+static uint32_t sweep_scale(uint32_t *calls) {
+  uint32_t checksum = 0;
+  uint32_t val;
+  *calls = 0;
+  for (val = 0; val <= ADC_MAX; val++) {
+    checksum = mix(checksum, scale(val, ADC_MAX, BYTE_MAX));
+    (*calls)++;
+  }
+  return checksum;
+}
+
+// Tooth periods from 1 us up to where the 32-bit capture would wrap,
+// alternating wheels, with the state read back at the end
+static uint32_t sweep_handle_interrupt(uint32_t *calls) {
+  const uint32_t max_us = UINT32_MAX / CYCLES_PER_MICROSECOND;
+  uint32_t checksum = 0;
+  uint32_t us;
+  uint32_t step = 1;
+  *calls = 0;
+  WheelSpeed_init();
+  // The costlier configuration, which is what the ISR has to budget for
+  WheelSpeed_set_adaptive(true);
+  for (us = 1; us < max_us - step; us += step) {
+    const Wheel_T wheel = *calls & 1 ? RIGHT : LEFT;
+    LPC_TIMER_T *timer = wheel == LEFT ? LPC_TIMER32_0 : LPC_TIMER32_1;
+    Sim_set_capture(timer, us * CYCLES_PER_MICROSECOND);
+    handle_interrupt(timer, wheel);
+    (*calls)++;
+    // Dense where the car actually runs, sparse towards the top
+    step = 1 + us / 64;
+  }
+  uint8_t wheel;
+  for (wheel = 0; wheel < NUM_WHEELS; wheel++) {
+    WheelSpeed_Snapshot_T snapshot;
+    WheelSpeed_read(wheel, &snapshot);
+    checksum = mix(checksum, snapshot.count);
+    checksum = mix(checksum, snapshot.latest_us);
+    checksum = mix(checksum, (uint32_t)snapshot.big_sum);
+    checksum = mix(checksum, snapshot.window_sum_us);
+  }
+  return checksum;
+}
+
+// Reads of both wheels between ticks, so every read sees a fresh
+// publication rather than a cached one
+static uint32_t sweep_wheel_speed_read(uint32_t *calls) {
+  uint32_t checksum = 0;
+  uint32_t i;
+  *calls = 0;
+  WheelSpeed_init();
+  WheelSpeed_set_adaptive(true);
+  for (i = 0; i < 4096; i++) {
+    WheelSpeed_isr_tick(i & 1 ? RIGHT : LEFT, 1000 + (i & 0xFF), i);
+    uint8_t wheel;
+    for (wheel = 0; wheel < NUM_WHEELS; wheel++) {
+      WheelSpeed_Snapshot_T snapshot;
+      WheelSpeed_read(wheel, &snapshot);
+      checksum = mix(checksum, snapshot.count);
+      checksum = mix(checksum, snapshot.latest_us);
+      checksum = mix(checksum, (uint32_t)snapshot.big_sum);
+      (*calls)++;
+    }
+  }
+  return checksum;
+}
+
+static const Benchmark_T benchmarks[] = {
+  { "Transform_linear_transfer_fn", sweep_linear_transfer_fn },
+  { "Transform_linear_apply", sweep_linear_apply },
+  { "apply_torque_ramp", sweep_apply_torque_ramp },
+  { "apply_limp", sweep_apply_limp },
+  { "Transform_click_time_to_mRPM", sweep_click_time_to_mRPM },
+  { "check_implausibility", sweep_check_implausibility },
+  { "scale", sweep_scale },
+  { "handle_interrupt", sweep_handle_interrupt },
+  { "WheelSpeed_read", sweep_wheel_speed_read },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/*****************************************************************************
+ * Timing
+ ****************************************************************************/
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run_benchmark(const Benchmark_T *benchmark, Result_T *result) {
+  snprintf(result->name, sizeof(result->name), "%s", benchmark->name);
+  result->checksum = benchmark->sweep(&result->calls);
+
+  // Enough sweeps per run to make the clock reads negligible
+  uint64_t start = now_ns();
+  uint32_t sweeps = 1;
+  uint32_t calls;
+  benchmark->sweep(&calls);
+  const uint64_t sweep_ns = now_ns() - start;
+  if (sweep_ns < MIN_RUN_NS) {
+    sweeps = MIN_RUN_NS / (sweep_ns + 1) + 1;
+  }
+
+  uint64_t best_ns = UINT64_MAX;
+  uint8_t run;
+  for (run = 0; run < RUNS; run++) {
+    uint32_t i;
+    start = now_ns();
+    for (i = 0; i < sweeps; i++) {
+      benchmark->sweep(&calls);
+    }
+    const uint64_t run_ns = now_ns() - start;
+    best_ns = run_ns < best_ns ? run_ns : best_ns;
+  }
+  result->ns_per_call = (double)best_ns / sweeps / result->calls;
+}
+
+/*****************************************************************************
+ * JSON
+ ****************************************************************************/
+
+// @param timing false to leave out the host timings, as in the baseline
+static void write_json(FILE *out, const Result_T *results, uint32_t count, bool timing) {
+  fprintf(out, "{\n  \"benchmarks\": [\n");
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    fprintf(out, "    {\"name\": \"%s\", \"calls\": %u, ", results[i].name, results[i].calls);
+    if (timing) {
+      fprintf(out, "\"ns_per_call\": %.3f, ", results[i].ns_per_call);
+    }
+    fprintf(out, "\"checksum\": \"0x%08x\"}%s\n",
+        results[i].checksum, i + 1 < count ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+// Reads back what write_json wrote, one benchmark per line. Entries without
+// a timing have ns_per_call 0.
+// @param required false if a missing file just means no results
+static uint32_t read_json(const char *path, Result_T *results, bool required) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    if (required) {
+      perror(path);
+      exit(1);
+    }
+    return 0;
+  }
+  char line[256];
+  uint32_t count = 0;
+  while (fgets(line, sizeof(line), in) != NULL && count < MAX_BENCHMARKS) {
+    Result_T *result = &results[count];
+    result->ns_per_call = 0;
+    if (sscanf(line, " {\"name\": \"%63[^\"]\", \"calls\": %u, \"ns_per_call\": %lf, "
+          "\"checksum\": \"0x%x\"}", result->name, &result->calls,
+          &result->ns_per_call, &result->checksum) == 4 ||
+        sscanf(line, " {\"name\": \"%63[^\"]\", \"calls\": %u, "
+          "\"checksum\": \"0x%x\"}", result->name, &result->calls,
+          &result->checksum) == 3) {
+      count++;
+    }
+  }
+  fclose(in);
+  return count;
+}
+
+static const Result_T *find_result(const Result_T *results, uint32_t count,
+    const char *name) {
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    if (strcmp(results[i].name, name) == 0) {
+      return &results[i];
+    }
+  }
+  return NULL;
+}
+
+// @return the number of benchmarks whose results differ from the baseline
+static uint32_t check_results(const Result_T *results, const Result_T *baseline,
+    uint32_t baseline_count) {
+  uint32_t changed = 0;
+  uint32_t i;
+  for (i = 0; i < BENCHMARK_COUNT; i++) {
+    const Result_T *result = &results[i];
+    const Result_T *base = find_result(baseline, baseline_count, result->name);
+    if (base == NULL) {
+      fprintf(stderr, "%-30s new, no baseline\n", result->name);
+    } else if (result->checksum != base->checksum || result->calls != base->calls) {
+      fprintf(stderr, "%-30s RESULTS CHANGED: checksum 0x%08x over %u calls, "
+          "baseline 0x%08x over %u\n", result->name, result->checksum,
+          result->calls, base->checksum, base->calls);
+      changed++;
+    }
+  }
+  return changed;
+}
+
+// Advisory only, the previous run may have been on a busier machine
+static void compare_timing(const Result_T *results, const Result_T *previous,
+    uint32_t previous_count, double tolerance_percent) {
+  uint32_t i;
+  for (i = 0; i < BENCHMARK_COUNT; i++) {
+    const Result_T *result = &results[i];
+    const Result_T *prev = find_result(previous, previous_count, result->name);
+    if (prev == NULL || prev->ns_per_call <= 0) {
+      fprintf(stderr, "%-30s %8.3f ns/call\n", result->name, result->ns_per_call);
+      continue;
+    }
+    const double change = 100.0 * (result->ns_per_call / prev->ns_per_call - 1.0);
+    fprintf(stderr, "%-30s %8.3f ns/call, previous %8.3f (%+6.1f%%)%s\n",
+        result->name, result->ns_per_call, prev->ns_per_call, change,
+        change > tolerance_percent ? " slower" : "");
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-b baseline] [-p previous] [-o output] [-c] "
+      "[-t tolerance_percent]\n", argv0);
+  fprintf(stderr, "  -b  fail if any checksum differs from this baseline\n");
+  fprintf(stderr, "  -p  report timings against an earlier run's output, if it exists\n");
+  fprintf(stderr, "  -o  write results as JSON (default stdout)\n");
+  fprintf(stderr, "  -c  leave the timings out of the output, for a baseline\n");
+  fprintf(stderr, "  -t  slowdown flagged against the previous run (default %.0f%%)\n",
+      DEFAULT_TOLERANCE_PERCENT);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *baseline_path = NULL;
+  const char *previous_path = NULL;
+  const char *output_path = NULL;
+  bool timing = true;
+  double tolerance_percent = DEFAULT_TOLERANCE_PERCENT;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:p:o:ct:")) != -1) {
+    switch (opt) {
+      case 'b':
+        baseline_path = optarg;
+        break;
+      case 'p':
+        previous_path = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'c':
+        timing = false;
+        break;
+      case 't':
+        tolerance_percent = strtod(optarg, NULL);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc) {
+    usage(argv[0]);
+  }
+
+  // Read before anything is written, in case they name the same file
+  static Result_T baseline[MAX_BENCHMARKS];
+  const uint32_t baseline_count =
+    baseline_path != NULL ? read_json(baseline_path, baseline, true) : 0;
+  static Result_T previous[MAX_BENCHMARKS];
+  const uint32_t previous_count =
+    previous_path != NULL ? read_json(previous_path, previous, false) : 0;
+
+  static Result_T results[BENCHMARK_COUNT];
+  uint32_t i;
+  for (i = 0; i < BENCHMARK_COUNT; i++) {
+    run_benchmark(&benchmarks[i], &results[i]);
+  }
+
+  FILE *out = stdout;
+  if (output_path != NULL) {
+    out = fopen(output_path, "w");
+    if (out == NULL) {
+      perror(output_path);
+      return 1;
+    }
+  }
+  write_json(out, results, BENCHMARK_COUNT, timing);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  if (previous_path != NULL) {
+    compare_timing(results, previous, previous_count, tolerance_percent);
+  }
+  if (baseline_path == NULL) {
+    return 0;
+  }
+  const uint32_t changed = check_results(results, baseline, baseline_count);
+  fprintf(stderr, "%u of %u benchmarks changed their results\n", changed,
+      (uint32_t)BENCHMARK_COUNT);
+  return changed > 0 ? 1 : 0;
+}
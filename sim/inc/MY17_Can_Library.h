@@ -0,0 +1,145 @@
+#ifndef SIM_MY17_CAN_LIBRARY_H
+#define SIM_MY17_CAN_LIBRARY_H
+
+/**
+ * Host stand-in for MY17_Can_Library.h.
+ *
+ * Declares the message types and read/write entry points this node uses.
+ * Frames are kept as already-unpacked structs in sim/src/can_sim.c instead of
+ * being bit-packed, since only the node logic is under test here.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UNUSED(x) (void)(x)
+
+typedef struct {
+  uint16_t id;
+  uint8_t len;
+  uint8_t data[8];
+} Frame;
+
+typedef enum {
+  Can_No_Msg,
+  Can_Error_Msg,
+  Can_Unknown_Msg,
+  Can_Vcu_DashHeartbeat_Msg,
+  Can_MC_DataReading_Msg,
+  Can_CurrentSensor_Voltage_Msg,
+  Can_CurrentSensor_Current_Msg,
+  Can_CurrentSensor_Power_Msg,
+  Can_CurrentSensor_Energy_Msg,
+  Can_FrontCanNode_DriverOutput_Msg,
+  Can_FrontCanNode_RawValues_Msg,
+  Can_FrontCanNode_WheelSpeed_Msg
+} Can_MsgID_T;
+
+// Standard IDs, as generated into the library from the CAN spec
+#define VCU_DASH_HEARTBEAT__id 0x0D0
+#define MC_DATA_READING__id 0x181
+#define CURRENT_SENSOR_CURRENT__id 0x521
+#define CURRENT_SENSOR_VOLTAGE__id 0x522
+#define CURRENT_SENSOR_POWER__id 0x526
+#define CURRENT_SENSOR_ENERGY__id 0x528
+
+typedef enum {
+  Can_Error_NONE,
+  Can_Error_NO_RX,
+  Can_Error_EPASS,
+  Can_Error_WARN,
+  Can_Error_BOFF,
+  Can_Error_STUF,
+  Can_Error_FORM,
+  Can_Error_ACK,
+  Can_Error_BIT1,
+  Can_Error_BIT0,
+  Can_Error_CRC,
+  Can_Error_UNUSED,
+  Can_Error_UNRECOGNIZED_MSGOBJ,
+  Can_Error_UNRECOGNIZED_ERROR,
+  Can_Error_TX_BUFFER_FULL,
+  Can_Error_RX_BUFFER_FULL
+} Can_ErrorID_T;
+
+typedef enum {
+  CAN_LIMP_NORMAL,
+  CAN_LIMP_50,
+  CAN_LIMP_33,
+  CAN_LIMP_25
+} Can_Vcu_LimpState_T;
+
+typedef enum {
+  CAN_MC_REG_CURRENT_ACTUAL = 0x20,
+  CAN_MC_REG_SPEED_ACTUAL_RPM = 0x30,
+  CAN_MC_REG_MOTOR_TEMP = 0x49
+} Can_MC_RegID_T;
+
+typedef struct {
+  bool hv_light;
+  uint16_t lv_battery_voltage;
+  Can_Vcu_LimpState_T limp_state;
+} Can_Vcu_DashHeartbeat_T;
+
+typedef struct {
+  Can_MC_RegID_T type;
+  int16_t value;
+} Can_MC_DataReading_T;
+
+typedef struct {
+  int32_t voltage_mV;
+} Can_CurrentSensor_Voltage_T;
+
+typedef struct {
+  int32_t current_mA;
+} Can_CurrentSensor_Current_T;
+
+typedef struct {
+  int32_t power_W;
+} Can_CurrentSensor_Power_T;
+
+typedef struct {
+  int32_t energy_Wh;
+} Can_CurrentSensor_Energy_T;
+
+typedef struct {
+  int16_t torque;
+  int16_t torque_before_control;
+  uint8_t brake_pressure;
+  bool throttle_implausible;
+  bool brake_throttle_conflict;
+  bool brake_engaged;
+  int8_t steering_position;
+} Can_FrontCanNode_DriverOutput_T;
+
+typedef struct {
+  uint16_t accel_1_raw;
+  uint16_t accel_2_raw;
+  uint16_t brake_1_raw;
+  uint16_t brake_2_raw;
+} Can_FrontCanNode_RawValues_T;
+
+typedef struct {
+  uint32_t front_left_wheel_speed_mRPM;
+  uint32_t front_right_wheel_speed_mRPM;
+} Can_FrontCanNode_WheelSpeed_T;
+
+void Can_Init(uint32_t baudrate);
+Can_MsgID_T Can_MsgType(void);
+
+Can_ErrorID_T Can_Error_Read(void);
+Can_ErrorID_T Can_Unknown_Read(Frame *frame);
+Can_ErrorID_T Can_RawWrite(Frame *frame);
+
+Can_ErrorID_T Can_Vcu_DashHeartbeat_Read(Can_Vcu_DashHeartbeat_T *msg);
+Can_ErrorID_T Can_MC_DataReading_Read(Can_MC_DataReading_T *msg);
+Can_ErrorID_T Can_CurrentSensor_Voltage_Read(Can_CurrentSensor_Voltage_T *msg);
+Can_ErrorID_T Can_CurrentSensor_Current_Read(Can_CurrentSensor_Current_T *msg);
+Can_ErrorID_T Can_CurrentSensor_Power_Read(Can_CurrentSensor_Power_T *msg);
+Can_ErrorID_T Can_CurrentSensor_Energy_Read(Can_CurrentSensor_Energy_T *msg);
+
+Can_ErrorID_T Can_FrontCanNode_DriverOutput_Write(Can_FrontCanNode_DriverOutput_T *msg);
+Can_ErrorID_T Can_FrontCanNode_RawValues_Write(Can_FrontCanNode_RawValues_T *msg);
+Can_ErrorID_T Can_FrontCanNode_WheelSpeed_Write(Can_FrontCanNode_WheelSpeed_T *msg);
+
+#endif // SIM_MY17_CAN_LIBRARY_H
@@ -0,0 +1,142 @@
+#ifndef SIM_H
+#define SIM_H
+
+/**
+ * Control surface of the host simulator.
+ *
+ * The chip and CAN stand-ins read their inputs from here, and the scenario
+ * runner in sim/sim_main.c drives them. Nothing in src/ includes this file.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip.h"
+#include "MY17_Can_Library.h"
+
+// Receive buffer depth of the simulated CAN controller. Frames arriving while
+// it is full are dropped, like frames left sitting in a message object.
+#define SIM_CAN_RX_DEPTH 8
+
+typedef struct {
+  Can_MsgID_T type;
+  union {
+    Can_ErrorID_T error;
+    Frame unknown;
+    Can_Vcu_DashHeartbeat_T vcu_dash;
+    Can_MC_DataReading_T mc_data;
+    Can_CurrentSensor_Voltage_T cs_voltage;
+    Can_CurrentSensor_Current_T cs_current;
+    Can_CurrentSensor_Power_T cs_power;
+    Can_CurrentSensor_Energy_T cs_energy;
+    Can_FrontCanNode_DriverOutput_T driver_output;
+    Can_FrontCanNode_RawValues_T raw_values;
+    Can_FrontCanNode_WheelSpeed_T wheel_speed;
+  } data;
+} Sim_Can_Msg_T;
+
+typedef void (*Sim_Wfi_Hook_T)(void);
+typedef void (*Sim_Can_Tx_Hook_T)(const Sim_Can_Msg_T *msg);
+typedef void (*Sim_Can_Rx_Hook_T)(const Sim_Can_Msg_T *msg);
+typedef void (*Sim_Adc_Read_Hook_T)(ADC_CHANNEL_T channel, uint16_t value);
+typedef void (*Sim_Serial_Tx_Hook_T)(uint8_t byte);
+
+typedef struct {
+  uint32_t rx_delivered;
+  uint32_t rx_dropped;
+  // Frames no receive message object matched, dropped by the controller
+  uint32_t rx_filtered;
+  uint32_t tx_frames;
+  uint32_t tx_refused;
+  uint32_t bus_offs;
+  uint32_t resets;
+} Sim_Can_Stats_T;
+
+/**
+ * @details simulated time since boot in microseconds
+ */
+uint64_t Sim_now_us(void);
+void Sim_set_now_us(uint64_t now_us);
+
+/**
+ * @details called for every __WFI(), and expected to deliver at least the
+ * next simulated interrupt. Without a hook WFI returns straight away.
+ */
+void Sim_set_wfi_hook(Sim_Wfi_Hook_T hook);
+
+/**
+ * @details sets the value the ADC returns for a channel
+ */
+void Sim_set_adc(ADC_CHANNEL_T channel, uint16_t value);
+
+/**
+ * @details called for every channel the firmware reads from the ADC
+ */
+void Sim_set_adc_read_hook(Sim_Adc_Read_Hook_T hook);
+
+/**
+ * @details loads a capture register, to be read by the timer interrupt handler
+ */
+void Sim_set_capture(LPC_TIMER_T *timer, uint32_t cycles);
+
+/**
+ * @details the simulated calibration flash sector, blank until written
+ */
+uint8_t *Sim_flash(void);
+void Sim_flash_erase(void);
+uint32_t Sim_flash_erases(void);
+
+/**
+ * @details echoes UART output to stderr when enabled
+ */
+void Sim_set_serial_echo(bool echo);
+uint32_t Sim_serial_bytes(void);
+
+/**
+ * @details called for every byte the UART accepts into its FIFO
+ */
+void Sim_set_serial_tx_hook(Sim_Serial_Tx_Hook_T hook);
+
+/**
+ * @details bytes written while the simulated UART FIFO was full
+ */
+uint32_t Sim_uart_overruns(void);
+
+/**
+ * @details when the UART THRE interrupt is next due, UINT64_MAX if it is
+ * not enabled
+ */
+uint64_t Sim_uart_irq_us(void);
+
+/**
+ * @details puts a frame on the bus. It lands in the controller receive
+ * buffer if a receive message object accepts its ID, and is counted in
+ * rx_filtered otherwise.
+ * @return false if the buffer was full and the frame was dropped
+ */
+bool Sim_can_receive(const Sim_Can_Msg_T *msg);
+uint32_t Sim_can_rx_pending(void);
+
+void Sim_set_can_tx_hook(Sim_Can_Tx_Hook_T hook);
+
+/**
+ * @details makes every write fail with this error until it is set back to
+ * Can_Error_NONE, e.g. Can_Error_TX_BUFFER_FULL for a bus too busy to take
+ * more frames
+ */
+void Sim_set_can_tx_error(Can_ErrorID_T error);
+
+/**
+ * @details counts this many transmit errors against the controller, enough
+ * of which take it bus-off, and keeps the bus too disturbed for bus-off
+ * recovery to finish for the next duration_us
+ */
+void Sim_can_error_burst(uint32_t errors, uint32_t duration_us);
+
+/**
+ * @details called for every frame the firmware pulls out of the controller
+ */
+void Sim_set_can_rx_hook(Sim_Can_Rx_Hook_T hook);
+const Sim_Can_Stats_T *Sim_can_stats(void);
+
+#endif // SIM_H
@@ -0,0 +1,109 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Binary CAN/ADC trace read by log-replay and written by can-node-sim -r.
+ *
+ * A trace is an 8 byte header followed by fixed size 16 byte records in time
+ * order. Fields are stored in host byte order, little-endian on every
+ * machine we build on, so records can be used straight out of a memory
+ * mapping. Records carry the RawValues, VCU and MC inputs and the
+ * DriverOutput frames the node put on the bus in response. The car's CAN
+ * logs are not in this format and there is no converter for them, so only
+ * traces recorded by the simulator can be replayed.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "MY17_Can_Library.h"
+
+#define TRACE_MAGIC "FCNT"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 16
+
+typedef enum {
+  // Pedal and brake sample, one per ADC sample the node takes
+  TRACE_RAW_VALUES = 1,
+  TRACE_VCU_DASH,
+  TRACE_MC_DATA,
+  // What the node transmitted, compared against on replay
+  TRACE_DRIVER_OUTPUT,
+  TRACE_TYPE_LENGTH
+} Trace_Type_T;
+
+// TRACE_VCU_DASH flags
+#define TRACE_VCU_HV_LIGHT 0x01
+
+// TRACE_DRIVER_OUTPUT flags
+#define TRACE_DRIVER_IMPLAUSIBLE 0x01
+#define TRACE_DRIVER_CONFLICT 0x02
+#define TRACE_DRIVER_BRAKE_ENGAGED 0x04
+
+// value[] holds, per type:
+//   TRACE_RAW_VALUES     accel_1, accel_2, brake_1, brake_2
+//   TRACE_VCU_DASH       lv_battery_voltage, limp_state
+//   TRACE_MC_DATA        register, value
+//   TRACE_DRIVER_OUTPUT  torque, torque_before_control, brake_pressure
+typedef struct {
+  // msTicks on the node when the frame was read or written
+  uint32_t time_ms;
+  uint8_t type;
+  uint8_t flags;
+  uint16_t value[5];
+} Trace_Record_T;
+
+typedef struct {
+  FILE *file;
+  uint64_t records;
+} Trace_Writer_T;
+
+typedef struct {
+  const uint8_t *map;
+  uint64_t map_size;
+  const Trace_Record_T *records;
+  uint64_t count;
+  uint64_t next;
+  // Start of the pages not yet handed back to the kernel
+  uint64_t released;
+} Trace_Reader_T;
+
+/**
+ * @details creates a trace file and writes its header
+ * @return false, with errno set, if the file could not be written
+ */
+bool Trace_create(Trace_Writer_T *writer, const char *path);
+bool Trace_write(Trace_Writer_T *writer, const Trace_Record_T *record);
+bool Trace_close_writer(Trace_Writer_T *writer);
+
+/**
+ * @details maps a trace file read-only
+ * @return NULL on success, otherwise what is wrong with the file
+ */
+const char *Trace_open(Trace_Reader_T *reader, const char *path);
+
+/**
+ * @details hands out the next run of records. Pages of earlier runs are
+ * dropped from the mapping, so a trace of any size is read with a constant
+ * resident footprint.
+ * @return records in the run, 0 at the end of the trace
+ */
+uint32_t Trace_next_window(Trace_Reader_T *reader, const Trace_Record_T **records);
+void Trace_close(Trace_Reader_T *reader);
+
+void Trace_from_raw_values(Trace_Record_T *record, uint32_t time_ms,
+    const Can_FrontCanNode_RawValues_T *msg);
+void Trace_to_raw_values(const Trace_Record_T *record, Can_FrontCanNode_RawValues_T *msg);
+void Trace_from_vcu_dash(Trace_Record_T *record, uint32_t time_ms,
+    const Can_Vcu_DashHeartbeat_T *msg);
+void Trace_to_vcu_dash(const Trace_Record_T *record, Can_Vcu_DashHeartbeat_T *msg);
+void Trace_from_mc_data(Trace_Record_T *record, uint32_t time_ms,
+    const Can_MC_DataReading_T *msg);
+void Trace_to_mc_data(const Trace_Record_T *record, Can_MC_DataReading_T *msg);
+void Trace_from_driver_output(Trace_Record_T *record, uint32_t time_ms,
+    const Can_FrontCanNode_DriverOutput_T *msg);
+void Trace_to_driver_output(const Trace_Record_T *record, Can_FrontCanNode_DriverOutput_T *msg);
+
+#endif // TRACE_H
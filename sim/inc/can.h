@@ -0,0 +1,10 @@
+#ifndef SIM_CAN_H
+#define SIM_CAN_H
+
+/**
+ * Host stand-in for the evt_lib can.h driver header.
+ */
+
+void CAN_ResetPeripheral(void);
+
+#endif // SIM_CAN_H
@@ -0,0 +1,237 @@
+#ifndef SIM_CHIP_H
+#define SIM_CHIP_H
+
+/**
+ * Host stand-in for the lpc_chip_11cxx_lib chip.h.
+ *
+ * Only the subset of the LPCOpen API that this project touches is declared
+ * here. Peripheral handles point at plain structs in sim/src/chip_sim.c so
+ * that the firmware sources compile unmodified on Linux.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define __NOP()
+#define __DMB() __asm__ volatile("" ::: "memory")
+// The simulator decides what wakes the core, see Sim_set_wfi_hook
+#define __WFI() Sim_wfi()
+#define __disable_irq()
+#define __enable_irq()
+
+/*****************************************************************************
+ * Core / NVIC / SysTick
+ ****************************************************************************/
+
+typedef enum {
+  SysTick_IRQn = -1,
+  CAN_IRQn = 13,
+  TIMER_32_0_IRQn = 18,
+  TIMER_32_1_IRQn = 19,
+  UART0_IRQn = 21,
+  SIM_NUM_IRQn = 32
+} IRQn_Type;
+
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+typedef enum { ERROR = 0, SUCCESS = !ERROR } Status;
+
+typedef struct {
+  uint32_t CTRL;
+  uint32_t LOAD;
+  uint32_t VAL;
+  uint32_t CALIB;
+} SysTick_Type;
+
+extern SysTick_Type *SysTick;
+extern uint32_t SystemCoreClock;
+
+void Sim_wfi(void);
+
+void SystemCoreClockUpdate(void);
+uint32_t SysTick_Config(uint32_t ticks);
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+
+/*****************************************************************************
+ * IOCON
+ ****************************************************************************/
+
+typedef struct {
+  uint32_t REG[32];
+} LPC_IOCON_T;
+
+typedef enum {
+  IOCON_PIO0_11,
+  IOCON_PIO1_0,
+  IOCON_PIO1_1,
+  IOCON_PIO1_2,
+  IOCON_PIO1_3,
+  IOCON_PIO1_4,
+  IOCON_PIO1_5,
+  IOCON_PIO1_6,
+  IOCON_PIO1_7
+} CHIP_IOCON_PIO_T;
+
+#define IOCON_FUNC0 0x0
+#define IOCON_FUNC1 0x1
+#define IOCON_FUNC2 0x2
+#define IOCON_FUNC3 0x3
+#define IOCON_MODE_INACT (0x0 << 3)
+#define IOCON_ADMODE_EN (0x0 << 7)
+#define IOCON_DIGMODE_EN (0x1 << 7)
+
+extern LPC_IOCON_T *LPC_IOCON;
+
+void Chip_IOCON_PinMuxSet(LPC_IOCON_T *pIOCON, CHIP_IOCON_PIO_T pin, uint32_t modefunc);
+
+/*****************************************************************************
+ * ADC
+ ****************************************************************************/
+
+typedef enum {
+  ADC_CH0,
+  ADC_CH1,
+  ADC_CH2,
+  ADC_CH3,
+  ADC_CH4,
+  ADC_CH5,
+  ADC_CH6,
+  ADC_CH7,
+  ADC_NUM_CHANNELS
+} ADC_CHANNEL_T;
+
+typedef enum {
+  ADC_NO_START,
+  ADC_START_NOW
+} ADC_START_MODE_T;
+
+typedef enum {
+  ADC_TRIGGERMODE_RISING,
+  ADC_TRIGGERMODE_FALLING
+} ADC_EDGESEL_T;
+
+typedef struct {
+  uint32_t adcRate;
+  uint8_t bitsAccuracy;
+  bool burstMode;
+} ADC_CLOCK_SETUP_T;
+
+typedef struct {
+  uint32_t CR;
+  uint32_t DR[ADC_NUM_CHANNELS];
+} LPC_ADC_T;
+
+extern LPC_ADC_T *LPC_ADC;
+
+void Chip_ADC_Init(LPC_ADC_T *pADC, ADC_CLOCK_SETUP_T *ADCSetup);
+void Chip_ADC_EnableChannel(LPC_ADC_T *pADC, ADC_CHANNEL_T channel, FunctionalState NewState);
+void Chip_ADC_SetBurstCmd(LPC_ADC_T *pADC, FunctionalState NewState);
+void Chip_ADC_SetStartMode(LPC_ADC_T *pADC, ADC_START_MODE_T mode, ADC_EDGESEL_T EdgeOption);
+Status Chip_ADC_ReadValue(LPC_ADC_T *pADC, uint8_t channel, uint16_t *data);
+
+/*****************************************************************************
+ * UART
+ ****************************************************************************/
+
+typedef struct {
+  uint32_t IER;
+  uint32_t LCR;
+  uint32_t FCR;
+  uint32_t TER;
+  uint32_t baudrate;
+  // Simulated time at which the transmitter runs dry, in ns
+  uint64_t tx_idle_ns;
+} LPC_USART_T;
+
+#define SIM_UART_FIFO_SIZE 16
+
+#define UART_LCR_WLEN8 (3 << 0)
+#define UART_LCR_SBS_1BIT (0 << 2)
+#define UART_LCR_PARITY_DIS (0 << 3)
+#define UART_FCR_FIFO_EN (1 << 0)
+#define UART_FCR_TRG_LEV2 (2 << 6)
+#define UART_IER_THREINT (1 << 1)
+#define UART_LSR_THRE (1 << 5)
+
+extern LPC_USART_T *LPC_USART;
+
+void Chip_UART_Init(LPC_USART_T *pUART);
+uint32_t Chip_UART_SetBaud(LPC_USART_T *pUART, uint32_t baudrate);
+void Chip_UART_ConfigData(LPC_USART_T *pUART, uint32_t config);
+void Chip_UART_SetupFIFOS(LPC_USART_T *pUART, uint32_t fcr);
+void Chip_UART_TXEnable(LPC_USART_T *pUART);
+void Chip_UART_IntEnable(LPC_USART_T *pUART, uint32_t intMask);
+void Chip_UART_IntDisable(LPC_USART_T *pUART, uint32_t intMask);
+uint32_t Chip_UART_ReadLineStatus(LPC_USART_T *pUART);
+void Chip_UART_SendByte(LPC_USART_T *pUART, uint8_t data);
+
+/*****************************************************************************
+ * 32-bit timers
+ ****************************************************************************/
+
+typedef struct {
+  uint32_t TCR;
+  uint32_t TC;
+  uint32_t PR;
+  uint32_t CCR;
+  uint32_t CR[4];
+} LPC_TIMER_T;
+
+extern LPC_TIMER_T *LPC_TIMER32_0;
+extern LPC_TIMER_T *LPC_TIMER32_1;
+
+void Chip_TIMER_Init(LPC_TIMER_T *pTMR);
+void Chip_TIMER_Enable(LPC_TIMER_T *pTMR);
+void Chip_TIMER_Reset(LPC_TIMER_T *pTMR);
+void Chip_TIMER_PrescaleSet(LPC_TIMER_T *pTMR, uint32_t prescale);
+void Chip_TIMER_ClearCapture(LPC_TIMER_T *pTMR, int8_t capnum);
+uint32_t Chip_TIMER_ReadCapture(LPC_TIMER_T *pTMR, int8_t capnum);
+
+/*****************************************************************************
+ * The ROM driver call that programs receive message objects. Frames
+ * themselves go through the MY17 library, modelled in sim/src/can_sim.c
+ * along with this and the CanController registers.
+ ****************************************************************************/
+
+#define CAN_MSGOBJ_STD 0x00000000UL
+#define CAN_MSGOBJ_EXT 0x20000000UL
+#define CAN_MSGOBJ_RTR 0x40000000UL
+
+typedef struct {
+  uint32_t mode_id;
+  uint32_t mask;
+  uint8_t data[8];
+  uint8_t dlc;
+  uint8_t msgobj;
+} CCAN_MSG_OBJ_T;
+
+// Only the entry point this project calls
+typedef struct {
+  void (*config_rxmsgobj)(CCAN_MSG_OBJ_T *msg_obj);
+} CCAND_API_T;
+
+extern const CCAND_API_T *LPC_CCAN_API;
+
+/*****************************************************************************
+ * IAP flash programming
+ ****************************************************************************/
+
+#define IAP_CMD_SUCCESS 0
+#define IAP_INVALID_SECTOR 7
+#define IAP_SECTOR_NOT_PREPARED 9
+#define IAP_DST_ADDR_ERROR 3
+
+// Only the last sector is simulated, standing in for the CALIBRATION
+// region of gcc.ld
+#define SIM_FLASH_SECTOR 7
+#define SIM_FLASH_SECTOR_SIZE 4096
+
+uint8_t Chip_IAP_PreSectorForReadWrite(uint32_t strSector, uint32_t endSector);
+uint8_t Chip_IAP_EraseSector(uint32_t strSector, uint32_t endSector);
+uint8_t Chip_IAP_CopyRamToFlash(uint32_t dstAdd, uint32_t *srcAdd, uint32_t byteswrt);
+
+#endif // SIM_CHIP_H
@@ -0,0 +1,46 @@
+# Counts the instructions of each function named in "functions" in objdump -d
+# output, and prints them as JSON. Literal pool words are not instructions.
+# Functions the linker dropped or the compiler inlined everywhere come out
+# as null. With no functions named, every function in the image is counted.
+
+BEGIN {
+  n = split(functions, names, " ")
+  for (i = 1; i <= n; i++) {
+    wanted[names[i]] = 1
+  }
+}
+
+/^[0-9a-f]+ <[^>]+>:$/ {
+  current = $2
+  gsub(/[<>:]/, "", current)
+  if (n == 0 && !(current in count)) {
+    names[++found] = current
+    count[current] = 0
+  } else if (n > 0 && !(current in wanted)) {
+    current = ""
+  }
+  next
+}
+
+/^$/ {
+  current = ""
+  next
+}
+
+current != "" && /^ +[0-9a-f]+:\t/ && !/\.word/ {
+  count[current]++
+}
+
+END {
+  if (n == 0) {
+    n = found
+  }
+  print "{"
+  print "  \"instructions\": ["
+  for (i = 1; i <= n; i++) {
+    printf "    {\"name\": \"%s\", \"count\": %s}%s\n", names[i],
+        (names[i] in count) ? count[names[i]] : "null", i < n ? "," : ""
+  }
+  print "  ]"
+  print "}"
+}
@@ -0,0 +1,349 @@
+/**
+ * Replays a recorded trace through the node's rules and output logic.
+ *
+ * Every record updates the same Input_T the firmware fills in: samples go
+ * through update_derived, VCU and MC frames through the CAN dispatch
+ * handlers. At each recorded DriverOutput the real State_update_state and
+ * write_can_driver_output run at that record's msTicks, and the frame they
+ * produce is compared against the recorded one, which serves as the golden
+ * output. There is no simulated time in between; the rules only change on a
+ * new sample or with time, and both are evaluated at every point that
+ * matters, so the result is the same as running every loop pass.
+ *
+ * The trace is memory-mapped and walked once, with pages dropped behind the
+ * cursor, so memory use stays flat whatever the trace size.
+ *
+ * Mismatches are printed to stdout, a summary goes to stderr, and the exit
+ * status is 1 if any frame differs. With -w the trace is written back out
+ * with the produced DriverOutput frames in place of the recorded ones, to
+ * serve as the golden trace after an intended behavior change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CanRx.h"
+#include "CanTx.h"
+#include "Input.h"
+#include "Output.h"
+#include "Sim.h"
+#include "State.h"
+#include "Trace.h"
+#include "Types.h"
+
+#define DEFAULT_MAX_REPORTED 20
+
+// Firmware entry points from src/Input.c and src/output.c
+void update_derived(Input_T *input);
+bool can_process_vcu_dash(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_mc_data(Input_T *input, CanRx_Msg_T *msg);
+void write_can_driver_output(Input_T *input, Rules_State_T *rules);
+
+typedef enum {
+  FIELD_TORQUE,
+  FIELD_TORQUE_BEFORE_CONTROL,
+  FIELD_BRAKE_PRESSURE,
+  FIELD_IMPLAUSIBLE,
+  FIELD_CONFLICT,
+  FIELD_BRAKE_ENGAGED,
+  FIELD_LENGTH
+} Field_T;
+
+typedef struct {
+  uint64_t records;
+  uint64_t records_by_type[TRACE_TYPE_LENGTH];
+  uint64_t unknown_records;
+  uint64_t driver_outputs;
+  uint64_t mismatches;
+  uint64_t field_mismatches[FIELD_LENGTH];
+  bool have_first_mismatch;
+  uint32_t first_mismatch_ms;
+} Replay_Stats_T;
+
+static const char *field_names[FIELD_LENGTH] = {
+  [FIELD_TORQUE] = "torque",
+  [FIELD_TORQUE_BEFORE_CONTROL] = "torque_before_control",
+  [FIELD_BRAKE_PRESSURE] = "brake_pressure",
+  [FIELD_IMPLAUSIBLE] = "implausible",
+  [FIELD_CONFLICT] = "conflict",
+  [FIELD_BRAKE_ENGAGED] = "brake_engaged",
+};
+
+static Input_T input;
+static Adc_Input_T adc_input;
+static Derived_Input_T derived_input;
+static Speed_Input_T speed_input;
+static Mc_Input_T mc_input;
+static Current_Sensor_Input_T current_sensor_input;
+static Energy_Input_T energy_input;
+static Misc_Input_T misc_input;
+
+static State_T state;
+static Rules_State_T rules_state;
+static Message_State_T message_state;
+
+static Output_T output;
+static Logging_Output_T logging_output;
+static Can_Output_T can_output;
+
+static Can_FrontCanNode_DriverOutput_T produced;
+static bool have_produced;
+
+static Replay_Stats_T stats;
+static uint64_t max_reported = DEFAULT_MAX_REPORTED;
+static bool rewriting = false;
+static Trace_Writer_T rewrite;
+
+// Same wiring as initialize_structs() in src/main.c
+static void initialize(void) {
+  input.adc = &adc_input;
+  input.derived = &derived_input;
+  input.speed = &speed_input;
+  input.mc = &mc_input;
+  input.current_sensor = &current_sensor_input;
+  input.energy = &energy_input;
+  input.misc = &misc_input;
+
+  state.rules = &rules_state;
+  state.message = &message_state;
+
+  output.can = &can_output;
+  output.logging = &logging_output;
+
+  Input_initialize(&input);
+  State_initialize(&state);
+  Output_initialize(&output);
+}
+
+static void on_can_tx(const Sim_Can_Msg_T *msg) {
+  if (msg->type == Can_FrontCanNode_DriverOutput_Msg) {
+    produced = msg->data.driver_output;
+    have_produced = true;
+  }
+}
+
+static void apply_raw_values(const Trace_Record_T *record) {
+  Can_FrontCanNode_RawValues_T raw;
+  Trace_to_raw_values(record, &raw);
+  Adc_Input_T *adc = input.adc;
+  adc->accel_1_raw = raw.accel_1_raw;
+  adc->accel_2_raw = raw.accel_2_raw;
+  adc->brake_1_raw = raw.brake_1_raw;
+  adc->brake_2_raw = raw.brake_2_raw;
+  adc->last_updated = input.msTicks;
+  // Traces can hold two samples in one millisecond, which update_derived
+  // would take for the one it already has
+  input.derived->adc_updated = input.msTicks - 1;
+  update_derived(&input);
+  State_update_state(&input, &state, &output);
+}
+
+static void apply_can(const Trace_Record_T *record) {
+  CanRx_Msg_T msg;
+  msg.received_ms = input.msTicks;
+  bool updated;
+  uint32_t *last_updated;
+  if (record->type == TRACE_VCU_DASH) {
+    msg.type = Can_Vcu_DashHeartbeat_Msg;
+    Trace_to_vcu_dash(record, &msg.data.vcu_dash);
+    updated = can_process_vcu_dash(&input, &msg);
+    last_updated = &input.misc->last_updated;
+  } else {
+    msg.type = Can_MC_DataReading_Msg;
+    Trace_to_mc_data(record, &msg.data.mc_data);
+    updated = can_process_mc_data(&input, &msg);
+    last_updated = &input.mc->last_updated;
+  }
+  if (updated) {
+    *last_updated = msg.received_ms;
+  }
+}
+
+static void report_mismatch(uint32_t time_ms, const Can_FrontCanNode_DriverOutput_T *expected,
+    const bool *differs) {
+  const int values[2][FIELD_LENGTH] = {
+    { expected->torque, expected->torque_before_control, expected->brake_pressure,
+      expected->throttle_implausible, expected->brake_throttle_conflict,
+      expected->brake_engaged },
+    { produced.torque, produced.torque_before_control, produced.brake_pressure,
+      produced.throttle_implausible, produced.brake_throttle_conflict,
+      produced.brake_engaged },
+  };
+  printf("%u ms DriverOutput", time_ms);
+  uint8_t field;
+  for (field = 0; field < FIELD_LENGTH; field++) {
+    if (differs[field]) {
+      printf(" %s=%d (recorded %d)", field_names[field], values[1][field], values[0][field]);
+    }
+  }
+  printf("\n");
+}
+
+static void check_driver_output(const Trace_Record_T *record) {
+  State_update_state(&input, &state, &output);
+  have_produced = false;
+  write_can_driver_output(&input, state.rules);
+  CanTx_flush();
+  stats.driver_outputs++;
+  if (!have_produced) {
+    fprintf(stderr, "%u ms: no DriverOutput produced\n", record->time_ms);
+    exit(1);
+  }
+
+  Trace_Record_T actual;
+  Trace_from_driver_output(&actual, record->time_ms, &produced);
+  if (rewriting && !Trace_write(&rewrite, &actual)) {
+    perror("trace");
+    exit(1);
+  }
+  if (actual.flags == record->flags &&
+      memcmp(actual.value, record->value, sizeof(actual.value)) == 0) {
+    return;
+  }
+
+  Can_FrontCanNode_DriverOutput_T expected;
+  Trace_to_driver_output(record, &expected);
+  bool differs[FIELD_LENGTH];
+  differs[FIELD_TORQUE] = expected.torque != produced.torque;
+  differs[FIELD_TORQUE_BEFORE_CONTROL] =
+    expected.torque_before_control != produced.torque_before_control;
+  differs[FIELD_BRAKE_PRESSURE] = expected.brake_pressure != produced.brake_pressure;
+  differs[FIELD_IMPLAUSIBLE] = expected.throttle_implausible != produced.throttle_implausible;
+  differs[FIELD_CONFLICT] = expected.brake_throttle_conflict != produced.brake_throttle_conflict;
+  differs[FIELD_BRAKE_ENGAGED] = expected.brake_engaged != produced.brake_engaged;
+
+  uint8_t field;
+  for (field = 0; field < FIELD_LENGTH; field++) {
+    stats.field_mismatches[field] += differs[field];
+  }
+  if (!stats.have_first_mismatch) {
+    stats.have_first_mismatch = true;
+    stats.first_mismatch_ms = record->time_ms;
+  }
+  if (stats.mismatches < max_reported) {
+    report_mismatch(record->time_ms, &expected, differs);
+  }
+  stats.mismatches++;
+}
+
+static void replay_window(const Trace_Record_T *records, uint32_t length) {
+  uint32_t i;
+  for (i = 0; i < length; i++) {
+    const Trace_Record_T *record = &records[i];
+    input.msTicks = record->time_ms;
+    if (record->type < TRACE_TYPE_LENGTH) {
+      stats.records_by_type[record->type]++;
+    }
+
+    switch (record->type) {
+      case TRACE_RAW_VALUES:
+        apply_raw_values(record);
+        break;
+      case TRACE_VCU_DASH:
+      case TRACE_MC_DATA:
+        apply_can(record);
+        break;
+      case TRACE_DRIVER_OUTPUT:
+        check_driver_output(record);
+        // Already written in its replayed form
+        continue;
+      default:
+        stats.unknown_records++;
+        break;
+    }
+    if (rewriting && !Trace_write(&rewrite, record)) {
+      perror("trace");
+      exit(1);
+    }
+  }
+  stats.records += length;
+}
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_summary(uint64_t wall_ns, uint64_t bytes) {
+  const double wall_s = wall_ns / 1e9;
+  fprintf(stderr, "records:        %llu (%llu samples, %llu vcu, %llu mc, %llu unknown)\n",
+      (unsigned long long)stats.records,
+      (unsigned long long)stats.records_by_type[TRACE_RAW_VALUES],
+      (unsigned long long)stats.records_by_type[TRACE_VCU_DASH],
+      (unsigned long long)stats.records_by_type[TRACE_MC_DATA],
+      (unsigned long long)stats.unknown_records);
+  fprintf(stderr, "driver output:  %llu frames, %llu differ\n",
+      (unsigned long long)stats.driver_outputs, (unsigned long long)stats.mismatches);
+  if (stats.have_first_mismatch) {
+    fprintf(stderr, "first differs:  at %u ms\n", stats.first_mismatch_ms);
+    uint8_t field;
+    for (field = 0; field < FIELD_LENGTH; field++) {
+      if (stats.field_mismatches[field] > 0) {
+        fprintf(stderr, "  %-22s %llu\n", field_names[field],
+            (unsigned long long)stats.field_mismatches[field]);
+      }
+    }
+  }
+  fprintf(stderr, "host wall time: %.3f s, %.1f M records/s, %.0f MB/s\n",
+      wall_s, wall_s > 0 ? stats.records / wall_s / 1e6 : 0.0,
+      wall_s > 0 ? bytes / wall_s / 1e6 : 0.0);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-m max_reported] [-w rewritten_trace] trace\n", argv0);
+  fprintf(stderr, "  -m  mismatching frames to print (default %u)\n", DEFAULT_MAX_REPORTED);
+  fprintf(stderr, "  -w  write the trace back out with the replayed DriverOutput frames\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "m:w:")) != -1) {
+    switch (opt) {
+      case 'm':
+        max_reported = strtoull(optarg, NULL, 0);
+        break;
+      case 'w':
+        if (!Trace_create(&rewrite, optarg)) {
+          perror(optarg);
+          return 1;
+        }
+        rewriting = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+  }
+
+  Trace_Reader_T reader;
+  const char *error = Trace_open(&reader, argv[optind]);
+  if (error != NULL) {
+    fprintf(stderr, "%s: %s\n", argv[optind], error);
+    return 1;
+  }
+
+  Sim_set_can_tx_hook(on_can_tx);
+  initialize();
+
+  const uint64_t wall_start = host_ns();
+  const Trace_Record_T *records;
+  uint32_t length;
+  while ((length = Trace_next_window(&reader, &records)) > 0) {
+    replay_window(records, length);
+  }
+  print_summary(host_ns() - wall_start, reader.map_size);
+
+  Trace_close(&reader);
+  if (rewriting && !Trace_close_writer(&rewrite)) {
+    perror("trace");
+    return 1;
+  }
+  return stats.mismatches > 0 ? 1 : 0;
+}
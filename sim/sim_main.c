@@ -0,0 +1,715 @@
+/**
+ * Host simulator for the front CAN node.
+ *
+ * Boots the firmware the same way main() does, then runs the real
+ * fill_input/update_state/process_output loop against a scripted scenario in
+ * simulated time. Each main loop pass costs a fixed amount of simulated time;
+ * SysTick, wheel speed capture and CAN traffic are delivered between passes
+ * in timestamp order.
+ *
+ * By default the loop polls like main() with EVENT_DRIVEN_LOOP set to 0. With
+ * -e it runs the event-driven loop instead: Event_wait sleeps, and each WFI
+ * skips simulated time ahead to the next interrupt or scenario event.
+ *
+ * Scenario files hold one event per line, '#' starts a comment:
+ *
+ *   <time_ms> adc <accel_1|accel_2|brake_1|brake_2|steering> <raw>
+ *   <time_ms> wheel <left|right> <us_per_tooth, 0 stops the wheel>
+ *   <time_ms> vcu_dash <hv_light> <lv_battery_voltage> <normal|50|33|25>
+ *   <time_ms> mc_speed <rpm>
+ *   <time_ms> cs_voltage <mV>
+ *   <time_ms> cs_current <mA>
+ *   <time_ms> cs_power <W>
+ *   <time_ms> cs_energy <Wh>
+ *   <time_ms> unknown <can_id>
+ *   <time_ms> can_error <error_code>
+ *   <time_ms> can_tx_error <error_code, 0 lets writes through again>
+ *   <time_ms> can_error_burst <transmit errors> <ms the bus stays disturbed>
+ *   <time_ms> bus_load <can_id> <frames every ms, 0 stops them>
+ *   <time_ms> end
+ *
+ * A CAN event may end in "*<count>" to deliver a burst of identical frames.
+ *
+ * Every transmitted frame is printed to stdout, a summary goes to stderr.
+ * With -t the raw UART output, telemetry records included, is saved to a
+ * file for telemetry-decode. With -r every ADC sample, every VCU and MC
+ * frame the node reads and every DriverOutput it sends are saved as a trace
+ * for log-replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Adc.h"
+#include "CanHealth.h"
+#include "CanRx.h"
+#include "CanTx.h"
+#include "Clock.h"
+#include "Energy.h"
+#include "Event.h"
+#include "Latency.h"
+#include "LoopTiming.h"
+#include "Output.h"
+#include "Serial.h"
+#include "Sim.h"
+#include "State.h"
+#include "Telemetry.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "Types.h"
+
+#define DEFAULT_LOOP_COST_US 20
+#define SYSTICK_PERIOD_US 1000
+#define SOURCE_SYSTICK -1
+#define SOURCE_UART -2
+#define MAX_LINE_LENGTH 256
+
+// Firmware entry points from src/main.c
+void SysTick_Handler(void);
+void TIMER32_0_IRQHandler(void);
+void TIMER32_1_IRQHandler(void);
+void UART_IRQHandler(void);
+void Set_Interrupt_Priorities(void);
+void initialize_structs(void);
+void fill_input(void);
+void update_state(void);
+void process_output(void);
+void schedule_wakeup(void);
+
+typedef struct {
+  uint32_t us_per_tooth;
+  uint64_t next_tick_us;
+} Sim_Wheel_T;
+
+typedef struct {
+  uint64_t passes;
+  uint64_t total_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t task_ns[EVENT_TASK_COUNT];
+} Sim_Loop_Stats_T;
+
+static FILE *scenario;
+static uint32_t scenario_line = 0;
+static bool have_pending = false;
+static uint64_t pending_us;
+static char pending[MAX_LINE_LENGTH];
+static uint64_t end_us = 0;
+
+static Sim_Wheel_T wheels[NUM_WHEELS];
+static uint64_t next_systick_us = SYSTICK_PERIOD_US;
+static uint64_t now_us = 0;
+static bool print_tx = true;
+static bool event_driven = false;
+static FILE *serial_capture = NULL;
+static bool recording = false;
+static Trace_Writer_T trace;
+static Can_FrontCanNode_RawValues_T trace_adc;
+
+// Other nodes' traffic, put on the bus ahead of every SysTick
+static uint16_t bus_load_id;
+static uint32_t bus_load_per_ms = 0;
+
+static Sim_Loop_Stats_T loop_stats;
+static uint32_t tx_counts[4];
+
+/*****************************************************************************
+ * Scenario parsing
+ ****************************************************************************/
+
+static void scenario_error(const char *what) {
+  fprintf(stderr, "scenario line %u: %s\n", scenario_line, what);
+  exit(1);
+}
+
+// Reads ahead to the next event, leaving its arguments in pending
+static bool next_event(void) {
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), scenario) != NULL) {
+    scenario_line++;
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char *end;
+    const double t_ms = strtod(line, &end);
+    if (end == line) {
+      if (strspn(line, " \t\r\n") != strlen(line)) {
+        scenario_error("expected a timestamp");
+      }
+      continue;
+    }
+    const uint64_t t_us = (uint64_t)(t_ms * 1000.0 + 0.5);
+    if (have_pending && t_us < pending_us) {
+      scenario_error("timestamps must not decrease");
+    }
+    pending_us = t_us;
+    strncpy(pending, end, sizeof(pending) - 1);
+    pending[sizeof(pending) - 1] = '\0';
+    have_pending = true;
+    return true;
+  }
+  have_pending = false;
+  return false;
+}
+
+static ADC_CHANNEL_T parse_adc_channel(const char *name) {
+  if (strcmp(name, "accel_1") == 0) return ACCEL_1_CHANNEL;
+  if (strcmp(name, "accel_2") == 0) return ACCEL_2_CHANNEL;
+  if (strcmp(name, "brake_1") == 0) return BRAKE_1_CHANNEL;
+  if (strcmp(name, "brake_2") == 0) return BRAKE_2_CHANNEL;
+  if (strcmp(name, "steering") == 0) return STEERING_CHANNEL;
+  scenario_error("unknown adc channel");
+  return ADC_CH0;
+}
+
+static Wheel_T parse_wheel(const char *name) {
+  if (strcmp(name, "left") == 0) return LEFT;
+  if (strcmp(name, "right") == 0) return RIGHT;
+  scenario_error("unknown wheel");
+  return LEFT;
+}
+
+static Can_Vcu_LimpState_T parse_limp(const char *name) {
+  if (strcmp(name, "normal") == 0) return CAN_LIMP_NORMAL;
+  if (strcmp(name, "50") == 0) return CAN_LIMP_50;
+  if (strcmp(name, "33") == 0) return CAN_LIMP_33;
+  if (strcmp(name, "25") == 0) return CAN_LIMP_25;
+  scenario_error("unknown limp state");
+  return CAN_LIMP_NORMAL;
+}
+
+static void set_wheel(Wheel_T wheel, uint32_t us_per_tooth, uint64_t now_us) {
+  Sim_Wheel_T *w = &wheels[wheel];
+  if (us_per_tooth > 0 && w->us_per_tooth == 0) {
+    w->next_tick_us = now_us + us_per_tooth;
+  }
+  w->us_per_tooth = us_per_tooth;
+}
+
+static void apply_event(char *args, uint64_t now_us) {
+  uint32_t burst = 1;
+  char *star = strchr(args, '*');
+  if (star != NULL) {
+    burst = strtoul(star + 1, NULL, 0);
+    *star = '\0';
+  }
+
+  char name[32], a[32], b[32], c[32];
+  const int n = sscanf(args, "%31s %31s %31s %31s", name, a, b, c);
+  if (n < 1) {
+    scenario_error("missing event name");
+  }
+
+  Sim_Can_Msg_T msg;
+  memset(&msg, 0, sizeof(msg));
+
+  if (strcmp(name, "end") == 0) {
+    end_us = now_us;
+    return;
+  } else if (strcmp(name, "adc") == 0 && n == 3) {
+    Sim_set_adc(parse_adc_channel(a), (uint16_t)strtoul(b, NULL, 0));
+    return;
+  } else if (strcmp(name, "wheel") == 0 && n == 3) {
+    set_wheel(parse_wheel(a), strtoul(b, NULL, 0), now_us);
+    return;
+  } else if (strcmp(name, "vcu_dash") == 0 && n == 4) {
+    msg.type = Can_Vcu_DashHeartbeat_Msg;
+    msg.data.vcu_dash.hv_light = strtoul(a, NULL, 0) != 0;
+    msg.data.vcu_dash.lv_battery_voltage = (uint16_t)strtoul(b, NULL, 0);
+    msg.data.vcu_dash.limp_state = parse_limp(c);
+  } else if (strcmp(name, "mc_speed") == 0 && n == 2) {
+    msg.type = Can_MC_DataReading_Msg;
+    msg.data.mc_data.type = CAN_MC_REG_SPEED_ACTUAL_RPM;
+    msg.data.mc_data.value = (int16_t)strtol(a, NULL, 0);
+  } else if (strcmp(name, "cs_voltage") == 0 && n == 2) {
+    msg.type = Can_CurrentSensor_Voltage_Msg;
+    msg.data.cs_voltage.voltage_mV = strtol(a, NULL, 0);
+  } else if (strcmp(name, "cs_current") == 0 && n == 2) {
+    msg.type = Can_CurrentSensor_Current_Msg;
+    msg.data.cs_current.current_mA = strtol(a, NULL, 0);
+  } else if (strcmp(name, "cs_power") == 0 && n == 2) {
+    msg.type = Can_CurrentSensor_Power_Msg;
+    msg.data.cs_power.power_W = strtol(a, NULL, 0);
+  } else if (strcmp(name, "cs_energy") == 0 && n == 2) {
+    msg.type = Can_CurrentSensor_Energy_Msg;
+    msg.data.cs_energy.energy_Wh = strtol(a, NULL, 0);
+  } else if (strcmp(name, "unknown") == 0 && n == 2) {
+    msg.type = Can_Unknown_Msg;
+    msg.data.unknown.id = (uint16_t)strtoul(a, NULL, 0);
+  } else if (strcmp(name, "can_error") == 0 && n == 2) {
+    msg.type = Can_Error_Msg;
+    msg.data.error = (Can_ErrorID_T)strtoul(a, NULL, 0);
+  } else if (strcmp(name, "can_tx_error") == 0 && n == 2) {
+    Sim_set_can_tx_error((Can_ErrorID_T)strtoul(a, NULL, 0));
+    return;
+  } else if (strcmp(name, "can_error_burst") == 0 && n == 3) {
+    Sim_can_error_burst(strtoul(a, NULL, 0), (uint32_t)(strtod(b, NULL) * 1000));
+    return;
+  } else if (strcmp(name, "bus_load") == 0 && n == 3) {
+    bus_load_id = (uint16_t)strtoul(a, NULL, 0);
+    bus_load_per_ms = strtoul(b, NULL, 0);
+    return;
+  } else {
+    scenario_error("unknown event or wrong number of arguments");
+  }
+
+  while (burst-- > 0) {
+    Sim_can_receive(&msg);
+  }
+}
+
+/*****************************************************************************
+ * Simulated interrupts
+ ****************************************************************************/
+
+static void put_bus_load(void) {
+  Sim_Can_Msg_T msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.type = Can_Unknown_Msg;
+  msg.data.unknown.id = bus_load_id;
+  msg.data.unknown.len = 8;
+  uint32_t i;
+  for (i = 0; i < bus_load_per_ms; i++) {
+    Sim_can_receive(&msg);
+  }
+}
+
+static void fire_wheel(Wheel_T wheel) {
+  Sim_Wheel_T *w = &wheels[wheel];
+  LPC_TIMER_T *timer = wheel == LEFT ? LPC_TIMER32_0 : LPC_TIMER32_1;
+  Sim_set_capture(timer, w->us_per_tooth * CYCLES_PER_MICROSECOND);
+  if (wheel == LEFT) {
+    TIMER32_0_IRQHandler();
+  } else {
+    TIMER32_1_IRQHandler();
+  }
+  w->next_tick_us += w->us_per_tooth;
+}
+
+// Time of the next interrupt, source is SOURCE_SYSTICK, SOURCE_UART or the
+// wheel
+static uint64_t next_interrupt(int *source) {
+  uint64_t earliest = next_systick_us;
+  uint8_t wheel;
+  *source = SOURCE_SYSTICK;
+  const uint64_t uart_us = Sim_uart_irq_us();
+  if (uart_us < earliest) {
+    earliest = uart_us;
+    *source = SOURCE_UART;
+  }
+  for (wheel = 0; wheel < NUM_WHEELS; wheel++) {
+    if (wheels[wheel].us_per_tooth > 0 && wheels[wheel].next_tick_us < earliest) {
+      earliest = wheels[wheel].next_tick_us;
+      *source = wheel;
+    }
+  }
+  return earliest;
+}
+
+// Delivers every interrupt due at or before now_us, earliest first
+static void fire_interrupts(uint64_t now_us) {
+  while (1) {
+    int source;
+    const uint64_t earliest = next_interrupt(&source);
+    if (earliest > now_us) {
+      return;
+    }
+    Sim_set_now_us(earliest);
+    if (source == SOURCE_SYSTICK) {
+      put_bus_load();
+      SysTick_Handler();
+      next_systick_us += SYSTICK_PERIOD_US;
+    } else if (source == SOURCE_UART) {
+      UART_IRQHandler();
+    } else {
+      fire_wheel((Wheel_T)source);
+    }
+  }
+}
+
+static bool finished(void) {
+  if (end_us == 0 && !have_pending) {
+    // No end event, stop once the script runs out
+    end_us = now_us;
+  }
+  return end_us != 0 && now_us >= end_us;
+}
+
+// Applies scenario events and interrupts due by now_us
+// @return false once the scenario has ended
+static bool advance(void) {
+  while (have_pending && pending_us <= now_us) {
+    apply_event(pending, pending_us);
+    next_event();
+  }
+  if (finished()) {
+    return false;
+  }
+  fire_interrupts(now_us);
+  Sim_set_now_us(now_us);
+  return true;
+}
+
+// Sleeping core: nothing happens until the next interrupt or scenario event
+static void on_wfi(void) {
+  int source;
+  uint64_t wake_us = next_interrupt(&source);
+  if (have_pending && pending_us < wake_us) {
+    wake_us = pending_us;
+  }
+  if (wake_us > now_us) {
+    now_us = wake_us;
+  }
+  if (!advance()) {
+    // Get Event_wait to return so the run loop sees the end
+    Event_post(EVENT_DEADLINE);
+  }
+}
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if LOOP_TIMING
+// Simulated time stands still during a pass, so the loop timing histograms
+// are fed host time in 48 MHz cycles instead
+static uint32_t ns_to_cycles(uint64_t ns) {
+  return ns * CYCLES_PER_MICROSECOND / 1000;
+}
+#endif
+
+static void run_pass(void) {
+  const uint64_t pass_start = host_ns();
+  uint64_t start = pass_start;
+  fill_input();
+  uint64_t end = host_ns();
+  loop_stats.task_ns[EVENT_TASK_INPUT] += end - start;
+  LOOP_TIMING_RECORD(LOOP_TIMING_INPUT, ns_to_cycles(end - start));
+
+  start = end;
+  update_state();
+  end = host_ns();
+  loop_stats.task_ns[EVENT_TASK_STATE] += end - start;
+  LOOP_TIMING_RECORD(LOOP_TIMING_STATE, ns_to_cycles(end - start));
+
+  start = end;
+  process_output();
+  end = host_ns();
+  loop_stats.task_ns[EVENT_TASK_OUTPUT] += end - start;
+  LOOP_TIMING_RECORD(LOOP_TIMING_OUTPUT, ns_to_cycles(end - start));
+
+  const uint64_t pass_ns = end - pass_start;
+  LOOP_TIMING_RECORD(LOOP_TIMING_PASS, ns_to_cycles(pass_ns));
+
+  loop_stats.passes++;
+  loop_stats.total_ns += pass_ns;
+  loop_stats.min_ns = pass_ns < loop_stats.min_ns ? pass_ns : loop_stats.min_ns;
+  loop_stats.max_ns = pass_ns > loop_stats.max_ns ? pass_ns : loop_stats.max_ns;
+}
+
+/*****************************************************************************
+ * Output
+ ****************************************************************************/
+
+static void record_trace(const Trace_Record_T *r) {
+  if (!Trace_write(&trace, r)) {
+    perror("trace");
+    exit(1);
+  }
+}
+
+static void on_can_tx(const Sim_Can_Msg_T *msg) {
+  const unsigned long long t = Sim_now_us();
+  switch (msg->type) {
+    case Can_FrontCanNode_DriverOutput_Msg: {
+      const Can_FrontCanNode_DriverOutput_T *m = &msg->data.driver_output;
+      tx_counts[0]++;
+      if (recording) {
+        Trace_Record_T r;
+        Trace_from_driver_output(&r, msTicks, m);
+        record_trace(&r);
+      }
+      if (print_tx) {
+        printf("%llu DriverOutput torque=%d torque_before_control=%d brake_pressure=%u "
+            "implausible=%d conflict=%d brake_engaged=%d\n",
+            t, m->torque, m->torque_before_control, m->brake_pressure,
+            m->throttle_implausible, m->brake_throttle_conflict, m->brake_engaged);
+      }
+      break;
+    }
+    case Can_FrontCanNode_RawValues_Msg: {
+      const Can_FrontCanNode_RawValues_T *m = &msg->data.raw_values;
+      tx_counts[1]++;
+      if (print_tx) {
+        printf("%llu RawValues accel_1=%u accel_2=%u brake_1=%u brake_2=%u\n",
+            t, m->accel_1_raw, m->accel_2_raw, m->brake_1_raw, m->brake_2_raw);
+      }
+      break;
+    }
+    case Can_FrontCanNode_WheelSpeed_Msg: {
+      const Can_FrontCanNode_WheelSpeed_T *m = &msg->data.wheel_speed;
+      tx_counts[2]++;
+      if (print_tx) {
+        printf("%llu WheelSpeed left_mRPM=%u right_mRPM=%u\n",
+            t, m->front_left_wheel_speed_mRPM, m->front_right_wheel_speed_mRPM);
+      }
+      break;
+    }
+    case Can_Unknown_Msg: {
+      const Frame *f = &msg->data.unknown;
+      if (f->id != ENERGY_SUMMARY_ID) {
+        break;
+      }
+      tx_counts[3]++;
+      if (print_tx) {
+        const int32_t energy_J = (int32_t)(f->data[0] | f->data[1] << 8 |
+            f->data[2] << 16 | (uint32_t)f->data[3] << 24);
+        const int32_t power_W = (int32_t)(f->data[4] | f->data[5] << 8 |
+            f->data[6] << 16 | (uint32_t)f->data[7] << 24);
+        printf("%llu Energy window_J=%d average_W=%d\n", t, energy_J, power_W);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static void print_summary(uint64_t sim_us, uint64_t wall_ns, uint32_t loop_cost_us) {
+  const Sim_Can_Stats_T *can = Sim_can_stats();
+  const double sim_s = sim_us / 1e6;
+  const double wall_s = wall_ns / 1e9;
+  fprintf(stderr, "simulated:      %.3f s\n", sim_s);
+  fprintf(stderr, "host wall time: %.3f s (%.0fx real time)\n",
+      wall_s, wall_s > 0 ? sim_s / wall_s : 0.0);
+  fprintf(stderr, "loop passes:    %llu\n", (unsigned long long)loop_stats.passes);
+  if (loop_stats.passes > 0) {
+    fprintf(stderr, "pass host ns:   min %llu, mean %.1f, max %llu\n",
+        (unsigned long long)loop_stats.min_ns,
+        (double)loop_stats.total_ns / loop_stats.passes,
+        (unsigned long long)loop_stats.max_ns);
+    fprintf(stderr, "task host ns:   input %.1f, state %.1f, output %.1f per pass\n",
+        (double)loop_stats.task_ns[EVENT_TASK_INPUT] / loop_stats.passes,
+        (double)loop_stats.task_ns[EVENT_TASK_STATE] / loop_stats.passes,
+        (double)loop_stats.task_ns[EVENT_TASK_OUTPUT] / loop_stats.passes);
+  }
+  fprintf(stderr, "awake:          %.2f%% at %u us per pass\n",
+      sim_us > 0 ? 100.0 * loop_stats.passes * loop_cost_us / sim_us : 0.0,
+      loop_cost_us);
+  if (event_driven) {
+    const Event_Stats_T *events = Event_get_stats();
+    fprintf(stderr, "wakeups:        %u (%u deadline, %u can rx)\n",
+        events->wakeups, events->deadline_wakeups, events->can_rx_wakeups);
+    fprintf(stderr, "asleep:         %.2f%% of cycles\n",
+        events->total_cycles > 0 ?
+        100.0 * events->sleep_cycles / events->total_cycles : 0.0);
+  }
+  const State_Stats_T *state = State_get_stats();
+  const Output_Stats_T *output = Output_get_stats();
+  fprintf(stderr, "rules:          %u of %u passes evaluated (%.1f%% skipped)\n",
+      state->rules_runs, state->passes,
+      state->passes > 0 ? 100.0 * (state->passes - state->rules_runs) / state->passes : 0.0);
+  fprintf(stderr, "driver output:  %u of %u frames computed (%.1f%% reused)\n",
+      output->driver_outputs_computed, output->driver_outputs,
+      output->driver_outputs > 0 ?
+      100.0 * (output->driver_outputs - output->driver_outputs_computed) / output->driver_outputs : 0.0);
+  const CanRx_Stats_T *ring = CanRx_get_stats();
+  fprintf(stderr, "can rx:         %u delivered, %u dropped, %u filtered out, %u pending\n",
+      can->rx_delivered, can->rx_dropped, can->rx_filtered, Sim_can_rx_pending());
+  fprintf(stderr, "can rx ring:    %u received, %u overflows, high water %u/%u\n",
+      ring->received, ring->overflows, ring->high_water, CAN_RX_RING_SIZE);
+  fprintf(stderr, "can tx:         DriverOutput %u, RawValues %u, WheelSpeed %u, Energy %u\n",
+      tx_counts[0], tx_counts[1], tx_counts[2], tx_counts[3]);
+  const CanTx_Stats_T *slots = CanTx_get_stats();
+  fprintf(stderr, "can tx slots:   %u queued, %u sent, %u coalesced, %u deferred, "
+      "%u errors, %u dropped, %u refused by controller\n",
+      slots->queued, slots->sent, slots->coalesced, slots->deferred, slots->errors,
+      slots->dropped, can->tx_refused);
+  const CanHealth_Stats_T *health = CanHealth_get_stats();
+  fprintf(stderr, "can health:     %u error passive, %u bus-off (%u seen by controller), "
+      "%u recovered, %u recovery timeouts\n",
+      health->error_passive_entries, health->bus_offs, can->bus_offs,
+      health->recoveries, health->recovery_timeouts);
+  if (health->recoveries > 0) {
+    fprintf(stderr, "can recovery:   min %u ms, mean %u ms, max %u ms, last backoff %u ms\n",
+        health->recover_min_ms, CanHealth_mean_recover_ms(), health->recover_max_ms,
+        health->backoff_ms);
+  }
+  const Serial_Stats_T *serial = Serial_GetStats();
+  fprintf(stderr, "serial bytes:   %u sent, %u queued, %u dropped in %u writes, "
+      "high water %u/%u, %u overruns\n",
+      Sim_serial_bytes(), serial->queued_bytes, serial->dropped_bytes,
+      serial->dropped_writes, serial->high_water, SERIAL_TX_RING_SIZE,
+      Sim_uart_overruns());
+  const Latency_Stats_T *latency = Latency_get_stats();
+  fprintf(stderr, "pedal age:      %u frames, min %u us, mean %u us, max %u us\n",
+      latency->count, latency->count > 0 ? latency->min_us : 0,
+      Latency_mean_us(), latency->max_us);
+  const Telemetry_Stats_T *telemetry = Telemetry_get_stats();
+  fprintf(stderr, "telemetry:      %u records, %u dropped, %.0f bytes/s\n",
+      telemetry->records, telemetry->dropped,
+      sim_us > 0 ? telemetry->bytes * 1e6 / sim_us : 0.0);
+}
+
+static void on_can_rx(const Sim_Can_Msg_T *msg) {
+  Trace_Record_T r;
+  if (msg->type == Can_Vcu_DashHeartbeat_Msg) {
+    Trace_from_vcu_dash(&r, msTicks, &msg->data.vcu_dash);
+  } else if (msg->type == Can_MC_DataReading_Msg) {
+    Trace_from_mc_data(&r, msTicks, &msg->data.mc_data);
+  } else {
+    return;
+  }
+  record_trace(&r);
+}
+
+// update_adc reads brake_2 last, so that read completes a sample
+static void on_adc_read(ADC_CHANNEL_T channel, uint16_t value) {
+  if (channel == ACCEL_1_CHANNEL) {
+    trace_adc.accel_1_raw = value;
+  } else if (channel == ACCEL_2_CHANNEL) {
+    trace_adc.accel_2_raw = value;
+  } else if (channel == BRAKE_1_CHANNEL) {
+    trace_adc.brake_1_raw = value;
+  } else if (channel == BRAKE_2_CHANNEL) {
+    trace_adc.brake_2_raw = value;
+    Trace_Record_T r;
+    Trace_from_raw_values(&r, msTicks, &trace_adc);
+    record_trace(&r);
+  }
+}
+
+static void on_serial_tx(uint8_t byte) {
+  fputc(byte, serial_capture);
+}
+
+/*****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-e] [-l loop_cost_us] [-q] [-r trace] [-s] [-t capture] "
+      "scenario\n", argv0);
+  fprintf(stderr, "  -e  run the event-driven loop, sleeping between passes\n");
+  fprintf(stderr, "  -l  simulated time per main loop pass (default %u us)\n",
+      DEFAULT_LOOP_COST_US);
+  fprintf(stderr, "  -q  do not print transmitted frames\n");
+  fprintf(stderr, "  -r  save a trace for log-replay\n");
+  fprintf(stderr, "  -s  echo serial output to stderr\n");
+  fprintf(stderr, "  -t  save serial output to a file\n");
+  exit(2);
+}
+
+// Same bring-up as main() in src/main.c, minus the clock setup
+static void boot(void) {
+  SystemCoreClockUpdate();
+  SysTick_Config(SystemCoreClock / 1000);
+
+  Serial_Init(115200);
+  Can_Init(500000);
+  CanRx_init();
+  CanHealth_init();
+  CanTx_init();
+
+  ADC_Init();
+  Timer_Init();
+
+  Set_Interrupt_Priorities();
+  Timer_Start();
+
+  initialize_structs();
+
+  Serial_Println("Started up");
+  Telemetry_init();
+}
+
+int main(int argc, char **argv) {
+  uint32_t loop_cost_us = DEFAULT_LOOP_COST_US;
+  int opt;
+  while ((opt = getopt(argc, argv, "el:qr:st:")) != -1) {
+    switch (opt) {
+      case 'e':
+        event_driven = true;
+        break;
+      case 'l':
+        loop_cost_us = strtoul(optarg, NULL, 0);
+        break;
+      case 'q':
+        print_tx = false;
+        break;
+      case 'r':
+        if (!Trace_create(&trace, optarg)) {
+          perror(optarg);
+          return 1;
+        }
+        recording = true;
+        Sim_set_can_rx_hook(on_can_rx);
+        Sim_set_adc_read_hook(on_adc_read);
+        break;
+      case 's':
+        Sim_set_serial_echo(true);
+        break;
+      case 't':
+        serial_capture = fopen(optarg, "wb");
+        if (serial_capture == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        Sim_set_serial_tx_hook(on_serial_tx);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || loop_cost_us == 0) {
+    usage(argv[0]);
+  }
+
+  scenario = fopen(argv[optind], "r");
+  if (scenario == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  Sim_set_can_tx_hook(on_can_tx);
+  boot();
+
+  loop_stats.min_ns = UINT64_MAX;
+  next_event();
+
+  const uint64_t wall_start = host_ns();
+  if (event_driven) {
+    Sim_set_wfi_hook(on_wfi);
+    schedule_wakeup();
+  }
+  while (advance()) {
+    if (event_driven) {
+      Event_wait();
+      if (finished()) {
+        break;
+      }
+    }
+    run_pass();
+    if (event_driven) {
+      schedule_wakeup();
+    }
+    now_us += loop_cost_us;
+  }
+
+  print_summary(now_us, host_ns() - wall_start, loop_cost_us);
+  fclose(scenario);
+  if (serial_capture != NULL) {
+    fclose(serial_capture);
+  }
+  if (recording && !Trace_close_writer(&trace)) {
+    perror("trace");
+    return 1;
+  }
+  return 0;
+}
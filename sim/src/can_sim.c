@@ -0,0 +1,329 @@
+#include "MY17_Can_Library.h"
+
+#include <stddef.h>
+
+#include "can.h"
+#include "CanController.h"
+#include "CanRx.h"
+#include "Sim.h"
+
+static Sim_Can_Msg_T rx_buffer[SIM_CAN_RX_DEPTH];
+static uint32_t rx_head = 0;
+static uint32_t rx_count = 0;
+
+// Like the real library, Can_MsgType() pulls the next frame out of the
+// controller and the typed Read functions decode whatever it pulled last
+static Sim_Can_Msg_T last_rx;
+
+static Sim_Can_Tx_Hook_T tx_hook = NULL;
+static Sim_Can_Rx_Hook_T rx_hook = NULL;
+static Sim_Can_Stats_T stats;
+static Can_ErrorID_T tx_error = Can_Error_NONE;
+
+// Fault confinement, as far as the status register shows it. Transmit
+// errors add 8 to the error counter and frames sent take 1 off; the
+// controller goes error passive at 128 and bus-off at 256, which also sets
+// INIT. Once software clears INIT it has to see 128 runs of 11 recessive
+// bits, which takes a quiet bus, before it is error active again.
+#define TEC_WARNING 96
+#define TEC_PASSIVE 128
+#define TEC_BUS_OFF 256
+#define TEC_PER_ERROR 8
+#define RECOVERY_BITS (128 * 11)
+#define CAN_BITRATE 500000
+
+static struct {
+  uint32_t CNTL;
+  uint32_t STAT;
+} ccan;
+
+static uint32_t tec = 0;
+static bool bus_off = false;
+static uint64_t init_cleared_us = 0;
+static uint64_t disturbed_until_us = 0;
+
+// Receive message objects. A frame reaches the receive buffer only if one
+// of them matches it; the rest are dropped by the controller without the
+// CPU seeing them. Can_Init opens CAN_LIBRARY_RX_MSGOBJ with an all-zero
+// mask, taking every frame, as the library does.
+typedef struct {
+  bool valid;
+  uint32_t id;
+  uint32_t mask;
+} Rx_Obj_T;
+
+static Rx_Obj_T rx_objs[CAN_RX_MSGOBJ_COUNT];
+
+static void config_rxmsgobj(CCAN_MSG_OBJ_T *msg_obj);
+
+static const CCAND_API_T ccan_api = {
+  config_rxmsgobj,
+};
+const CCAND_API_T *LPC_CCAN_API = &ccan_api;
+
+static bool tx_blocked(void) {
+  CanController_status();
+  return bus_off || (ccan.CNTL & CAN_CONTROLLER_CNTL_INIT);
+}
+
+static uint32_t frame_id(const Sim_Can_Msg_T *msg) {
+  switch (msg->type) {
+    case Can_Vcu_DashHeartbeat_Msg:
+      return VCU_DASH_HEARTBEAT__id;
+    case Can_MC_DataReading_Msg:
+      return MC_DATA_READING__id;
+    case Can_CurrentSensor_Voltage_Msg:
+      return CURRENT_SENSOR_VOLTAGE__id;
+    case Can_CurrentSensor_Current_Msg:
+      return CURRENT_SENSOR_CURRENT__id;
+    case Can_CurrentSensor_Power_Msg:
+      return CURRENT_SENSOR_POWER__id;
+    case Can_CurrentSensor_Energy_Msg:
+      return CURRENT_SENSOR_ENERGY__id;
+    default:
+      return msg->data.unknown.id;
+  }
+}
+
+static bool accepted(const Sim_Can_Msg_T *msg) {
+  // Errors are reported by the controller, not received off the bus
+  if (msg->type == Can_Error_Msg) {
+    return true;
+  }
+  const uint32_t id = frame_id(msg);
+  uint8_t i;
+  for (i = 0; i < CAN_RX_MSGOBJ_COUNT; i++) {
+    const Rx_Obj_T *obj = &rx_objs[i];
+    if (obj->valid && (id & obj->mask) == (obj->id & obj->mask)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void config_rxmsgobj(CCAN_MSG_OBJ_T *msg_obj) {
+  if (msg_obj->msgobj >= CAN_RX_MSGOBJ_COUNT) {
+    return;
+  }
+  Rx_Obj_T *obj = &rx_objs[msg_obj->msgobj];
+  obj->valid = true;
+  obj->id = msg_obj->mode_id & ~(CAN_MSGOBJ_EXT | CAN_MSGOBJ_RTR);
+  obj->mask = msg_obj->mask;
+}
+
+/*****************************************************************************
+ * Simulator controls
+ ****************************************************************************/
+
+bool Sim_can_receive(const Sim_Can_Msg_T *msg) {
+  if (!accepted(msg)) {
+    stats.rx_filtered++;
+    return true;
+  }
+  if (rx_count == SIM_CAN_RX_DEPTH) {
+    stats.rx_dropped++;
+    return false;
+  }
+  rx_buffer[(rx_head + rx_count) % SIM_CAN_RX_DEPTH] = *msg;
+  rx_count++;
+  return true;
+}
+
+uint32_t Sim_can_rx_pending(void) {
+  return rx_count;
+}
+
+void Sim_set_can_tx_hook(Sim_Can_Tx_Hook_T hook) {
+  tx_hook = hook;
+}
+
+void Sim_set_can_rx_hook(Sim_Can_Rx_Hook_T hook) {
+  rx_hook = hook;
+}
+
+void Sim_set_can_tx_error(Can_ErrorID_T error) {
+  tx_error = error;
+}
+
+void Sim_can_error_burst(uint32_t errors, uint32_t duration_us) {
+  const uint64_t until_us = Sim_now_us() + duration_us;
+  if (until_us > disturbed_until_us) {
+    disturbed_until_us = until_us;
+  }
+  if (bus_off) {
+    return;
+  }
+  tec += errors * TEC_PER_ERROR;
+  if (tec >= TEC_BUS_OFF) {
+    tec = TEC_BUS_OFF;
+    bus_off = true;
+    ccan.CNTL |= CAN_CONTROLLER_CNTL_INIT;
+    stats.bus_offs++;
+  }
+}
+
+const Sim_Can_Stats_T *Sim_can_stats(void) {
+  return &stats;
+}
+
+/*****************************************************************************
+ * Driver
+ ****************************************************************************/
+
+void CAN_ResetPeripheral(void) {
+  stats.resets++;
+}
+
+void Can_Init(uint32_t baudrate) {
+  UNUSED(baudrate);
+  uint8_t i;
+  for (i = 0; i < CAN_RX_MSGOBJ_COUNT; i++) {
+    rx_objs[i].valid = false;
+  }
+  rx_objs[CAN_LIBRARY_RX_MSGOBJ].valid = true;
+  rx_objs[CAN_LIBRARY_RX_MSGOBJ].id = 0;
+  rx_objs[CAN_LIBRARY_RX_MSGOBJ].mask = 0;
+  ccan.CNTL = 0;
+  tec = 0;
+  bus_off = false;
+  rx_head = 0;
+  rx_count = 0;
+  last_rx.type = Can_No_Msg;
+}
+
+Can_MsgID_T Can_MsgType(void) {
+  if (rx_count == 0) {
+    last_rx.type = Can_No_Msg;
+    return Can_No_Msg;
+  }
+  last_rx = rx_buffer[rx_head];
+  rx_head = (rx_head + 1) % SIM_CAN_RX_DEPTH;
+  rx_count--;
+  stats.rx_delivered++;
+  if (rx_hook != NULL) {
+    rx_hook(&last_rx);
+  }
+  return last_rx.type;
+}
+
+uint32_t CanController_status(void) {
+  if (bus_off && !(ccan.CNTL & CAN_CONTROLLER_CNTL_INIT)) {
+    const uint64_t quiet_us =
+      init_cleared_us > disturbed_until_us ? init_cleared_us : disturbed_until_us;
+    if (Sim_now_us() >= quiet_us + RECOVERY_BITS * 1000000ULL / CAN_BITRATE) {
+      bus_off = false;
+      tec = 0;
+    }
+  }
+
+  ccan.STAT = 0;
+  if (bus_off) {
+    ccan.STAT |= CAN_CONTROLLER_STAT_BOFF;
+  }
+  if (tec >= TEC_PASSIVE) {
+    ccan.STAT |= CAN_CONTROLLER_STAT_EPASS;
+  }
+  if (tec >= TEC_WARNING) {
+    ccan.STAT |= CAN_CONTROLLER_STAT_EWARN;
+  }
+  return ccan.STAT;
+}
+
+void CanController_enter_init(void) {
+  ccan.CNTL |= CAN_CONTROLLER_CNTL_INIT;
+}
+
+void CanController_leave_init(void) {
+  if (ccan.CNTL & CAN_CONTROLLER_CNTL_INIT) {
+    init_cleared_us = Sim_now_us();
+  }
+  ccan.CNTL &= ~CAN_CONTROLLER_CNTL_INIT;
+}
+
+/*****************************************************************************
+ * Reads
+ ****************************************************************************/
+
+Can_ErrorID_T Can_Error_Read(void) {
+  if (last_rx.type != Can_Error_Msg) {
+    return Can_Error_NONE;
+  }
+  return last_rx.data.error;
+}
+
+#define SIM_CAN_READ(name, field)                                   \
+  Can_ErrorID_T Can_##name##_Read(Can_##name##_T *msg) {            \
+    if (last_rx.type != Can_##name##_Msg) {                         \
+      return Can_Error_NO_RX;                                       \
+    }                                                               \
+    *msg = last_rx.data.field;                                      \
+    return Can_Error_NONE;                                          \
+  }
+
+Can_ErrorID_T Can_Unknown_Read(Frame *frame) {
+  if (last_rx.type != Can_Unknown_Msg) {
+    return Can_Error_NO_RX;
+  }
+  *frame = last_rx.data.unknown;
+  return Can_Error_NONE;
+}
+
+SIM_CAN_READ(Vcu_DashHeartbeat, vcu_dash)
+SIM_CAN_READ(MC_DataReading, mc_data)
+SIM_CAN_READ(CurrentSensor_Voltage, cs_voltage)
+SIM_CAN_READ(CurrentSensor_Current, cs_current)
+SIM_CAN_READ(CurrentSensor_Power, cs_power)
+SIM_CAN_READ(CurrentSensor_Energy, cs_energy)
+
+/*****************************************************************************
+ * Writes
+ ****************************************************************************/
+
+#define SIM_CAN_WRITE(name, field)                                  \
+  Can_ErrorID_T Can_##name##_Write(Can_##name##_T *msg) {           \
+    Sim_Can_Msg_T tx;                                               \
+    if (tx_blocked()) {                                             \
+      stats.tx_refused++;                                           \
+      return Can_Error_BOFF;                                        \
+    }                                                               \
+    if (tx_error != Can_Error_NONE) {                               \
+      stats.tx_refused++;                                           \
+      return tx_error;                                              \
+    }                                                               \
+    tx.type = Can_##name##_Msg;                                     \
+    tx.data.field = *msg;                                           \
+    stats.tx_frames++;                                              \
+    if (tec > 0) {                                                  \
+      tec--;                                                        \
+    }                                                               \
+    if (tx_hook != NULL) {                                          \
+      tx_hook(&tx);                                                 \
+    }                                                               \
+    return Can_Error_NONE;                                          \
+  }
+
+SIM_CAN_WRITE(FrontCanNode_DriverOutput, driver_output)
+SIM_CAN_WRITE(FrontCanNode_RawValues, raw_values)
+SIM_CAN_WRITE(FrontCanNode_WheelSpeed, wheel_speed)
+
+Can_ErrorID_T Can_RawWrite(Frame *frame) {
+  Sim_Can_Msg_T tx;
+  if (tx_blocked()) {
+    stats.tx_refused++;
+    return Can_Error_BOFF;
+  }
+  if (tx_error != Can_Error_NONE) {
+    stats.tx_refused++;
+    return tx_error;
+  }
+  tx.type = Can_Unknown_Msg;
+  tx.data.unknown = *frame;
+  stats.tx_frames++;
+  if (tec > 0) {
+    tec--;
+  }
+  if (tx_hook != NULL) {
+    tx_hook(&tx);
+  }
+  return Can_Error_NONE;
+}
@@ -0,0 +1,354 @@
+#include "chip.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Sim.h"
+
+uint32_t SystemCoreClock = 48000000;
+
+static SysTick_Type systick;
+static LPC_IOCON_T iocon;
+static LPC_ADC_T adc;
+static LPC_USART_T usart;
+static LPC_TIMER_T timer32_0;
+static LPC_TIMER_T timer32_1;
+
+SysTick_Type *SysTick = &systick;
+LPC_IOCON_T *LPC_IOCON = &iocon;
+LPC_ADC_T *LPC_ADC = &adc;
+LPC_USART_T *LPC_USART = &usart;
+LPC_TIMER_T *LPC_TIMER32_0 = &timer32_0;
+LPC_TIMER_T *LPC_TIMER32_1 = &timer32_1;
+
+static uint64_t now_us = 0;
+static uint16_t adc_values[ADC_NUM_CHANNELS];
+static Sim_Adc_Read_Hook_T adc_read_hook = NULL;
+static Sim_Wfi_Hook_T wfi_hook = NULL;
+static bool serial_echo = false;
+static uint32_t serial_bytes = 0;
+static Sim_Serial_Tx_Hook_T serial_tx_hook = NULL;
+
+static struct {
+  uint32_t overruns;
+} uart;
+
+// The linker provides this symbol on the target. Starts out blank, as after
+// a mass erase.
+__attribute__((aligned(4))) uint8_t __calibration_start[SIM_FLASH_SECTOR_SIZE];
+static bool flash_blank = false;
+static bool flash_prepared = false;
+static uint32_t flash_erases = 0;
+
+/*****************************************************************************
+ * Simulator controls
+ ****************************************************************************/
+
+uint64_t Sim_now_us(void) {
+  return now_us;
+}
+
+void Sim_set_now_us(uint64_t us) {
+  now_us = us;
+  // The SysTick counter reloads on every millisecond boundary and counts
+  // down from LOAD
+  const uint64_t reload = (uint64_t)systick.LOAD + 1;
+  systick.VAL = systick.LOAD - (uint32_t)((us % 1000) * reload / 1000);
+}
+
+void Sim_set_wfi_hook(Sim_Wfi_Hook_T hook) {
+  wfi_hook = hook;
+}
+
+void Sim_set_adc(ADC_CHANNEL_T channel, uint16_t value) {
+  adc_values[channel] = value;
+}
+
+void Sim_set_adc_read_hook(Sim_Adc_Read_Hook_T hook) {
+  adc_read_hook = hook;
+}
+
+void Sim_set_capture(LPC_TIMER_T *timer, uint32_t cycles) {
+  timer->CR[0] = cycles;
+}
+
+void Sim_flash_erase(void) {
+  memset(__calibration_start, 0xFF, sizeof(__calibration_start));
+  flash_blank = true;
+}
+
+uint8_t *Sim_flash(void) {
+  if (!flash_blank) {
+    Sim_flash_erase();
+  }
+  return __calibration_start;
+}
+
+uint32_t Sim_flash_erases(void) {
+  return flash_erases;
+}
+
+void Sim_set_serial_echo(bool echo) {
+  serial_echo = echo;
+}
+
+uint32_t Sim_serial_bytes(void) {
+  return serial_bytes;
+}
+
+void Sim_set_serial_tx_hook(Sim_Serial_Tx_Hook_T hook) {
+  serial_tx_hook = hook;
+}
+
+uint32_t Sim_uart_overruns(void) {
+  return uart.overruns;
+}
+
+uint64_t Sim_uart_irq_us(void) {
+  if ((LPC_USART->IER & UART_IER_THREINT) == 0) {
+    return UINT64_MAX;
+  }
+  // THRE raises once the FIFO has drained
+  const uint64_t idle_us = (LPC_USART->tx_idle_ns + 999) / 1000;
+  return idle_us > now_us ? idle_us : now_us;
+}
+
+/*****************************************************************************
+ * Core / NVIC / SysTick
+ ****************************************************************************/
+
+void SystemCoreClockUpdate(void) {
+}
+
+uint32_t SysTick_Config(uint32_t ticks) {
+  systick.LOAD = ticks - 1;
+  systick.VAL = systick.LOAD;
+  return 0;
+}
+
+void Sim_wfi(void) {
+  if (wfi_hook != NULL) {
+    wfi_hook();
+  }
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {
+  (void)irq;
+  (void)priority;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) {
+  (void)irq;
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq) {
+  (void)irq;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq) {
+  (void)irq;
+}
+
+/*****************************************************************************
+ * IOCON
+ ****************************************************************************/
+
+void Chip_IOCON_PinMuxSet(LPC_IOCON_T *pIOCON, CHIP_IOCON_PIO_T pin, uint32_t modefunc) {
+  pIOCON->REG[pin] = modefunc;
+}
+
+/*****************************************************************************
+ * ADC
+ ****************************************************************************/
+
+void Chip_ADC_Init(LPC_ADC_T *pADC, ADC_CLOCK_SETUP_T *ADCSetup) {
+  pADC->CR = 0;
+  ADCSetup->adcRate = 400000;
+  ADCSetup->bitsAccuracy = 10;
+  ADCSetup->burstMode = false;
+}
+
+void Chip_ADC_EnableChannel(LPC_ADC_T *pADC, ADC_CHANNEL_T channel, FunctionalState NewState) {
+  if (NewState == ENABLE) {
+    pADC->CR |= 1 << channel;
+  } else {
+    pADC->CR &= ~(1 << channel);
+  }
+}
+
+void Chip_ADC_SetBurstCmd(LPC_ADC_T *pADC, FunctionalState NewState) {
+  (void)pADC;
+  (void)NewState;
+}
+
+void Chip_ADC_SetStartMode(LPC_ADC_T *pADC, ADC_START_MODE_T mode, ADC_EDGESEL_T EdgeOption) {
+  (void)pADC;
+  (void)mode;
+  (void)EdgeOption;
+}
+
+Status Chip_ADC_ReadValue(LPC_ADC_T *pADC, uint8_t channel, uint16_t *data) {
+  if (channel >= ADC_NUM_CHANNELS) {
+    return ERROR;
+  }
+  pADC->DR[channel] = adc_values[channel];
+  *data = adc_values[channel];
+  if (adc_read_hook != NULL) {
+    adc_read_hook(channel, *data);
+  }
+  return SUCCESS;
+}
+
+/*****************************************************************************
+ * UART
+ ****************************************************************************/
+
+void Chip_UART_Init(LPC_USART_T *pUART) {
+  pUART->IER = 0;
+  pUART->tx_idle_ns = 0;
+  pUART->LCR = 0;
+  pUART->FCR = 0;
+  pUART->TER = 0;
+}
+
+uint32_t Chip_UART_SetBaud(LPC_USART_T *pUART, uint32_t baudrate) {
+  pUART->baudrate = baudrate;
+  return baudrate;
+}
+
+void Chip_UART_ConfigData(LPC_USART_T *pUART, uint32_t config) {
+  pUART->LCR = config;
+}
+
+void Chip_UART_SetupFIFOS(LPC_USART_T *pUART, uint32_t fcr) {
+  pUART->FCR = fcr;
+}
+
+void Chip_UART_TXEnable(LPC_USART_T *pUART) {
+  pUART->TER = 1;
+}
+
+// The transmitter drains one 10 bit frame per byte time. tx_idle_ns is
+// when the last queued byte has fully gone out.
+static uint64_t uart_byte_ns(const LPC_USART_T *pUART) {
+  return pUART->baudrate > 0 ? 10000000000ULL / pUART->baudrate : 0;
+}
+
+static uint64_t uart_now_ns(void) {
+  return now_us * 1000;
+}
+
+static uint32_t uart_fifo_level(LPC_USART_T *pUART) {
+  const uint64_t now_ns = uart_now_ns();
+  if (pUART->tx_idle_ns <= now_ns) {
+    return 0;
+  }
+  const uint64_t byte_ns = uart_byte_ns(pUART);
+  return (uint32_t)((pUART->tx_idle_ns - now_ns + byte_ns - 1) / byte_ns);
+}
+
+void Chip_UART_IntEnable(LPC_USART_T *pUART, uint32_t intMask) {
+  pUART->IER |= intMask;
+}
+
+void Chip_UART_IntDisable(LPC_USART_T *pUART, uint32_t intMask) {
+  pUART->IER &= ~intMask;
+}
+
+uint32_t Chip_UART_ReadLineStatus(LPC_USART_T *pUART) {
+  return uart_fifo_level(pUART) == 0 ? UART_LSR_THRE : 0;
+}
+
+void Chip_UART_SendByte(LPC_USART_T *pUART, uint8_t data) {
+  if (uart_fifo_level(pUART) >= SIM_UART_FIFO_SIZE) {
+    // Real hardware silently loses the byte too
+    uart.overruns++;
+    return;
+  }
+  const uint64_t now_ns = uart_now_ns();
+  const uint64_t start_ns = pUART->tx_idle_ns > now_ns ? pUART->tx_idle_ns : now_ns;
+  pUART->tx_idle_ns = start_ns + uart_byte_ns(pUART);
+  if (serial_echo) {
+    fputc(data, stderr);
+  }
+  if (serial_tx_hook != NULL) {
+    serial_tx_hook(data);
+  }
+  serial_bytes++;
+}
+
+/*****************************************************************************
+ * 32-bit timers
+ ****************************************************************************/
+
+void Chip_TIMER_Init(LPC_TIMER_T *pTMR) {
+  pTMR->TCR = 0;
+  pTMR->TC = 0;
+  pTMR->PR = 0;
+  pTMR->CCR = 0;
+}
+
+void Chip_TIMER_Enable(LPC_TIMER_T *pTMR) {
+  pTMR->TCR |= 1;
+}
+
+void Chip_TIMER_Reset(LPC_TIMER_T *pTMR) {
+  pTMR->TC = 0;
+}
+
+void Chip_TIMER_PrescaleSet(LPC_TIMER_T *pTMR, uint32_t prescale) {
+  pTMR->PR = prescale;
+}
+
+void Chip_TIMER_ClearCapture(LPC_TIMER_T *pTMR, int8_t capnum) {
+  (void)pTMR;
+  (void)capnum;
+}
+
+uint32_t Chip_TIMER_ReadCapture(LPC_TIMER_T *pTMR, int8_t capnum) {
+  return pTMR->CR[capnum];
+}
+
+/*****************************************************************************
+ * IAP flash programming
+ ****************************************************************************/
+
+uint8_t Chip_IAP_PreSectorForReadWrite(uint32_t strSector, uint32_t endSector) {
+  if (strSector != SIM_FLASH_SECTOR || endSector != SIM_FLASH_SECTOR) {
+    return IAP_INVALID_SECTOR;
+  }
+  flash_prepared = true;
+  return IAP_CMD_SUCCESS;
+}
+
+uint8_t Chip_IAP_EraseSector(uint32_t strSector, uint32_t endSector) {
+  if (strSector != SIM_FLASH_SECTOR || endSector != SIM_FLASH_SECTOR) {
+    return IAP_INVALID_SECTOR;
+  }
+  if (!flash_prepared) {
+    return IAP_SECTOR_NOT_PREPARED;
+  }
+  flash_prepared = false;
+  flash_erases++;
+  Sim_flash_erase();
+  return IAP_CMD_SUCCESS;
+}
+
+uint8_t Chip_IAP_CopyRamToFlash(uint32_t dstAdd, uint32_t *srcAdd, uint32_t byteswrt) {
+  // Addresses are 32 bits on the target, so compare offsets in 32 bits too
+  const uint32_t offset = dstAdd - (uint32_t)(uintptr_t)Sim_flash();
+  if (offset % 256 != 0 || offset + byteswrt > SIM_FLASH_SECTOR_SIZE) {
+    return IAP_DST_ADDR_ERROR;
+  }
+  if (!flash_prepared) {
+    return IAP_SECTOR_NOT_PREPARED;
+  }
+  flash_prepared = false;
+  // Programming can only clear bits
+  const uint8_t *src = (const uint8_t *)srcAdd;
+  uint32_t i;
+  for (i = 0; i < byteswrt; i++) {
+    __calibration_start[offset + i] &= src[i];
+  }
+  return IAP_CMD_SUCCESS;
+}
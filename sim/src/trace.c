@@ -0,0 +1,200 @@
+#include "Trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Records handed out per window, 16 MB of trace
+#define TRACE_WINDOW_RECORDS (1UL << 20)
+
+typedef char trace_record_size_check[
+    sizeof(Trace_Record_T) == TRACE_RECORD_SIZE ? 1 : -1];
+
+/*****************************************************************************
+ * Writing
+ ****************************************************************************/
+
+bool Trace_create(Trace_Writer_T *writer, const char *path) {
+  writer->records = 0;
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    return false;
+  }
+  uint8_t header[TRACE_HEADER_SIZE];
+  memcpy(header, TRACE_MAGIC, 4);
+  header[4] = TRACE_VERSION & 0xff;
+  header[5] = TRACE_VERSION >> 8;
+  header[6] = TRACE_RECORD_SIZE & 0xff;
+  header[7] = TRACE_RECORD_SIZE >> 8;
+  return fwrite(header, sizeof(header), 1, writer->file) == 1;
+}
+
+bool Trace_write(Trace_Writer_T *writer, const Trace_Record_T *record) {
+  writer->records++;
+  return fwrite(record, sizeof(*record), 1, writer->file) == 1;
+}
+
+bool Trace_close_writer(Trace_Writer_T *writer) {
+  const bool ok = ferror(writer->file) == 0;
+  return fclose(writer->file) == 0 && ok;
+}
+
+/*****************************************************************************
+ * Reading
+ ****************************************************************************/
+
+const char *Trace_open(Trace_Reader_T *reader, const char *path) {
+  memset(reader, 0, sizeof(*reader));
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return strerror(errno);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return strerror(errno);
+  }
+  if (st.st_size < TRACE_HEADER_SIZE) {
+    close(fd);
+    return "too short for a trace header";
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file open
+  close(fd);
+  if (map == MAP_FAILED) {
+    return strerror(errno);
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  reader->map = map;
+  reader->map_size = st.st_size;
+
+  const uint8_t *header = reader->map;
+  const uint16_t version = header[4] | (uint16_t)header[5] << 8;
+  const uint16_t record_size = header[6] | (uint16_t)header[7] << 8;
+  const char *error = NULL;
+  if (memcmp(header, TRACE_MAGIC, 4) != 0) {
+    error = "not a trace file";
+  } else if (version != TRACE_VERSION) {
+    error = "unsupported trace version";
+  } else if (record_size != TRACE_RECORD_SIZE) {
+    error = "unexpected record size";
+  } else if ((reader->map_size - TRACE_HEADER_SIZE) % TRACE_RECORD_SIZE != 0) {
+    error = "trace ends in a partial record";
+  }
+  if (error != NULL) {
+    Trace_close(reader);
+    return error;
+  }
+
+  reader->records = (const Trace_Record_T *)(reader->map + TRACE_HEADER_SIZE);
+  reader->count = (reader->map_size - TRACE_HEADER_SIZE) / TRACE_RECORD_SIZE;
+  return NULL;
+}
+
+uint32_t Trace_next_window(Trace_Reader_T *reader, const Trace_Record_T **records) {
+  // Everything before the new window has been used, so drop its pages
+  // rather than let a multi-gigabyte trace fill up memory
+  const uint64_t page = sysconf(_SC_PAGESIZE);
+  const uint64_t used = TRACE_HEADER_SIZE + reader->next * TRACE_RECORD_SIZE;
+  const uint64_t release_end = used / page * page;
+  if (release_end > reader->released) {
+    madvise((void *)(reader->map + reader->released), release_end - reader->released,
+        MADV_DONTNEED);
+    reader->released = release_end;
+  }
+
+  const uint64_t left = reader->count - reader->next;
+  const uint32_t length = left < TRACE_WINDOW_RECORDS ? left : TRACE_WINDOW_RECORDS;
+  *records = reader->records + reader->next;
+  reader->next += length;
+  return length;
+}
+
+void Trace_close(Trace_Reader_T *reader) {
+  if (reader->map != NULL) {
+    munmap((void *)reader->map, reader->map_size);
+  }
+  reader->map = NULL;
+  reader->records = NULL;
+  reader->count = 0;
+}
+
+/*****************************************************************************
+ * Frame conversion
+ ****************************************************************************/
+
+static void begin_record(Trace_Record_T *record, Trace_Type_T type, uint32_t time_ms) {
+  memset(record, 0, sizeof(*record));
+  record->time_ms = time_ms;
+  record->type = type;
+}
+
+void Trace_from_raw_values(Trace_Record_T *record, uint32_t time_ms,
+    const Can_FrontCanNode_RawValues_T *msg) {
+  begin_record(record, TRACE_RAW_VALUES, time_ms);
+  record->value[0] = msg->accel_1_raw;
+  record->value[1] = msg->accel_2_raw;
+  record->value[2] = msg->brake_1_raw;
+  record->value[3] = msg->brake_2_raw;
+}
+
+void Trace_to_raw_values(const Trace_Record_T *record, Can_FrontCanNode_RawValues_T *msg) {
+  msg->accel_1_raw = record->value[0];
+  msg->accel_2_raw = record->value[1];
+  msg->brake_1_raw = record->value[2];
+  msg->brake_2_raw = record->value[3];
+}
+
+void Trace_from_vcu_dash(Trace_Record_T *record, uint32_t time_ms,
+    const Can_Vcu_DashHeartbeat_T *msg) {
+  begin_record(record, TRACE_VCU_DASH, time_ms);
+  record->flags = msg->hv_light ? TRACE_VCU_HV_LIGHT : 0;
+  record->value[0] = msg->lv_battery_voltage;
+  record->value[1] = msg->limp_state;
+}
+
+void Trace_to_vcu_dash(const Trace_Record_T *record, Can_Vcu_DashHeartbeat_T *msg) {
+  msg->hv_light = (record->flags & TRACE_VCU_HV_LIGHT) != 0;
+  msg->lv_battery_voltage = record->value[0];
+  msg->limp_state = (Can_Vcu_LimpState_T)record->value[1];
+}
+
+void Trace_from_mc_data(Trace_Record_T *record, uint32_t time_ms,
+    const Can_MC_DataReading_T *msg) {
+  begin_record(record, TRACE_MC_DATA, time_ms);
+  record->value[0] = msg->type;
+  record->value[1] = (uint16_t)msg->value;
+}
+
+void Trace_to_mc_data(const Trace_Record_T *record, Can_MC_DataReading_T *msg) {
+  msg->type = (Can_MC_RegID_T)record->value[0];
+  msg->value = (int16_t)record->value[1];
+}
+
+void Trace_from_driver_output(Trace_Record_T *record, uint32_t time_ms,
+    const Can_FrontCanNode_DriverOutput_T *msg) {
+  begin_record(record, TRACE_DRIVER_OUTPUT, time_ms);
+  record->flags =
+    (msg->throttle_implausible ? TRACE_DRIVER_IMPLAUSIBLE : 0) |
+    (msg->brake_throttle_conflict ? TRACE_DRIVER_CONFLICT : 0) |
+    (msg->brake_engaged ? TRACE_DRIVER_BRAKE_ENGAGED : 0);
+  record->value[0] = (uint16_t)msg->torque;
+  record->value[1] = (uint16_t)msg->torque_before_control;
+  record->value[2] = msg->brake_pressure;
+}
+
+void Trace_to_driver_output(const Trace_Record_T *record, Can_FrontCanNode_DriverOutput_T *msg) {
+  msg->torque = (int16_t)record->value[0];
+  msg->torque_before_control = (int16_t)record->value[1];
+  msg->brake_pressure = (uint8_t)record->value[2];
+  msg->throttle_implausible = (record->flags & TRACE_DRIVER_IMPLAUSIBLE) != 0;
+  msg->brake_throttle_conflict = (record->flags & TRACE_DRIVER_CONFLICT) != 0;
+  msg->brake_engaged = (record->flags & TRACE_DRIVER_BRAKE_ENGAGED) != 0;
+  msg->steering_position = 0;
+}
@@ -0,0 +1,673 @@
+/**
+ * Worst-case stack and main loop instruction budget for the firmware image.
+ *
+ * Reads the .ci call graphs GCC writes with -fcallgraph-info=su, which give
+ * every function's own frame size and its calls, and works out the deepest
+ * call chain from main and from each interrupt handler. Indirect calls are
+ * resolved from -i rules, since the compiler cannot see through function
+ * pointer tables.
+ *
+ * The Cortex-M0 lets an interrupt preempt only strictly lower priorities,
+ * so at most one handler per priority level is on the stack at once. The
+ * worst case is main plus, for every level, the deepest handler at that
+ * level and the exception frame it stacks.
+ *
+ * The total is compared against the RAM region in the linker script, and,
+ * given the image's symbol table, against the reserved stack and against
+ * all RAM left between the heap and the top of the stack. Given the
+ * instruction counts from instruction_count.awk, the longest static call
+ * path of each main loop stage is also reported; loops are counted once,
+ * so it is a lower bound on work per pass and a guide to where it goes.
+ *
+ * Given the symbol table, every handler named with -r must also be defined
+ * in the image itself, not left as a weak alias of the startup code's
+ * default handler, so that a handler the image lacks fails the report
+ * rather than quietly dropping out of the total.
+ *
+ * Exits 1 if the worst case does not fit in RAM.
+ */
+
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_FUNCTIONS 2048
+#define MAX_EDGES 8192
+#define MAX_RULES 32
+#define MAX_ROOTS 16
+#define MAX_NAME_LENGTH 96
+#define MAX_LINE_LENGTH 1024
+
+// Eight stacked registers, plus a word of padding when the core realigns
+// the stack to 8 bytes on entry
+#define EXCEPTION_FRAME_BYTES 36
+
+#define INDIRECT_CALL "__indirect_call"
+
+typedef enum {
+  VISIT_NONE,
+  VISIT_ACTIVE,
+  VISIT_DONE
+} Visit_T;
+
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  bool defined;
+  // Frame size depends on runtime values
+  bool dynamic;
+  uint32_t stack_bytes;
+  bool have_instructions;
+  uint32_t instructions;
+
+  Visit_T visit;
+  bool on_loop_path;
+  // Some call chain from here recurses or grows its frame at runtime
+  bool unbounded;
+  uint32_t depth_bytes;
+  uint32_t path_instructions;
+  int32_t deepest_callee;
+  int32_t longest_callee;
+} Function_T;
+
+typedef struct {
+  int32_t caller;
+  int32_t callee;
+} Edge_T;
+
+typedef struct {
+  char caller[MAX_NAME_LENGTH];
+  char pattern[MAX_NAME_LENGTH];
+  bool used;
+} Indirect_Rule_T;
+
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  int32_t priority;
+  // Strong text symbol in the image
+  bool in_image;
+} Root_T;
+
+typedef struct {
+  bool have_region;
+  uint32_t origin;
+  uint32_t length;
+  bool have_symbols;
+  uint32_t heap_limit;
+  uint32_t stack_limit;
+  uint32_t stack_top;
+} Memory_T;
+
+static Function_T functions[MAX_FUNCTIONS];
+static uint32_t function_count = 0;
+static Edge_T edges[MAX_EDGES];
+static uint32_t edge_count = 0;
+static Indirect_Rule_T rules[MAX_RULES];
+static uint32_t rule_count = 0;
+static Root_T isrs[MAX_ROOTS];
+static uint32_t isr_count = 0;
+static char loop_stages[MAX_ROOTS][MAX_NAME_LENGTH];
+static uint32_t loop_stage_count = 0;
+static const char *main_name = "main";
+static Memory_T memory;
+static uint32_t unresolved_indirect = 0;
+
+static void fail(const char *what, const char *detail) {
+  fprintf(stderr, "%s: %s\n", what, detail);
+  exit(1);
+}
+
+static int32_t find_function(const char *name) {
+  uint32_t i;
+  for (i = 0; i < function_count; i++) {
+    if (strcmp(functions[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int32_t add_function(const char *name) {
+  const int32_t found = find_function(name);
+  if (found >= 0) {
+    return found;
+  }
+  if (function_count == MAX_FUNCTIONS) {
+    fail("call graph", "too many functions");
+  }
+  Function_T *function = &functions[function_count];
+  memset(function, 0, sizeof(*function));
+  snprintf(function->name, sizeof(function->name), "%s", name);
+  function->deepest_callee = -1;
+  function->longest_callee = -1;
+  return function_count++;
+}
+
+static void add_edge(int32_t caller, int32_t callee) {
+  if (edge_count == MAX_EDGES) {
+    fail("call graph", "too many calls");
+  }
+  edges[edge_count].caller = caller;
+  edges[edge_count].callee = callee;
+  edge_count++;
+}
+
+/*****************************************************************************
+ * Input
+ ****************************************************************************/
+
+// Copies the quoted value following key into out. Local clones are named
+// like "src/serial.c:fill_tx_fifo.part.0", while the image just has
+// "fill_tx_fifo.part.0", so any file prefix is dropped.
+static bool get_quoted(const char *line, const char *key, char *out, size_t size) {
+  const char *start = strstr(line, key);
+  if (start == NULL) {
+    return false;
+  }
+  start += strlen(key);
+  const char *colon;
+  while ((colon = strchr(start, ':')) != NULL && colon < strchr(start, '"')) {
+    start = colon + 1;
+  }
+  const char *end = strchr(start, '"');
+  if (end == NULL) {
+    return false;
+  }
+  const size_t length = (size_t)(end - start) < size - 1 ? (size_t)(end - start) : size - 1;
+  memcpy(out, start, length);
+  out[length] = '\0';
+  return true;
+}
+
+// Nodes look like
+//   node: { title: "f" label: "f\nfile.c:1:6\n24 bytes (static)\n0 dynamic objects" }
+// and only functions defined in this file carry a size
+static void read_node(const char *line) {
+  char title[MAX_NAME_LENGTH];
+  char label[MAX_LINE_LENGTH];
+  if (!get_quoted(line, "title: \"", title, sizeof(title)) ||
+      !get_quoted(line, "label: \"", label, sizeof(label))) {
+    return;
+  }
+  if (strcmp(title, INDIRECT_CALL) == 0) {
+    return;
+  }
+  const int32_t index = add_function(title);
+
+  const char *sizes = strstr(label, " bytes (");
+  if (sizes == NULL) {
+    return;
+  }
+  // Back up over the digits of the size
+  const char *digits = sizes;
+  while (digits > label && digits[-1] >= '0' && digits[-1] <= '9') {
+    digits--;
+  }
+  Function_T *function = &functions[index];
+  const uint32_t bytes = strtoul(digits, NULL, 10);
+  // A static function can share its name with one in another file; keep
+  // the larger frame
+  if (!function->defined || bytes > function->stack_bytes) {
+    function->stack_bytes = bytes;
+  }
+  function->defined = true;
+  function->dynamic |= strncmp(sizes, " bytes (static)", 15) != 0;
+}
+
+static void read_edge(const char *line) {
+  char source[MAX_NAME_LENGTH];
+  char target[MAX_NAME_LENGTH];
+  if (!get_quoted(line, "sourcename: \"", source, sizeof(source)) ||
+      !get_quoted(line, "targetname: \"", target, sizeof(target))) {
+    return;
+  }
+  const int32_t caller = add_function(source);
+  if (strcmp(target, INDIRECT_CALL) != 0) {
+    add_edge(caller, add_function(target));
+    return;
+  }
+
+  // Every function a rule allows this caller to reach through a pointer.
+  // Targets are matched once everything has been read, so remember the
+  // call as an edge to the placeholder for now.
+  add_edge(caller, -1);
+}
+
+static void read_call_graph(const char *path) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (strncmp(line, "node:", 5) == 0) {
+      read_node(line);
+    } else if (strncmp(line, "edge:", 5) == 0) {
+      read_edge(line);
+    }
+  }
+  fclose(in);
+}
+
+// Replaces placeholder edges with one edge per rule match. Indirect calls
+// in functions no rule covers are counted and otherwise ignored.
+static void resolve_indirect_calls(void) {
+  const uint32_t original_count = edge_count;
+  uint32_t e;
+  for (e = 0; e < original_count; e++) {
+    if (edges[e].callee >= 0) {
+      continue;
+    }
+    const int32_t caller = edges[e].caller;
+    bool resolved = false;
+    uint32_t r;
+    for (r = 0; r < rule_count; r++) {
+      if (strcmp(rules[r].caller, functions[caller].name) != 0) {
+        continue;
+      }
+      uint32_t f;
+      for (f = 0; f < function_count; f++) {
+        if (functions[f].defined && fnmatch(rules[r].pattern, functions[f].name, 0) == 0) {
+          add_edge(caller, f);
+          rules[r].used = true;
+          resolved = true;
+        }
+      }
+    }
+    if (!resolved) {
+      fprintf(stderr, "warning: unresolved indirect call in %s\n", functions[caller].name);
+      unresolved_indirect++;
+    }
+  }
+}
+
+// The MEMORY line for RAM, like
+//   RAM (rwx) : ORIGIN = 0x10000100, LENGTH = 0x1F00
+static void read_linker_script(const char *path) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    const char *origin = strstr(line, "ORIGIN =");
+    const char *length = strstr(line, "LENGTH =");
+    if (strstr(line, "RAM") == NULL || origin == NULL || length == NULL) {
+      continue;
+    }
+    memory.origin = strtoul(origin + 8, NULL, 0);
+    memory.length = strtoul(length + 8, NULL, 0);
+    memory.have_region = true;
+    break;
+  }
+  fclose(in);
+  if (!memory.have_region) {
+    fail(path, "no RAM region");
+  }
+}
+
+// nm output, "<address> <type> <name>" per line
+static void read_symbols(const char *path) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[MAX_LINE_LENGTH];
+  uint8_t found = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char name[MAX_NAME_LENGTH];
+    char type;
+    unsigned long address;
+    if (sscanf(line, "%lx %c %95s", &address, &type, name) != 3) {
+      continue;
+    }
+    if (type == 'T' || type == 't') {
+      uint32_t i;
+      for (i = 0; i < isr_count; i++) {
+        isrs[i].in_image |= strcmp(isrs[i].name, name) == 0;
+      }
+    }
+    if (strcmp(name, "__HeapLimit") == 0) {
+      memory.heap_limit = address;
+      found |= 1;
+    } else if (strcmp(name, "__StackLimit") == 0) {
+      memory.stack_limit = address;
+      found |= 2;
+    } else if (strcmp(name, "__StackTop") == 0) {
+      memory.stack_top = address;
+      found |= 4;
+    }
+  }
+  fclose(in);
+  memory.have_symbols = found == 7;
+  if (!memory.have_symbols) {
+    fprintf(stderr, "warning: %s lacks the heap and stack symbols\n", path);
+  }
+  uint32_t i;
+  for (i = 0; i < isr_count; i++) {
+    if (!isrs[i].in_image) {
+      fail(isrs[i].name, "not defined in the image, or only as a weak default");
+    }
+  }
+}
+
+// instruction_count.awk output, one {"name": ..., "count": ...} per line
+static void read_instructions(const char *path) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char name[MAX_NAME_LENGTH];
+    unsigned count;
+    if (sscanf(line, " {\"name\": \"%95[^\"]\", \"count\": %u}", name, &count) != 2) {
+      continue;
+    }
+    const int32_t index = find_function(name);
+    if (index >= 0) {
+      functions[index].have_instructions = true;
+      functions[index].instructions = count;
+    }
+  }
+  fclose(in);
+}
+
+/*****************************************************************************
+ * Analysis
+ ****************************************************************************/
+
+// Deepest stack and longest instruction path from each function down,
+// memoized. A call back into a function still being walked is recursion,
+// which has no bound.
+static void walk(int32_t index) {
+  Function_T *function = &functions[index];
+  if (function->visit == VISIT_DONE) {
+    return;
+  }
+  if (function->visit == VISIT_ACTIVE) {
+    function->unbounded = true;
+    return;
+  }
+  function->visit = VISIT_ACTIVE;
+
+  uint32_t deepest = 0;
+  uint32_t longest = 0;
+  bool unbounded = function->dynamic;
+  uint32_t e;
+  for (e = 0; e < edge_count; e++) {
+    if (edges[e].caller != index || edges[e].callee < 0) {
+      continue;
+    }
+    const int32_t callee = edges[e].callee;
+    walk(callee);
+    const Function_T *c = &functions[callee];
+    unbounded |= c->unbounded || c->visit == VISIT_ACTIVE;
+    if (c->depth_bytes > deepest || function->deepest_callee < 0) {
+      deepest = c->depth_bytes;
+      function->deepest_callee = callee;
+    }
+    if (c->path_instructions > longest || function->longest_callee < 0) {
+      longest = c->path_instructions;
+      function->longest_callee = callee;
+    }
+  }
+
+  function->unbounded |= unbounded;
+  function->depth_bytes = function->stack_bytes + deepest;
+  function->path_instructions = function->instructions + longest;
+  function->visit = VISIT_DONE;
+}
+
+static void mark_loop_path(int32_t index) {
+  if (functions[index].on_loop_path) {
+    return;
+  }
+  functions[index].on_loop_path = true;
+  uint32_t e;
+  for (e = 0; e < edge_count; e++) {
+    if (edges[e].caller == index && edges[e].callee >= 0) {
+      mark_loop_path(edges[e].callee);
+    }
+  }
+}
+
+static void print_chain(int32_t index, bool by_stack) {
+  uint32_t hops = 0;
+  while (index >= 0 && hops++ < MAX_FUNCTIONS) {
+    printf("%s%s", hops > 1 ? " > " : "", functions[index].name);
+    index = by_stack ? functions[index].deepest_callee : functions[index].longest_callee;
+  }
+  printf("\n");
+}
+
+static const Function_T *require(const char *name) {
+  const int32_t index = find_function(name);
+  if (index < 0 || !functions[index].defined) {
+    fail(name, "not found in the call graphs");
+  }
+  walk(index);
+  return &functions[index];
+}
+
+static void print_undefined(void) {
+  uint32_t i;
+  bool first = true;
+  for (i = 0; i < function_count; i++) {
+    const Function_T *function = &functions[i];
+    if (function->defined || function->visit != VISIT_DONE) {
+      continue;
+    }
+    printf("%s%s", first ? "\nCalled without stack information, counted as 0 bytes:\n  " : " ",
+        function->name);
+    first = false;
+  }
+  if (!first) {
+    printf("\n");
+  }
+}
+
+// @return the worst-case total in bytes
+static uint32_t report_stack(bool *unbounded) {
+  const Function_T *main_fn = require(main_name);
+  *unbounded = main_fn->unbounded;
+
+  printf("Worst-case stack\n");
+  printf("  %-24s      %6u bytes  ", main_fn->name, main_fn->depth_bytes);
+  print_chain(main_fn - functions, true);
+  uint32_t total = main_fn->depth_bytes;
+
+  // One handler per priority level can be active at once
+  int32_t priority;
+  for (priority = 0; priority < 256; priority++) {
+    uint32_t level_bytes = 0;
+    bool any = false;
+    uint32_t i;
+    for (i = 0; i < isr_count; i++) {
+      if (isrs[i].priority != priority) {
+        continue;
+      }
+      const Function_T *isr = require(isrs[i].name);
+      const uint32_t bytes = isr->depth_bytes + EXCEPTION_FRAME_BYTES;
+      printf("  %-24s p%-3d %6u bytes  ", isr->name, priority, bytes);
+      print_chain(isr - functions, true);
+      *unbounded |= isr->unbounded;
+      level_bytes = bytes > level_bytes ? bytes : level_bytes;
+      any = true;
+    }
+    if (any) {
+      total += level_bytes;
+    }
+  }
+  printf("  %-24s      %6u bytes%s\n", "total, all levels nested", total,
+      *unbounded ? " (UNBOUNDED: recursion or dynamic frames)" : "");
+  printf("  handler frames include %u bytes of exception stacking\n", EXCEPTION_FRAME_BYTES);
+  return total;
+}
+
+static bool report_memory(uint32_t total) {
+  printf("\nRAM\n");
+  printf("  region                    0x%08x, %u bytes\n", memory.origin, memory.length);
+  bool fits = total <= memory.length;
+  if (memory.have_symbols) {
+    const uint32_t statics = memory.heap_limit - memory.origin;
+    const uint32_t reserved = memory.stack_top - memory.stack_limit;
+    const uint32_t free_bytes = memory.stack_top - memory.heap_limit;
+    printf("  data, bss and heap        %u bytes\n", statics);
+    printf("  reserved stack            %u bytes, margin %d\n",
+        reserved, (int32_t)(reserved - total));
+    printf("  free for stack            %u bytes, margin %d\n",
+        free_bytes, (int32_t)(free_bytes - total));
+    fits = total <= free_bytes;
+  } else {
+    printf("  margin against region     %d bytes\n", (int32_t)(memory.length - total));
+  }
+  return fits;
+}
+
+static void report_loop(void) {
+  printf("\nMain loop instructions, longest static path per stage\n");
+  uint32_t pass = 0;
+  uint32_t i;
+  for (i = 0; i < loop_stage_count; i++) {
+    const Function_T *stage = require(loop_stages[i]);
+    printf("  %-24s %6u  ", stage->name, stage->path_instructions);
+    print_chain(stage - functions, false);
+    pass += stage->path_instructions;
+    mark_loop_path(stage - functions);
+  }
+  printf("  %-24s %6u\n", "pass", pass);
+
+  printf("\nFunctions on the main loop path\n");
+  printf("  %-32s %12s %12s\n", "function", "instructions", "stack bytes");
+  for (i = 0; i < function_count; i++) {
+    const Function_T *function = &functions[i];
+    if (!function->on_loop_path || !function->defined) {
+      continue;
+    }
+    if (function->have_instructions) {
+      printf("  %-32s %12u %12u\n", function->name, function->instructions,
+          function->stack_bytes);
+    } else {
+      printf("  %-32s %12s %12u\n", function->name, "inlined", function->stack_bytes);
+    }
+  }
+}
+
+/*****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s -l linker_script [-s symbols] [-n instructions] [-m main]\n"
+      "    [-r isr:priority]... [-i caller=pattern]... [-p loop_stage]... file.ci...\n",
+      argv0);
+  fprintf(stderr, "  -l  linker script holding the RAM region\n");
+  fprintf(stderr, "  -s  nm output of the image, for the heap and stack symbols and\n"
+      "      to check the interrupt handlers are in it\n");
+  fprintf(stderr, "  -n  instruction counts from instruction_count.awk\n");
+  fprintf(stderr, "  -m  thread mode entry point (default main)\n");
+  fprintf(stderr, "  -r  interrupt handler and its NVIC priority\n");
+  fprintf(stderr, "  -i  functions matching pattern are called through pointers in caller\n");
+  fprintf(stderr, "  -p  main loop stage to report instructions for\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *linker_script = NULL;
+  const char *symbols = NULL;
+  const char *instructions = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:s:n:m:r:i:p:")) != -1) {
+    switch (opt) {
+      case 'l':
+        linker_script = optarg;
+        break;
+      case 's':
+        symbols = optarg;
+        break;
+      case 'n':
+        instructions = optarg;
+        break;
+      case 'm':
+        main_name = optarg;
+        break;
+      case 'r': {
+        char *colon = strchr(optarg, ':');
+        if (colon == NULL || isr_count == MAX_ROOTS) {
+          usage(argv[0]);
+        }
+        *colon = '\0';
+        snprintf(isrs[isr_count].name, MAX_NAME_LENGTH, "%s", optarg);
+        isrs[isr_count].priority = strtol(colon + 1, NULL, 0);
+        if (isrs[isr_count].priority < 0 || isrs[isr_count].priority > 255) {
+          usage(argv[0]);
+        }
+        isr_count++;
+        break;
+      }
+      case 'i': {
+        char *equals = strchr(optarg, '=');
+        if (equals == NULL || rule_count == MAX_RULES) {
+          usage(argv[0]);
+        }
+        *equals = '\0';
+        snprintf(rules[rule_count].caller, MAX_NAME_LENGTH, "%s", optarg);
+        snprintf(rules[rule_count].pattern, MAX_NAME_LENGTH, "%s", equals + 1);
+        rule_count++;
+        break;
+      }
+      case 'p':
+        if (loop_stage_count == MAX_ROOTS) {
+          usage(argv[0]);
+        }
+        snprintf(loop_stages[loop_stage_count++], MAX_NAME_LENGTH, "%s", optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (linker_script == NULL || optind == argc) {
+    usage(argv[0]);
+  }
+
+  int i;
+  for (i = optind; i < argc; i++) {
+    read_call_graph(argv[i]);
+  }
+  resolve_indirect_calls();
+  uint32_t r;
+  for (r = 0; r < rule_count; r++) {
+    if (!rules[r].used) {
+      fprintf(stderr, "warning: %s=%s matched no indirect call\n",
+          rules[r].caller, rules[r].pattern);
+    }
+  }
+  read_linker_script(linker_script);
+  if (symbols != NULL) {
+    read_symbols(symbols);
+  }
+  if (instructions != NULL) {
+    read_instructions(instructions);
+  }
+
+  bool unbounded;
+  const uint32_t total = report_stack(&unbounded);
+  const bool fits = report_memory(total);
+  if (loop_stage_count > 0) {
+    report_loop();
+  }
+  print_undefined();
+  if (unresolved_indirect > 0) {
+    printf("\n%u indirect calls could not be resolved and are not counted\n",
+        unresolved_indirect);
+  }
+  return fits && !unbounded ? 0 : 1;
+}
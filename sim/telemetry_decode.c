@@ -0,0 +1,316 @@
+/**
+ * Host decoder for the binary telemetry stream written by src/Telemetry.c.
+ *
+ * Reads a raw UART capture, from the car or from can-node-sim -t, splits it
+ * on 0x00 delimiters, COBS decodes each frame and checks its length and
+ * CRC. Good records go to one CSV file per record type, named
+ * <prefix>_<type>.csv, each starting with a header row and with the record
+ * timestamp in the first column. Anything that is not a valid record, such
+ * as debug text, is counted and skipped.
+ *
+ * A summary of records per type, rejected frames and sequence gaps goes to
+ * stderr.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Telemetry.h"
+
+// Longer frames are certainly not records, and are read past to the next
+// delimiter without being kept
+#define MAX_FRAME_SIZE 256
+
+typedef struct {
+  const uint8_t *data;
+  uint8_t pos;
+} Reader_T;
+
+typedef void (*Print_Fn_T)(FILE *out, Reader_T *reader);
+
+typedef struct {
+  const char *name;
+  uint8_t payload_size;
+  const char *columns;
+  Print_Fn_T print;
+} Record_Def_T;
+
+typedef struct {
+  uint32_t frames;
+  uint32_t bad_length;
+  uint32_t bad_crc;
+  uint32_t bad_type;
+  uint32_t sequence_gaps;
+  uint32_t missing_records;
+  uint32_t records[TELEMETRY_RECORD_LENGTH];
+} Decode_Stats_T;
+
+static void print_throttle(FILE *out, Reader_T *reader);
+static void print_brake(FILE *out, Reader_T *reader);
+static void print_current_sensor(FILE *out, Reader_T *reader);
+static void print_mc_data(FILE *out, Reader_T *reader);
+static void print_mc_state(FILE *out, Reader_T *reader);
+static void print_latency(FILE *out, Reader_T *reader);
+static void print_loop_timing(FILE *out, Reader_T *reader);
+
+#define CS_COLUMNS "value,last_updated"
+
+static const Record_Def_T record_defs[TELEMETRY_RECORD_LENGTH] = {
+  [TELEMETRY_THROTTLE] = { "throttle", TELEMETRY_THROTTLE_SIZE,
+    "accel_1_raw,accel_2_raw,accel_1_travel,accel_2_travel,accel_torque,"
+    "implausibility_observed,implausibility_reported", print_throttle },
+  [TELEMETRY_BRAKE] = { "brake", TELEMETRY_BRAKE_SIZE,
+    "brake_1_raw,brake_2_raw,brake_pressure,has_conflict", print_brake },
+  [TELEMETRY_CS_VOLTAGE] = { "cs_voltage", TELEMETRY_CS_SIZE, CS_COLUMNS,
+    print_current_sensor },
+  [TELEMETRY_CS_CURRENT] = { "cs_current", TELEMETRY_CS_SIZE, CS_COLUMNS,
+    print_current_sensor },
+  [TELEMETRY_CS_POWER] = { "cs_power", TELEMETRY_CS_SIZE, CS_COLUMNS,
+    print_current_sensor },
+  [TELEMETRY_CS_ENERGY] = { "cs_energy", TELEMETRY_CS_SIZE, CS_COLUMNS,
+    print_current_sensor },
+  [TELEMETRY_MC_DATA] = { "mc_data", TELEMETRY_MC_DATA_SIZE,
+    "motor_speed,last_updated", print_mc_data },
+  [TELEMETRY_MC_STATE] = { "mc_state", TELEMETRY_MC_STATE_SIZE,
+    "limp_state,hv_enabled,lv_voltage,last_updated", print_mc_state },
+  // Bucket n counts ages from n to n + 1 ms, the last one everything above
+  [TELEMETRY_LATENCY] = { "latency", TELEMETRY_LATENCY_SIZE,
+    "count,min_us,max_us,mean_us,"
+    "ms_0,ms_1,ms_2,ms_3,ms_4,ms_5,ms_6,ms_7,ms_8,ms_9,ms_10,ms_11",
+    print_latency },
+  // Bucket 0 counts spans under 2^LOOP_TIMING_MIN_SHIFT cycles, and bucket
+  // n after it spans from 2^(LOOP_TIMING_MIN_SHIFT + n - 1)
+  [TELEMETRY_LOOP_TIMING] = { "loop_timing", TELEMETRY_LOOP_TIMING_SIZE,
+    "stage,count,min_cycles,max_cycles,"
+    "bucket_0,bucket_1,bucket_2,bucket_3,bucket_4,bucket_5,bucket_6,bucket_7,"
+    "bucket_8,bucket_9,bucket_10,bucket_11,bucket_12,bucket_13,bucket_14",
+    print_loop_timing },
+};
+
+static FILE *outputs[TELEMETRY_RECORD_LENGTH];
+static const char *prefix;
+static Decode_Stats_T stats;
+static bool have_sequence = false;
+static uint8_t last_sequence;
+
+static uint8_t get_u8(Reader_T *reader) {
+  return reader->data[reader->pos++];
+}
+
+static uint16_t get_u16(Reader_T *reader) {
+  const uint16_t low = get_u8(reader);
+  return low | (uint16_t)get_u8(reader) << 8;
+}
+
+static uint32_t get_u32(Reader_T *reader) {
+  const uint32_t low = get_u16(reader);
+  return low | (uint32_t)get_u16(reader) << 16;
+}
+
+static void print_throttle(FILE *out, Reader_T *reader) {
+  const uint16_t accel_1_raw = get_u16(reader);
+  const uint16_t accel_2_raw = get_u16(reader);
+  const uint16_t accel_1_travel = get_u16(reader);
+  const uint16_t accel_2_travel = get_u16(reader);
+  const uint16_t accel_torque = get_u16(reader);
+  const uint8_t flags = get_u8(reader);
+  fprintf(out, "%u,%u,%u,%u,%u,%d,%d\n", accel_1_raw, accel_2_raw,
+      accel_1_travel, accel_2_travel, accel_torque,
+      (flags & TELEMETRY_THROTTLE_IMPLAUSIBILITY_OBSERVED) != 0,
+      (flags & TELEMETRY_THROTTLE_IMPLAUSIBILITY_REPORTED) != 0);
+}
+
+static void print_brake(FILE *out, Reader_T *reader) {
+  const uint16_t brake_1_raw = get_u16(reader);
+  const uint16_t brake_2_raw = get_u16(reader);
+  const uint8_t brake_pressure = get_u8(reader);
+  const uint8_t flags = get_u8(reader);
+  fprintf(out, "%u,%u,%u,%d\n", brake_1_raw, brake_2_raw, brake_pressure,
+      (flags & TELEMETRY_BRAKE_CONFLICT) != 0);
+}
+
+static void print_current_sensor(FILE *out, Reader_T *reader) {
+  const int32_t value = (int32_t)get_u32(reader);
+  const uint32_t last_updated = get_u32(reader);
+  fprintf(out, "%d,%u\n", value, last_updated);
+}
+
+static void print_mc_data(FILE *out, Reader_T *reader) {
+  const int16_t motor_speed = (int16_t)get_u16(reader);
+  const uint32_t last_updated = get_u32(reader);
+  fprintf(out, "%d,%u\n", motor_speed, last_updated);
+}
+
+static void print_mc_state(FILE *out, Reader_T *reader) {
+  const uint8_t limp_state = get_u8(reader);
+  const uint8_t flags = get_u8(reader);
+  const uint16_t lv_voltage = get_u16(reader);
+  const uint32_t last_updated = get_u32(reader);
+  fprintf(out, "%u,%d,%u,%u\n", limp_state,
+      (flags & TELEMETRY_MC_STATE_HV_ENABLED) != 0, lv_voltage, last_updated);
+}
+
+static void print_latency(FILE *out, Reader_T *reader) {
+  const uint32_t count = get_u32(reader);
+  const uint32_t min_us = get_u32(reader);
+  const uint32_t max_us = get_u32(reader);
+  const uint32_t mean_us = get_u32(reader);
+  fprintf(out, "%u,%u,%u,%u", count, min_us, max_us, mean_us);
+  uint8_t i;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    fprintf(out, ",%u", get_u32(reader));
+  }
+  fprintf(out, "\n");
+}
+
+static void print_loop_timing(FILE *out, Reader_T *reader) {
+  static const char *stages[LOOP_TIMING_STAGE_COUNT] = {
+    "input", "state", "output", "pass",
+  };
+  const uint8_t stage = get_u8(reader);
+  const uint32_t count = get_u32(reader);
+  const uint32_t min_cycles = get_u32(reader);
+  const uint32_t max_cycles = get_u32(reader);
+  fprintf(out, "%s,%u,%u,%u", stage < LOOP_TIMING_STAGE_COUNT ? stages[stage] : "?",
+      count, min_cycles, max_cycles);
+  uint8_t i;
+  for (i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+    fprintf(out, ",%u", get_u32(reader));
+  }
+  fprintf(out, "\n");
+}
+
+// Decodes in place, returns the decoded length or -1 if the frame is not
+// valid COBS
+static int cobs_decode(uint8_t *frame, uint32_t len) {
+  uint32_t in = 0;
+  uint32_t out = 0;
+  while (in < len) {
+    const uint8_t code = frame[in++];
+    if (code == 0 || in + code - 1 > len) {
+      return -1;
+    }
+    uint8_t i;
+    for (i = 1; i < code; i++) {
+      frame[out++] = frame[in++];
+    }
+    if (code != 0xff && in < len) {
+      frame[out++] = 0;
+    }
+  }
+  return out;
+}
+
+static FILE *output_for(Telemetry_Record_T type) {
+  if (outputs[type] == NULL) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s_%s.csv", prefix, record_defs[type].name);
+    outputs[type] = fopen(path, "w");
+    if (outputs[type] == NULL) {
+      perror(path);
+      exit(1);
+    }
+    fprintf(outputs[type], "timestamp_ms,sequence,%s\n", record_defs[type].columns);
+  }
+  return outputs[type];
+}
+
+static void handle_frame(uint8_t *frame, uint32_t len) {
+  if (len == 0) {
+    return;
+  }
+  stats.frames++;
+
+  const int decoded = len > MAX_FRAME_SIZE ? -1 : cobs_decode(frame, len);
+  if (decoded < TELEMETRY_HEADER_SIZE + TELEMETRY_CRC_SIZE) {
+    stats.bad_length++;
+    return;
+  }
+  const uint32_t body = decoded - TELEMETRY_CRC_SIZE;
+  const uint16_t crc = frame[body] | (uint16_t)frame[body + 1] << 8;
+  if (Telemetry_crc16(frame, body) != crc) {
+    stats.bad_crc++;
+    return;
+  }
+
+  Reader_T reader = { frame, 0 };
+  const uint8_t type = get_u8(&reader);
+  const uint8_t sequence = get_u8(&reader);
+  const uint32_t timestamp_ms = get_u32(&reader);
+  if (type >= TELEMETRY_RECORD_LENGTH) {
+    stats.bad_type++;
+    return;
+  }
+  if (body != (uint32_t)TELEMETRY_HEADER_SIZE + record_defs[type].payload_size) {
+    stats.bad_length++;
+    return;
+  }
+
+  if (have_sequence && sequence != (uint8_t)(last_sequence + 1)) {
+    stats.sequence_gaps++;
+    stats.missing_records += (uint8_t)(sequence - last_sequence - 1);
+  }
+  have_sequence = true;
+  last_sequence = sequence;
+  stats.records[type]++;
+
+  FILE *out = output_for(type);
+  fprintf(out, "%u,%u,", timestamp_ms, sequence);
+  record_defs[type].print(out, &reader);
+}
+
+static void print_summary(void) {
+  uint8_t type;
+  for (type = 0; type < TELEMETRY_RECORD_LENGTH; type++) {
+    fprintf(stderr, "%-12s %u records\n", record_defs[type].name, stats.records[type]);
+  }
+  fprintf(stderr, "frames:      %u, %u bad length, %u bad crc, %u bad type\n",
+      stats.frames, stats.bad_length, stats.bad_crc, stats.bad_type);
+  fprintf(stderr, "sequence:    %u gaps, %u records missing\n",
+      stats.sequence_gaps, stats.missing_records);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s capture output_prefix\n", argv0);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    usage(argv[0]);
+  }
+  FILE *capture = fopen(argv[1], "rb");
+  if (capture == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  prefix = argv[2];
+
+  static uint8_t frame[MAX_FRAME_SIZE];
+  uint32_t len = 0;
+  int c;
+  while ((c = getc(capture)) != EOF) {
+    if (c == 0) {
+      handle_frame(frame, len);
+      len = 0;
+    } else {
+      if (len < MAX_FRAME_SIZE) {
+        frame[len] = c;
+      }
+      len++;
+    }
+  }
+  // A trailing partial frame was cut off by the end of the capture
+  fclose(capture);
+
+  uint8_t type;
+  for (type = 0; type < TELEMETRY_RECORD_LENGTH; type++) {
+    if (outputs[type] != NULL) {
+      fclose(outputs[type]);
+    }
+  }
+  print_summary();
+  return 0;
+}
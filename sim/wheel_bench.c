@@ -0,0 +1,392 @@
+/**
+ * Host benchmark for the wheel speed estimators in src/WheelSpeed.c.
+ *
+ * Feeds tooth periods through the real WheelSpeed_isr_tick and samples
+ * every WHEEL_SPEED_READ_PERIOD_MS the way fill_input() does, comparing
+ * the weighted revolution sum, the adaptive time window, and the adaptive
+ * window with spacing correction.
+ *
+ * With no arguments, runs built-in traces generated from known speed
+ * profiles on a wheel whose teeth are unevenly spaced, and reports error
+ * against the true speed. Given trace files instead (one tooth period in us
+ * per line, '#' starts a comment), prints every estimate as CSV on stdout.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Transform.h"
+#include "Types.h"
+#include "WheelSpeed.h"
+
+#define READ_PERIOD_MS 10
+#define TIMEOUT_MS 100
+#define DEFAULT_SPACING_PERCENT 2.0
+#define MAX_TICKS 200000
+#define SETTLE_PERCENT 2.0
+#define BENCH_TICKS 10000000UL
+
+typedef enum {
+  EST_WEIGHTED,
+  EST_ADAPTIVE,
+  EST_ADAPTIVE_CORRECTED,
+  EST_LENGTH
+} Estimator_T;
+
+static const char *estimator_names[EST_LENGTH] = {
+  "weighted",
+  "adaptive",
+  "adaptive+spacing",
+};
+
+// Wheel speed in rev/s at t seconds
+typedef double (*Profile_Fn_T)(double t);
+
+typedef struct {
+  const char *name;
+  Profile_Fn_T speed;
+  double duration_s;
+  // Time of a speed step to measure settling after, or 0 for none
+  double step_s;
+} Trace_Def_T;
+
+typedef struct {
+  uint32_t length;
+  uint32_t period_us[MAX_TICKS];
+} Trace_T;
+
+typedef struct {
+  uint32_t samples;
+  double abs_sum;
+  double sq_sum;
+  double max;
+} Error_Stats_T;
+
+static double rpm_to_rps(double rpm) {
+  return rpm / 60.0;
+}
+
+static double steady_300(double t) {
+  (void)t;
+  return rpm_to_rps(300);
+}
+
+static double steady_60(double t) {
+  (void)t;
+  return rpm_to_rps(60);
+}
+
+static double step_100_600(double t) {
+  return rpm_to_rps(t < 1.0 ? 100 : 600);
+}
+
+static double step_600_150(double t) {
+  return rpm_to_rps(t < 1.0 ? 600 : 150);
+}
+
+// Launch to 1000 RPM in 3 s, then brake to a stop in 1.5 s
+static double launch_brake(double t) {
+  if (t < 0.2) {
+    return rpm_to_rps(20);
+  } else if (t < 3.2) {
+    return rpm_to_rps(20 + 980 * (t - 0.2) / 3.0);
+  } else if (t < 4.7) {
+    return rpm_to_rps(1000 * (4.7 - t) / 1.5);
+  }
+  return 0;
+}
+
+static const Trace_Def_T traces[] = {
+  { "steady_300", steady_300, 3.0, 0 },
+  { "steady_60", steady_60, 6.0, 0 },
+  { "step_100_600", step_100_600, 2.0, 1.0 },
+  { "step_600_150", step_600_150, 2.0, 1.0 },
+  { "launch_brake", launch_brake, 5.0, 0 },
+};
+
+#define NUM_TRACES (sizeof(traces) / sizeof(traces[0]))
+
+static Trace_T trace;
+static double spacing_error[NUM_TEETH];
+
+/*****************************************************************************
+ * Trace generation
+ ****************************************************************************/
+
+// Fixed pseudo-random tooth edges, each within +-percent of a tooth pitch
+static void make_spacing(double percent) {
+  uint32_t seed = 12345;
+  double mean = 0;
+  uint8_t i;
+  for (i = 0; i < NUM_TEETH; i++) {
+    seed = seed * 1103515245 + 12345;
+    spacing_error[i] = (((seed >> 8) & 0xFFFF) / 32767.5 - 1.0) * percent / 100.0;
+    mean += spacing_error[i];
+  }
+  mean /= NUM_TEETH;
+  for (i = 0; i < NUM_TEETH; i++) {
+    spacing_error[i] -= mean;
+  }
+}
+
+// Integrates the profile in 1 us steps and records the whole microseconds
+// between tooth edges, as the capture timer would
+static void generate(const Trace_Def_T *def) {
+  const double dt = 1e-6;
+  double angle = 0;
+  double last_edge_us = 0;
+  uint32_t tooth = 1;
+  double next_edge = (1 + spacing_error[1]) / NUM_TEETH;
+  double t;
+
+  trace.length = 0;
+  for (t = 0; t < def->duration_s && trace.length < MAX_TICKS; t += dt) {
+    const double v = def->speed(t);
+    const double next_angle = angle + v * dt;
+    if (next_angle >= next_edge) {
+      const double edge_us = (t + dt * (next_edge - angle) / (next_angle - angle)) * 1e6;
+      trace.period_us[trace.length++] = (uint32_t)(edge_us - last_edge_us);
+      last_edge_us = edge_us;
+      tooth++;
+      next_edge = (tooth + spacing_error[tooth % NUM_TEETH]) / NUM_TEETH;
+    }
+    angle = next_angle;
+  }
+}
+
+static bool load_trace(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[128];
+  trace.length = 0;
+  while (fgets(line, sizeof(line), f) != NULL && trace.length < MAX_TICKS) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char *end;
+    const unsigned long us = strtoul(line, &end, 0);
+    if (end != line) {
+      trace.period_us[trace.length++] = us;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/*****************************************************************************
+ * Replay
+ ****************************************************************************/
+
+// Same as fill_input(): the last tick's msTicks, a timeout, and the
+// since-last bound at tick resolution
+static uint32_t estimate_mRPM(Estimator_T est, uint32_t ms) {
+  WheelSpeed_Snapshot_T snapshot;
+  WheelSpeed_read(LEFT, &snapshot);
+
+  const bool timeout = snapshot.last_updated + TIMEOUT_MS < ms;
+  WheelSpeed_set_disregard(LEFT, timeout);
+  if (timeout || snapshot.count == 0) {
+    return 0;
+  }
+
+  uint32_t period_us;
+  if (est == EST_WEIGHTED) {
+    period_us = WheelSpeed_weighted_us(&snapshot);
+  } else {
+    const uint32_t since_last_ms = ms - snapshot.last_updated;
+    const uint32_t since_last_us =
+      since_last_ms > 0 ? (since_last_ms - 1) * 1000 : 0;
+    period_us = WheelSpeed_adaptive_us(&snapshot, since_last_us);
+  }
+  return Transform_click_time_to_mRPM(period_us);
+}
+
+// Replays the trace through the ISR, calling sample at every read instant
+typedef void (*Sample_Fn_T)(uint32_t ms, uint32_t mRPM, void *ctx);
+
+static void replay(Estimator_T est, Sample_Fn_T sample, void *ctx) {
+  WheelSpeed_init();
+  WheelSpeed_set_adaptive(est != EST_WEIGHTED);
+  WheelSpeed_set_spacing_correction(est == EST_ADAPTIVE_CORRECTED);
+
+  uint64_t now_us = 0;
+  uint32_t next_read_ms = READ_PERIOD_MS;
+  uint32_t i;
+  for (i = 0; i < trace.length; i++) {
+    const uint64_t tick_us = now_us + trace.period_us[i];
+    while ((uint64_t)next_read_ms * 1000 <= tick_us) {
+      sample(next_read_ms, estimate_mRPM(est, next_read_ms), ctx);
+      next_read_ms += READ_PERIOD_MS;
+    }
+    now_us = tick_us;
+    WheelSpeed_isr_tick(LEFT, trace.period_us[i], (uint32_t)(now_us / 1000));
+  }
+}
+
+typedef struct {
+  const Trace_Def_T *def;
+  Error_Stats_T stats;
+  // Last time the error was outside SETTLE_PERCENT after the step
+  double last_unsettled_s;
+} Error_Ctx_T;
+
+static void sample_against_truth(uint32_t ms, uint32_t mRPM, void *ctx) {
+  Error_Ctx_T *c = (Error_Ctx_T*)ctx;
+  const double t = ms / 1000.0;
+  const double truth_rpm = c->def->speed(t) * 60.0;
+  const double err = mRPM / 1000.0 - truth_rpm;
+  const double abs_err = fabs(err);
+
+  // The first revolution has no estimate to speak of for any method
+  if (t < 0.1) {
+    return;
+  }
+  c->stats.samples++;
+  c->stats.abs_sum += abs_err;
+  c->stats.sq_sum += err * err;
+  if (abs_err > c->stats.max) {
+    c->stats.max = abs_err;
+  }
+  if (c->def->step_s > 0 && t >= c->def->step_s &&
+      abs_err > truth_rpm * SETTLE_PERCENT / 100.0) {
+    c->last_unsettled_s = t;
+  }
+}
+
+static void sample_csv(uint32_t ms, uint32_t mRPM, void *ctx) {
+  uint32_t *column = (uint32_t*)ctx;
+  column[ms / READ_PERIOD_MS] = mRPM;
+}
+
+/*****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report_isr_cost(void) {
+  uint8_t corrected;
+  for (corrected = 0; corrected <= 1; corrected++) {
+    WheelSpeed_init();
+    WheelSpeed_set_adaptive(true);
+    WheelSpeed_set_spacing_correction(corrected);
+    const uint64_t start = host_ns();
+    uint32_t i;
+    for (i = 0; i < BENCH_TICKS; i++) {
+      // Steady enough to learn, with enough variation to move the window
+      WheelSpeed_isr_tick(LEFT, 2000 + (i & 0xF), i / 500);
+    }
+    const uint64_t ns = host_ns() - start;
+    printf("isr tick, spacing correction %s: %.2f ns/call\n",
+        corrected ? "on " : "off", (double)ns / BENCH_TICKS);
+  }
+}
+
+static void run_builtin(double spacing_percent) {
+  make_spacing(spacing_percent);
+  printf("tooth spacing error +-%.1f%%, reads every %u ms, settle within %.0f%%\n\n",
+      spacing_percent, READ_PERIOD_MS, SETTLE_PERCENT);
+  printf("%-14s %-18s %10s %10s %10s %10s\n",
+      "trace", "estimator", "mean RPM", "rms RPM", "max RPM", "settle ms");
+
+  uint32_t t;
+  for (t = 0; t < NUM_TRACES; t++) {
+    const Trace_Def_T *def = &traces[t];
+    generate(def);
+    uint8_t est;
+    for (est = 0; est < EST_LENGTH; est++) {
+      Error_Ctx_T ctx;
+      memset(&ctx, 0, sizeof(ctx));
+      ctx.def = def;
+      ctx.last_unsettled_s = def->step_s;
+      replay((Estimator_T)est, sample_against_truth, &ctx);
+
+      const Error_Stats_T *s = &ctx.stats;
+      const double n = s->samples > 0 ? s->samples : 1;
+      printf("%-14s %-18s %10.2f %10.2f %10.2f", def->name,
+          estimator_names[est], s->abs_sum / n, sqrt(s->sq_sum / n), s->max);
+      if (def->step_s > 0) {
+        printf(" %10.0f", (ctx.last_unsettled_s - def->step_s) * 1000.0 + READ_PERIOD_MS);
+      }
+      printf("\n");
+    }
+  }
+  printf("\n");
+  report_isr_cost();
+}
+
+static void run_file(const char *path) {
+  if (!load_trace(path)) {
+    exit(1);
+  }
+  uint64_t total_us = 0;
+  uint32_t i;
+  for (i = 0; i < trace.length; i++) {
+    total_us += trace.period_us[i];
+  }
+  const uint32_t reads = total_us / 1000 / READ_PERIOD_MS + 1;
+  uint32_t *columns[EST_LENGTH];
+  uint8_t est;
+  for (est = 0; est < EST_LENGTH; est++) {
+    columns[est] = calloc(reads + 1, sizeof(uint32_t));
+    replay((Estimator_T)est, sample_csv, columns[est]);
+  }
+
+  printf("# %s\nt_ms", path);
+  for (est = 0; est < EST_LENGTH; est++) {
+    printf(",%s_mRPM", estimator_names[est]);
+  }
+  printf("\n");
+  for (i = 1; i < reads; i++) {
+    printf("%u", i * READ_PERIOD_MS);
+    for (est = 0; est < EST_LENGTH; est++) {
+      printf(",%u", columns[est][i]);
+    }
+    printf("\n");
+  }
+  for (est = 0; est < EST_LENGTH; est++) {
+    free(columns[est]);
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-p spacing_percent] [trace_file...]\n", argv0);
+  fprintf(stderr, "  -p  tooth spacing error of the built-in traces (default %.1f)\n",
+      DEFAULT_SPACING_PERCENT);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  double spacing_percent = DEFAULT_SPACING_PERCENT;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:")) != -1) {
+    switch (opt) {
+      case 'p':
+        spacing_percent = strtod(optarg, NULL);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind == argc) {
+    run_builtin(spacing_percent);
+    return 0;
+  }
+  for (; optind < argc; optind++) {
+    run_file(argv[optind]);
+  }
+  return 0;
+}
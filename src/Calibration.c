@@ -0,0 +1,220 @@
+#include "Calibration.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "chip.h"
+
+#include "CanTx.h"
+#include "Clock.h"
+#include "Output.h"
+#include "Rules.h"
+#include "State.h"
+#include "Telemetry.h"
+#include "Transform.h"
+#include "Types.h"
+
+#define CALIBRATION_MAGIC 0x424C4143UL // "CALB"
+
+#define TEN_BIT_MAX 1023
+#define MESSAGE_PERIOD_MAX_MS 60000
+
+// As stored at the start of the calibration sector. The CRC covers every
+// byte before it.
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  Calibration_Values_T values;
+  uint16_t crc;
+} Calibration_Block_T;
+
+typedef char calibration_block_size_check[
+    sizeof(Calibration_Block_T) <= CALIBRATION_PAGE_SIZE ? 1 : -1];
+typedef char calibration_message_slots_check[
+    MESSAGE_LENGTH <= CALIBRATION_MESSAGE_SLOTS ? 1 : -1];
+
+// Start of the CALIBRATION region, from gcc.ld
+extern const uint8_t __calibration_start[];
+
+static const Calibration_Values_T defaults = {
+  .accel_1_lower_bound = CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND,
+  .accel_1_upper_bound = CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+  .accel_2_lower_bound = CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND,
+  .accel_2_upper_bound = CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND,
+  .conflict_brake_raw = CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW,
+  .brake_engaged_hv_raw = CALIBRATION_DEFAULT_BRAKE_ENGAGED_HV_RAW,
+  .brake_engaged_lv_raw = CALIBRATION_DEFAULT_BRAKE_ENGAGED_LV_RAW,
+  .message_period_ms = {
+    [MESSAGE_CAN_DRIVER_OUTPUT] = CALIBRATION_DEFAULT_DRIVER_OUTPUT_MSG_MS,
+    [MESSAGE_CAN_RAW_VALUES] = CALIBRATION_DEFAULT_RAW_VALUES_MSG_MS,
+    [MESSAGE_CAN_WHEEL_SPEED] = CALIBRATION_DEFAULT_WHEEL_SPEED_MSG_MS,
+    [MESSAGE_CAN_ENERGY] = CALIBRATION_DEFAULT_ENERGY_MSG_MS,
+    [MESSAGE_LOGGING_THROTTLE] = CALIBRATION_DEFAULT_LOGGING_THROTTLE_MS,
+    [MESSAGE_LOGGING_BRAKE] = CALIBRATION_DEFAULT_LOGGING_BRAKE_MS,
+    [MESSAGE_LOGGING_MC_DATA] = CALIBRATION_DEFAULT_LOGGING_MC_DATA_MS,
+    [MESSAGE_LOGGING_CS_VOLTAGE] = CALIBRATION_DEFAULT_LOGGING_CS_MS,
+    [MESSAGE_LOGGING_CS_CURRENT] = CALIBRATION_DEFAULT_LOGGING_CS_MS,
+    [MESSAGE_LOGGING_CS_POWER] = CALIBRATION_DEFAULT_LOGGING_CS_MS,
+    [MESSAGE_LOGGING_CS_ENERGY] = CALIBRATION_DEFAULT_LOGGING_CS_MS,
+    [MESSAGE_LOGGING_MC_STATE] = CALIBRATION_DEFAULT_LOGGING_MC_STATE_MS,
+    [MESSAGE_LOGGING_LATENCY] = CALIBRATION_DEFAULT_LOGGING_LATENCY_MS,
+#if LOOP_TIMING
+    [MESSAGE_LOGGING_LOOP_TIMING] = CALIBRATION_DEFAULT_LOGGING_LOOP_TIMING_MS,
+#endif
+  },
+};
+
+static Calibration_Values_T active;
+static Calibration_Values_T staged;
+
+// IAP programs whole pages from word-aligned RAM
+static uint32_t page[CALIBRATION_PAGE_SIZE / sizeof(uint32_t)];
+
+void apply_values(const Calibration_Values_T *values);
+bool values_valid(const Calibration_Values_T *values);
+bool write_block(const Calibration_Values_T *values);
+uint16_t block_crc(const Calibration_Block_T *block);
+void send_reply(uint8_t command, uint8_t field, Calibration_Status_T status);
+
+bool Calibration_load(void) {
+  const Calibration_Block_T *block = (const Calibration_Block_T *)__calibration_start;
+  const bool intact =
+    block->magic == CALIBRATION_MAGIC &&
+    block->version == CALIBRATION_VERSION &&
+    block->length == sizeof(Calibration_Values_T) &&
+    block->crc == block_crc(block) &&
+    values_valid(&block->values);
+
+  apply_values(intact ? &block->values : &defaults);
+  staged = active;
+  return intact;
+}
+
+const Calibration_Values_T *Calibration_get(void) {
+  return &active;
+}
+
+Calibration_Status_T Calibration_handle_frame(const Frame *frame, bool hv_enabled) {
+  const uint8_t command = frame->len > 0 ? frame->data[0] : 0xFF;
+  const uint8_t field = frame->len > 1 ? frame->data[1] : 0;
+  uint16_t *fields = (uint16_t *)&staged;
+
+  Calibration_Status_T status = CALIBRATION_OK;
+  switch (command) {
+    case CALIBRATION_CMD_READ:
+      if (frame->len < 2 || field >= CALIBRATION_FIELDS) {
+        status = CALIBRATION_BAD_FIELD;
+      }
+      break;
+
+    case CALIBRATION_CMD_WRITE:
+      if (frame->len < 4 || field >= CALIBRATION_FIELDS) {
+        status = CALIBRATION_BAD_FIELD;
+      } else {
+        fields[field] = frame->data[2] | (uint16_t)frame->data[3] << 8;
+      }
+      break;
+
+    case CALIBRATION_CMD_COMMIT:
+      if (!values_valid(&staged)) {
+        status = CALIBRATION_INVALID;
+      } else if (hv_enabled) {
+        status = CALIBRATION_HV_ON;
+      } else if (!write_block(&staged)) {
+        status = CALIBRATION_FLASH_ERROR;
+      } else {
+        apply_values(&staged);
+      }
+      break;
+
+    case CALIBRATION_CMD_DISCARD:
+      staged = active;
+      break;
+
+    default:
+      status = CALIBRATION_BAD_COMMAND;
+      break;
+  }
+
+  send_reply(command, field, status);
+  return status;
+}
+
+void apply_values(const Calibration_Values_T *values) {
+  active = *values;
+  // Derived reciprocals are worked out here, once, rather than per sample
+  Transform_set_accel_bounds(values->accel_1_lower_bound, values->accel_1_upper_bound,
+      values->accel_2_lower_bound, values->accel_2_upper_bound);
+  Rules_set_conflict_brake_raw(values->conflict_brake_raw);
+  Output_set_brake_engaged_raw(values->brake_engaged_hv_raw, values->brake_engaged_lv_raw);
+  State_set_message_periods(values->message_period_ms);
+}
+
+bool values_valid(const Calibration_Values_T *values) {
+  if (values->accel_1_lower_bound >= values->accel_1_upper_bound ||
+      values->accel_1_upper_bound > TEN_BIT_MAX ||
+      values->accel_2_lower_bound >= values->accel_2_upper_bound ||
+      values->accel_2_upper_bound > TEN_BIT_MAX) {
+    return false;
+  }
+  if (values->conflict_brake_raw > TEN_BIT_MAX ||
+      values->brake_engaged_hv_raw > TEN_BIT_MAX ||
+      values->brake_engaged_lv_raw > TEN_BIT_MAX) {
+    return false;
+  }
+  uint8_t i;
+  for (i = 0; i < MESSAGE_LENGTH; i++) {
+    const uint16_t period = values->message_period_ms[i];
+    if (period == 0 || period > MESSAGE_PERIOD_MAX_MS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool write_block(const Calibration_Values_T *values) {
+  Calibration_Block_T block;
+  memset(&block, 0, sizeof(block));
+  block.magic = CALIBRATION_MAGIC;
+  block.version = CALIBRATION_VERSION;
+  block.length = sizeof(Calibration_Values_T);
+  block.values = *values;
+  block.crc = block_crc(&block);
+
+  memset(page, 0xFF, sizeof(page));
+  memcpy(page, &block, sizeof(block));
+
+  // Flash cannot be read while it is being erased or written, and the
+  // vector table lives there, so no interrupt may be taken until it is done
+  const uint32_t address = (uint32_t)(uintptr_t)__calibration_start;
+  __disable_irq();
+  const bool written =
+    Chip_IAP_PreSectorForReadWrite(CALIBRATION_SECTOR, CALIBRATION_SECTOR) == IAP_CMD_SUCCESS &&
+    Chip_IAP_EraseSector(CALIBRATION_SECTOR, CALIBRATION_SECTOR) == IAP_CMD_SUCCESS &&
+    Chip_IAP_PreSectorForReadWrite(CALIBRATION_SECTOR, CALIBRATION_SECTOR) == IAP_CMD_SUCCESS &&
+    Chip_IAP_CopyRamToFlash(address, page, sizeof(page)) == IAP_CMD_SUCCESS;
+  __enable_irq();
+
+  return written && memcmp(__calibration_start, &block, sizeof(block)) == 0;
+}
+
+uint16_t block_crc(const Calibration_Block_T *block) {
+  return Telemetry_crc16((const uint8_t *)block, offsetof(Calibration_Block_T, crc));
+}
+
+void send_reply(uint8_t command, uint8_t field, Calibration_Status_T status) {
+  const uint16_t value = field < CALIBRATION_FIELDS ? ((uint16_t *)&staged)[field] : 0;
+  Frame reply;
+  reply.id = CALIBRATION_REPLY_ID;
+  reply.len = 5;
+  reply.data[0] = command;
+  reply.data[1] = field;
+  reply.data[2] = status;
+  reply.data[3] = value & 0xFF;
+  reply.data[4] = value >> 8;
+  // Out now if the controller has room, rather than after the rest of the
+  // pass, so that a second request in the same pass does not replace it
+  CanTx_queue_calibration_reply(&reply, Clock_us());
+  CanTx_flush();
+}
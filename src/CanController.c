@@ -0,0 +1,18 @@
+#include "CanController.h"
+
+// C_CAN block of the LPC11Cxx
+#define CAN_CONTROLLER_BASE 0x40050000UL
+#define CAN_CONTROLLER_CNTL (*(volatile uint32_t *)(CAN_CONTROLLER_BASE + 0x000))
+#define CAN_CONTROLLER_STAT (*(volatile uint32_t *)(CAN_CONTROLLER_BASE + 0x004))
+
+uint32_t CanController_status(void) {
+  return CAN_CONTROLLER_STAT;
+}
+
+void CanController_enter_init(void) {
+  CAN_CONTROLLER_CNTL |= CAN_CONTROLLER_CNTL_INIT;
+}
+
+void CanController_leave_init(void) {
+  CAN_CONTROLLER_CNTL &= ~CAN_CONTROLLER_CNTL_INIT;
+}
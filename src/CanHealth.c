@@ -0,0 +1,139 @@
+#include "CanHealth.h"
+
+#include "CanController.h"
+#include "CanRx.h"
+#include "Common.h"
+
+// Only written by the SysTick interrupt
+static volatile CanHealth_State_T state;
+static CanHealth_Stats_T stats;
+
+// When the controller went bus-off, for time to recover
+static uint32_t bus_off_ms;
+// When the current state's wait ends: backoff in BUS_OFF, timeout in
+// RECOVERING
+static uint32_t wait_until_ms;
+static uint32_t recovered_ms;
+static bool recovered_once;
+
+void enter_bus_off(uint32_t msTicks);
+void double_backoff(void);
+void finish_recovery(uint32_t msTicks);
+bool reached(uint32_t msTicks, uint32_t deadline_ms);
+
+void CanHealth_init(void) {
+  state = CAN_HEALTH_ERROR_ACTIVE;
+  stats.error_passive_entries = 0;
+  stats.bus_offs = 0;
+  stats.recoveries = 0;
+  stats.recovery_timeouts = 0;
+  stats.recover_min_ms = UINT32_MAX;
+  stats.recover_max_ms = 0;
+  stats.recover_total_ms = 0;
+  stats.backoff_ms = CAN_HEALTH_BACKOFF_MIN_MS;
+  recovered_once = false;
+}
+
+void CanHealth_isr_update(uint32_t msTicks) {
+  const uint32_t status = CanController_status();
+  const bool bus_off = status & CAN_CONTROLLER_STAT_BOFF;
+
+  switch (state) {
+    case CAN_HEALTH_ERROR_ACTIVE:
+    case CAN_HEALTH_ERROR_PASSIVE:
+      if (bus_off) {
+        enter_bus_off(msTicks);
+      } else if (status & CAN_CONTROLLER_STAT_EPASS) {
+        if (state == CAN_HEALTH_ERROR_ACTIVE) {
+          stats.error_passive_entries++;
+        }
+        state = CAN_HEALTH_ERROR_PASSIVE;
+      } else {
+        state = CAN_HEALTH_ERROR_ACTIVE;
+      }
+      break;
+
+    case CAN_HEALTH_BUS_OFF:
+      if (reached(msTicks, wait_until_ms)) {
+        // Anything that re-ran the library's setup meanwhile reopened the
+        // catch-all object, and INIT is the time to close it again
+        CanRx_init();
+        // Clearing INIT starts the controller's own recovery sequence
+        CanController_leave_init();
+        wait_until_ms = msTicks + CAN_HEALTH_RECOVERY_TIMEOUT_MS;
+        state = CAN_HEALTH_RECOVERING;
+      }
+      break;
+
+    case CAN_HEALTH_RECOVERING:
+      if (!bus_off) {
+        finish_recovery(msTicks);
+      } else if (reached(msTicks, wait_until_ms)) {
+        stats.recovery_timeouts++;
+        CanController_enter_init();
+        double_backoff();
+        wait_until_ms = msTicks + stats.backoff_ms;
+        state = CAN_HEALTH_BUS_OFF;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+CanHealth_State_T CanHealth_state(void) {
+  return state;
+}
+
+bool CanHealth_can_transmit(void) {
+  const CanHealth_State_T curr_state = state;
+  return curr_state == CAN_HEALTH_ERROR_ACTIVE || curr_state == CAN_HEALTH_ERROR_PASSIVE;
+}
+
+const CanHealth_Stats_T *CanHealth_get_stats(void) {
+  return &stats;
+}
+
+uint32_t CanHealth_mean_recover_ms(void) {
+  if (stats.recoveries == 0) {
+    return 0;
+  }
+  return stats.recover_total_ms / stats.recoveries;
+}
+
+void enter_bus_off(uint32_t msTicks) {
+  stats.bus_offs++;
+  // A bus that keeps knocking us off gets longer to settle each time
+  if (recovered_once && !reached(msTicks, recovered_ms + CAN_HEALTH_STABLE_MS)) {
+    double_backoff();
+  } else {
+    stats.backoff_ms = CAN_HEALTH_BACKOFF_MIN_MS;
+  }
+  bus_off_ms = msTicks;
+  wait_until_ms = msTicks + stats.backoff_ms;
+  state = CAN_HEALTH_BUS_OFF;
+}
+
+void double_backoff(void) {
+  stats.backoff_ms = min(stats.backoff_ms * 2, CAN_HEALTH_BACKOFF_MAX_MS);
+}
+
+void finish_recovery(uint32_t msTicks) {
+  const uint32_t took_ms = msTicks - bus_off_ms;
+  stats.recoveries++;
+  stats.recover_total_ms += took_ms;
+  if (took_ms < stats.recover_min_ms) {
+    stats.recover_min_ms = took_ms;
+  }
+  if (took_ms > stats.recover_max_ms) {
+    stats.recover_max_ms = took_ms;
+  }
+  recovered_ms = msTicks;
+  recovered_once = true;
+  state = CAN_HEALTH_ERROR_ACTIVE;
+}
+
+bool reached(uint32_t msTicks, uint32_t deadline_ms) {
+  return (int32_t)(msTicks - deadline_ms) >= 0;
+}
@@ -0,0 +1,124 @@
+#include "CanRx.h"
+
+#include "chip.h"
+
+#include "Calibration.h"
+
+// Single-producer/single-consumer ring. head is only written by the
+// interrupt, tail only by the main loop, and both run freely so that
+// head - tail is the occupancy. 32-bit loads and stores are atomic on the M0,
+// so no interrupt masking is needed on either side.
+static CanRx_Msg_T ring[CAN_RX_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+
+// Frames that arrive while the ring is full still have to be read out of the
+// driver to free it up, so they land here and are dropped
+static CanRx_Msg_T overflow_msg;
+
+static CanRx_Stats_T stats;
+
+#define SUBSCRIBED_ID(id, type, member, payload, read, process, last_updated) id,
+
+// Every ID in CAN_RX_SUBSCRIPTIONS. Anything else on the bus is left to the
+// controller's acceptance filtering.
+static const uint16_t subscribed_ids[] = {
+  CAN_RX_SUBSCRIPTIONS(SUBSCRIBED_ID)
+};
+
+#undef SUBSCRIBED_ID
+
+#define SUBSCRIPTION_COUNT (sizeof(subscribed_ids) / sizeof(subscribed_ids[0]))
+#define LAST_MSGOBJ (CAN_RX_FIRST_MSGOBJ + SUBSCRIPTION_COUNT - 1)
+
+typedef char subscription_msgobjs_fit_check[
+    LAST_MSGOBJ < CAN_RX_MSGOBJ_COUNT ? 1 : -1];
+typedef char subscription_msgobjs_clear_of_tx_check[
+    CAN_LIBRARY_TX_MSGOBJ < CAN_RX_FIRST_MSGOBJ ||
+    CAN_LIBRARY_TX_MSGOBJ > LAST_MSGOBJ ? 1 : -1];
+
+void read_driver_frame(Can_MsgID_T type, CanRx_Msg_T *msg);
+
+void CanRx_init(void) {
+  CCAN_MSG_OBJ_T obj;
+  uint8_t i;
+  for (i = 0; i < SUBSCRIPTION_COUNT; i++) {
+    obj.msgobj = CAN_RX_FIRST_MSGOBJ + i;
+    obj.mode_id = CAN_MSGOBJ_STD | subscribed_ids[i];
+    obj.mask = CAN_RX_ID_MASK;
+    LPC_CCAN_API->config_rxmsgobj(&obj);
+  }
+}
+
+uint32_t CanRx_isr_receive(uint32_t msTicks) {
+  // Bounded so that a babbling bus cannot hold us in the interrupt
+  uint32_t reads;
+  for (reads = 0; reads < CAN_RX_RING_SIZE; reads++) {
+    const Can_MsgID_T type = Can_MsgType();
+    if (type == Can_No_Msg) {
+      return reads;
+    }
+
+    const uint32_t curr_head = head;
+    const uint32_t used = curr_head - tail;
+    const bool full = used >= CAN_RX_RING_SIZE;
+    CanRx_Msg_T *msg = full ? &overflow_msg : &ring[curr_head & CAN_RX_RING_MASK];
+
+    read_driver_frame(type, msg);
+    msg->received_ms = msTicks;
+
+    if (full) {
+      stats.overflows++;
+      continue;
+    }
+
+    // Slot contents must land before the consumer can see the new head
+    __DMB();
+    head = curr_head + 1;
+
+    stats.received++;
+    if (used + 1 > stats.high_water) {
+      stats.high_water = used + 1;
+    }
+  }
+  return reads;
+}
+
+bool CanRx_pop(CanRx_Msg_T *msg) {
+  const uint32_t curr_tail = tail;
+  if (curr_tail == head) {
+    return false;
+  }
+
+  *msg = ring[curr_tail & CAN_RX_RING_MASK];
+
+  // Finish copying the slot before handing it back to the producer
+  __DMB();
+  tail = curr_tail + 1;
+  return true;
+}
+
+const CanRx_Stats_T *CanRx_get_stats(void) {
+  return &stats;
+}
+
+#define READ_CASE(id, type, member, payload, read, process, last_updated) \
+    case type: \
+      read(&msg->data.member); \
+      break;
+
+void read_driver_frame(Can_MsgID_T type, CanRx_Msg_T *msg) {
+  msg->type = type;
+  switch(type) {
+    case Can_Error_Msg:
+      msg->data.error = Can_Error_Read();
+      break;
+
+    CAN_RX_SUBSCRIPTIONS(READ_CASE)
+
+    default:
+      break;
+  }
+}
+
+#undef READ_CASE
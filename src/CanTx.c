@@ -0,0 +1,196 @@
+#include "CanTx.h"
+
+#include "chip.h"
+
+#include "CanHealth.h"
+#include "Clock.h"
+
+typedef struct {
+  bool pending;
+  // The pending frame has already been counted as deferred
+  bool deferred;
+  // Writes of the pending frame have been failing, other than for a full
+  // buffer, since failing_since_us
+  bool failing;
+  uint32_t failing_since_us;
+  // A frame went out since the last CanTx_take_sent
+  bool sent;
+  uint32_t sampled_us;
+  uint32_t sent_age_us;
+  union {
+    Can_FrontCanNode_DriverOutput_T driver_output;
+    Can_FrontCanNode_RawValues_T raw_values;
+    Can_FrontCanNode_WheelSpeed_T wheel_speed;
+    Frame energy;
+    Frame calibration_reply;
+  } msg;
+} Slot_T;
+
+static Slot_T slots[CAN_TX_SLOTS];
+
+// Set while the main loop is anywhere in here. The main loop cannot preempt
+// SysTick, so when SysTick finds this clear it has the slots and the
+// driver's transmit side to itself until it returns.
+static volatile bool main_busy = false;
+
+static CanTx_Stats_T stats;
+
+void enter(void);
+void leave(void);
+Slot_T *begin_queue(CanTx_Slot_T slot, uint32_t sampled_us);
+void drain(void);
+Can_ErrorID_T write_slot(CanTx_Slot_T slot);
+
+void CanTx_init(void) {
+  uint8_t i;
+  for (i = 0; i < CAN_TX_SLOTS; i++) {
+    slots[i].pending = false;
+    slots[i].deferred = false;
+    slots[i].failing = false;
+    slots[i].sent = false;
+  }
+}
+
+void CanTx_queue_driver_output(const Can_FrontCanNode_DriverOutput_T *msg, uint32_t sampled_us) {
+  begin_queue(CAN_TX_DRIVER_OUTPUT, sampled_us)->msg.driver_output = *msg;
+  leave();
+}
+
+void CanTx_queue_raw_values(const Can_FrontCanNode_RawValues_T *msg, uint32_t sampled_us) {
+  begin_queue(CAN_TX_RAW_VALUES, sampled_us)->msg.raw_values = *msg;
+  leave();
+}
+
+void CanTx_queue_wheel_speed(const Can_FrontCanNode_WheelSpeed_T *msg, uint32_t sampled_us) {
+  begin_queue(CAN_TX_WHEEL_SPEED, sampled_us)->msg.wheel_speed = *msg;
+  leave();
+}
+
+void CanTx_queue_energy(const Frame *frame, uint32_t sampled_us) {
+  begin_queue(CAN_TX_ENERGY, sampled_us)->msg.energy = *frame;
+  leave();
+}
+
+void CanTx_queue_calibration_reply(const Frame *frame, uint32_t sampled_us) {
+  begin_queue(CAN_TX_CALIBRATION_REPLY, sampled_us)->msg.calibration_reply = *frame;
+  leave();
+}
+
+void CanTx_flush(void) {
+  enter();
+  drain();
+  leave();
+}
+
+void CanTx_isr_drain(void) {
+  if (main_busy) {
+    return;
+  }
+  drain();
+}
+
+bool CanTx_take_sent(CanTx_Slot_T slot, uint32_t *age_us) {
+  enter();
+  const bool sent = slots[slot].sent;
+  *age_us = slots[slot].sent_age_us;
+  slots[slot].sent = false;
+  leave();
+  return sent;
+}
+
+const CanTx_Stats_T *CanTx_get_stats(void) {
+  return &stats;
+}
+
+void enter(void) {
+  main_busy = true;
+  __DMB();
+}
+
+void leave(void) {
+  __DMB();
+  main_busy = false;
+}
+
+// Leaves the caller inside, to fill in the message and then leave()
+Slot_T *begin_queue(CanTx_Slot_T slot, uint32_t sampled_us) {
+  enter();
+  Slot_T *s = &slots[slot];
+  if (s->pending) {
+    stats.coalesced++;
+  }
+  s->pending = true;
+  s->deferred = false;
+  s->failing = false;
+  s->sampled_us = sampled_us;
+  stats.queued++;
+  return s;
+}
+
+// Writes pending slots in priority order, stopping at the first one the
+// controller refuses so that a lower priority frame never takes the room a
+// higher priority one is waiting for. Frames wait out errors in their
+// slots; getting the controller back on the bus is up to CanHealth. Any
+// other error that goes on for CAN_TX_ERROR_TIMEOUT_US drops the frame, and
+// the slots after it get their turn.
+void drain(void) {
+  if (!CanHealth_can_transmit()) {
+    return;
+  }
+
+  uint8_t i;
+  for (i = 0; i < CAN_TX_SLOTS; i++) {
+    Slot_T *s = &slots[i];
+    if (!s->pending) {
+      continue;
+    }
+
+    const Can_ErrorID_T error = write_slot(i);
+    if (error == Can_Error_NONE || error == Can_Error_NO_RX) {
+      s->pending = false;
+      s->sent = true;
+      s->sent_age_us = Clock_us() - s->sampled_us;
+      stats.sent++;
+      continue;
+    }
+
+    if (error != Can_Error_TX_BUFFER_FULL) {
+      stats.errors++;
+      const uint32_t now_us = Clock_us();
+      if (!s->failing) {
+        s->failing = true;
+        s->failing_since_us = now_us;
+      } else if (now_us - s->failing_since_us >= CAN_TX_ERROR_TIMEOUT_US) {
+        s->pending = false;
+        stats.dropped++;
+        continue;
+      }
+    } else if (!s->deferred) {
+      s->deferred = true;
+      stats.deferred++;
+    }
+    return;
+  }
+}
+
+Can_ErrorID_T write_slot(CanTx_Slot_T slot) {
+  switch (slot) {
+    case CAN_TX_DRIVER_OUTPUT:
+      return Can_FrontCanNode_DriverOutput_Write(&slots[slot].msg.driver_output);
+
+    case CAN_TX_RAW_VALUES:
+      return Can_FrontCanNode_RawValues_Write(&slots[slot].msg.raw_values);
+
+    case CAN_TX_WHEEL_SPEED:
+      return Can_FrontCanNode_WheelSpeed_Write(&slots[slot].msg.wheel_speed);
+
+    case CAN_TX_ENERGY:
+      return Can_RawWrite(&slots[slot].msg.energy);
+
+    case CAN_TX_CALIBRATION_REPLY:
+      return Can_RawWrite(&slots[slot].msg.calibration_reply);
+
+    default:
+      return Can_Error_NONE;
+  }
+}
@@ -0,0 +1,40 @@
+#include "Clock.h"
+
+#include "chip.h"
+
+volatile uint32_t msTicks;
+
+uint32_t Clock_cycles(void) {
+  uint32_t ms;
+  uint32_t val;
+  // If SysTick fires between the two reads msTicks moves, so try again
+  do {
+    ms = msTicks;
+    val = SysTick->VAL;
+  } while (ms != msTicks);
+
+  const uint32_t reload = SysTick->LOAD + 1;
+  return ms * reload + (reload - 1 - val);
+}
+
+uint32_t Clock_us(void) {
+  uint32_t ms;
+  uint32_t val;
+  do {
+    ms = msTicks;
+    val = SysTick->VAL;
+  } while (ms != msTicks);
+
+  // One division for the part of the current millisecond; msTicks * 1000
+  // wraps in step with the result, so differences stay right across it
+  const uint32_t reload = SysTick->LOAD + 1;
+  return ms * 1000 + (reload - 1 - val) * 1000 / reload;
+}
+
+uint32_t Clock_span(uint32_t start_val, uint32_t end_val) {
+  // SysTick counts down and reloads from LOAD after reaching zero
+  if (start_val >= end_val) {
+    return start_val - end_val;
+  }
+  return start_val + (SysTick->LOAD + 1) - end_val;
+}
@@ -0,0 +1,132 @@
+#include "Event.h"
+
+#include "chip.h"
+
+#include "Clock.h"
+
+// One byte per event rather than a shared bitmask, so that interrupts at
+// different priorities never race on a read-modify-write
+static volatile uint8_t pending[EVENT_COUNT];
+
+static volatile uint32_t deadline = 0;
+static volatile bool deadline_armed = false;
+
+static Event_Stats_T stats;
+static bool clock_started = false;
+static uint32_t last_clock = 0;
+
+uint8_t event_index(Event_T event);
+bool wake_pending(void);
+void update_total(void);
+
+void Event_post(Event_T event) {
+  pending[event_index(event)] = 1;
+}
+
+void Event_tick(uint32_t msTicks) {
+  // Wrap-safe msTicks >= deadline
+  if (deadline_armed && (int32_t)(msTicks - deadline) >= 0) {
+    deadline_armed = false;
+    Event_post(EVENT_DEADLINE);
+  }
+}
+
+void Event_set_deadline(uint32_t deadline_ms) {
+  // SysTick must not run between the check and arming, or a deadline of the
+  // very next tick would be seen a tick late
+  __disable_irq();
+  if ((int32_t)(msTicks - deadline_ms) >= 0) {
+    deadline_armed = false;
+    Event_post(EVENT_DEADLINE);
+  } else {
+    deadline = deadline_ms;
+    deadline_armed = true;
+  }
+  __enable_irq();
+}
+
+uint32_t Event_take(void) {
+  uint32_t events = 0;
+  uint8_t i;
+  __disable_irq();
+  for (i = 0; i < EVENT_COUNT; i++) {
+    if (pending[i]) {
+      events |= 1 << i;
+      pending[i] = 0;
+    }
+  }
+  __enable_irq();
+  return events;
+}
+
+uint32_t Event_wait(void) {
+  update_total();
+  const uint32_t sleep_start = Clock_cycles();
+
+  while (1) {
+    // Check and sleep with interrupts masked so that an event posted in
+    // between cannot be missed. A pending interrupt still ends the WFI, and
+    // is taken as soon as they are unmasked again.
+    __disable_irq();
+    if (wake_pending()) {
+      __enable_irq();
+      break;
+    }
+    __WFI();
+    __enable_irq();
+  }
+
+  stats.sleep_cycles += Clock_cycles() - sleep_start;
+  const uint32_t events = Event_take();
+
+  stats.wakeups++;
+  if (events & EVENT_DEADLINE) {
+    stats.deadline_wakeups++;
+  }
+  if (events & EVENT_CAN_RX) {
+    stats.can_rx_wakeups++;
+  }
+  return events;
+}
+
+void Event_record_task(Event_Task_T task, uint32_t cycles) {
+  stats.busy_cycles[task] += cycles;
+}
+
+const Event_Stats_T *Event_get_stats(void) {
+  update_total();
+  return &stats;
+}
+
+bool wake_pending(void) {
+  uint8_t i;
+  for (i = 0; i < EVENT_COUNT; i++) {
+    if (pending[i] && ((1 << i) & EVENT_WAKE_MASK)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Accumulated in 32-bit steps so the cycle counter wrapping is harmless, as
+// long as this runs at least every 89 s at 48 MHz
+void update_total(void) {
+  const uint32_t now = Clock_cycles();
+  if (clock_started) {
+    stats.total_cycles += now - last_clock;
+  }
+  clock_started = true;
+  last_clock = now;
+}
+
+uint8_t event_index(Event_T event) {
+  switch(event) {
+    case EVENT_DEADLINE:
+      return 0;
+    case EVENT_CAN_RX:
+      return 1;
+    case EVENT_WHEEL_TICK:
+    default:
+      return 2;
+  }
+}
@@ -1,31 +1,83 @@
 #include "Input.h"
 
+#include <stddef.h>
+
 #include <MY17_Can_Library.h>
 
 #include "Adc.h"
+#include "Calibration.h"
+#include "CanRx.h"
+#include "Clock.h"
+#include "Common.h"
+#include "Energy.h"
 #include "Serial.h"
+#include "Transform.h"
 
 void update_adc(Input_T *input);
+void update_derived(Input_T *input);
 void update_can(Input_T *input);
 
-void can_process_error(void);
-void can_process_unknown(Input_T *input);
-void can_process_voltage(Input_T *input);
-void can_process_current(Input_T *input);
-void can_process_power(Input_T *input);
-void can_process_energy(Input_T *input);
-void can_process_mc_data(Input_T *input);
-void can_process_mc_state(Input_T *input);
-void can_process_vcu_dash(Input_T *input);
+bool can_process_error(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_unknown(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_voltage(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_current(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_power(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_energy(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_mc_data(Input_T *input, CanRx_Msg_T *msg);
+bool can_process_vcu_dash(Input_T *input, CanRx_Msg_T *msg);
+
+uint32_t *misc_last_updated(Input_T *input);
+uint32_t *mc_last_updated(Input_T *input);
+uint32_t *cs_voltage_last_updated(Input_T *input);
+uint32_t *cs_current_last_updated(Input_T *input);
+uint32_t *cs_power_last_updated(Input_T *input);
+uint32_t *cs_energy_last_updated(Input_T *input);
 
 #define ADC_UPDATE_PERIOD_MS 10
 
+#define TEN_BIT_MAX 1023
+#define BYTE_MAX 255
+
+// A handler returns true if it updated the input, in which case the frame's
+// receive time is written to the field last_updated points at
+typedef bool (*Can_Process_Fn_T)(Input_T *input, CanRx_Msg_T *msg);
+typedef uint32_t *(*Can_Last_Updated_Fn_T)(Input_T *input);
+
+typedef struct {
+  Can_Process_Fn_T process;
+  Can_Last_Updated_Fn_T last_updated;
+} Can_Dispatch_T;
+
+#define DISPATCH_ROW(id, type, member, payload, read, process, last_updated) \
+  [type] = { process, last_updated },
+
+// Indexed by message ID, so dispatch costs the same however many messages we
+// subscribe to. The rows come from CAN_RX_SUBSCRIPTIONS in CanRx.h.
+static const Can_Dispatch_T can_dispatch[] = {
+  [Can_Error_Msg] = { can_process_error, NULL },
+  CAN_RX_SUBSCRIPTIONS(DISPATCH_ROW)
+};
+
+#undef DISPATCH_ROW
+
+#define CAN_DISPATCH_LENGTH (sizeof(can_dispatch) / sizeof(can_dispatch[0]))
+
 void Input_initialize(Input_T *input) {
   input->adc->accel_1_raw = 0;
   input->adc->accel_2_raw = 0;
   input->adc->brake_1_raw = 0;
   input->adc->brake_2_raw = 0;
   input->adc->last_updated = 0;
+  input->adc->sampled_us = 0;
+
+  input->derived->accel_1_travel = 0;
+  input->derived->accel_2_travel = 0;
+  input->derived->accel_travel = 0;
+  input->derived->accel_torque = 0;
+  input->derived->brake_pressure = 0;
+  input->derived->brake_1_raw = 0;
+  input->derived->adc_updated = 0;
+  input->derived->adc_sampled_us = 0;
 
   uint8_t wheel;
   for (wheel = 0; wheel < NUM_WHEELS; wheel++) {
@@ -44,14 +96,29 @@ void Input_initialize(Input_T *input) {
     input->current_sensor->last_updated[i] = 0;
   }
 
+  Energy_init(input->energy);
+
   input->misc->lv_voltage = 0;
   input->misc->hv_enabled = false;
   input->misc->limp_state = CAN_LIMP_NORMAL;
+  input->misc->last_updated = 0;
+
+  uint8_t source;
+  for (source = 0; source < INPUT_SOURCES; source++) {
+    input->generation[source] = 0;
+  }
 }
 
 void Input_fill_input(Input_T *input) {
   update_adc(input);
+  update_derived(input);
   update_can(input);
+  Energy_update(input->energy, input->current_sensor, input->msTicks);
+}
+
+uint32_t Input_next_deadline(Input_T *input) {
+  // update_adc runs on the first tick strictly after the period
+  return input->adc->last_updated + ADC_UPDATE_PERIOD_MS + 1;
 }
 
 void update_adc(Input_T *input) {
@@ -59,6 +126,7 @@ void update_adc(Input_T *input) {
   uint32_t next_updated = adc->last_updated + ADC_UPDATE_PERIOD_MS;
 
   if (next_updated < input->msTicks) {
+    adc->sampled_us = Clock_us();
     adc->accel_1_raw = ADC_Read(ACCEL_1_CHANNEL);
     adc->accel_2_raw = ADC_Read(ACCEL_2_CHANNEL);
     adc->brake_1_raw = ADC_Read(BRAKE_1_CHANNEL);
@@ -67,57 +135,142 @@ void update_adc(Input_T *input) {
   }
 }
 
+void update_derived(Input_T *input) {
+  Adc_Input_T *adc = input->adc;
+  Derived_Input_T *derived = input->derived;
+
+  if (derived->adc_updated == adc->last_updated) {
+    return;
+  }
+
+  const Derived_Input_T prev = *derived;
+
+  derived->accel_1_travel = Transform_accel_1_travel(adc->accel_1_raw);
+  derived->accel_2_travel = Transform_accel_2_travel(adc->accel_2_raw);
+  derived->accel_travel = min(derived->accel_1_travel, derived->accel_2_travel);
+
+  const uint16_t accel_1_torque = Transform_accel_1_torque(adc->accel_1_raw);
+  const uint16_t accel_2_torque = Transform_accel_2_torque(adc->accel_2_raw);
+  derived->accel_torque = min(accel_1_torque, accel_2_torque);
+
+  derived->brake_pressure = scale(adc->brake_1_raw, TEN_BIT_MAX, BYTE_MAX);
+
+  // A pedal held still gives the same sample over and over
+  if (derived->accel_1_travel != prev.accel_1_travel ||
+      derived->accel_2_travel != prev.accel_2_travel ||
+      derived->accel_torque != prev.accel_torque ||
+      derived->brake_pressure != prev.brake_pressure ||
+      adc->brake_1_raw != derived->brake_1_raw) {
+    input->generation[INPUT_ADC]++;
+  }
+  derived->brake_1_raw = adc->brake_1_raw;
+
+  derived->adc_updated = adc->last_updated;
+  derived->adc_sampled_us = adc->sampled_us;
+}
+
 void update_can(Input_T *input) {
-  Can_MsgID_T msgID = Can_MsgType();
-  switch(msgID) {
-    case Can_Error_Msg:
-      can_process_error();
-      break;
-
-    case Can_Unknown_Msg:
-      can_process_unknown(input);
-      break;
-
-    case Can_Vcu_DashHeartbeat_Msg:
-      can_process_vcu_dash(input);
-      break;
-
-    case Can_MC_DataReading_Msg:
-      can_process_mc_data(input);
-
-    case Can_No_Msg:
-    default:
-      break;
+  // Frames are pulled out of the driver by the SysTick interrupt, so take
+  // everything that has queued up since the last pass
+  CanRx_Msg_T msg;
+  while (CanRx_pop(&msg)) {
+    if ((uint32_t)msg.type >= CAN_DISPATCH_LENGTH) {
+      continue;
+    }
+    const Can_Dispatch_T *entry = &can_dispatch[msg.type];
+    if (entry->process == NULL) {
+      continue;
+    }
+    const bool updated = entry->process(input, &msg);
+    if (updated && entry->last_updated != NULL) {
+      *entry->last_updated(input) = msg.received_ms;
+    }
   }
 }
 
-void can_process_error(void) {
-  Can_ErrorID_T err = Can_Error_Read();
+bool can_process_error(Input_T *input, CanRx_Msg_T *msg) {
+  UNUSED(input);
+  Can_ErrorID_T err = msg->data.error;
   UNUSED(err);
   /* Serial_Print("can_read_err: "); */
   /* Serial_PrintlnNumber(err, 16); */
+  return false;
 }
 
-void can_process_unknown(Input_T *input) {
-  UNUSED(input);
-  Frame f;
-  Can_Unknown_Read(&f);
+bool can_process_unknown(Input_T *input, CanRx_Msg_T *msg) {
+  if (msg->data.unknown.id == CALIBRATION_REQUEST_ID) {
+    Calibration_handle_frame(&msg->data.unknown, input->misc->hv_enabled);
+  }
+  return false;
 }
 
-void can_process_vcu_dash(Input_T *input) {
-  Can_Vcu_DashHeartbeat_T msg;
-  Can_Vcu_DashHeartbeat_Read(&msg);
+bool can_process_vcu_dash(Input_T *input, CanRx_Msg_T *msg) {
+  Can_Vcu_DashHeartbeat_T *vcu_dash = &msg->data.vcu_dash;
+  Misc_Input_T *misc = input->misc;
 
-  input->misc->hv_enabled = msg.hv_light;
-  input->misc->lv_voltage = msg.lv_battery_voltage;
-  input->misc->limp_state = msg.limp_state;
+  if (misc->hv_enabled != vcu_dash->hv_light ||
+      misc->lv_voltage != vcu_dash->lv_battery_voltage ||
+      misc->limp_state != vcu_dash->limp_state) {
+    input->generation[INPUT_MISC]++;
+  }
+  misc->hv_enabled = vcu_dash->hv_light;
+  misc->lv_voltage = vcu_dash->lv_battery_voltage;
+  misc->limp_state = vcu_dash->limp_state;
+  return true;
 }
 
-void can_process_mc_data(Input_T *input) {
-  Can_MC_DataReading_T msg;
-  Can_MC_DataReading_Read(&msg);
-  if (msg.type == CAN_MC_REG_SPEED_ACTUAL_RPM) {
-    input->mc->motor_speed = msg.value;
-    input->mc->last_updated = input->msTicks;
+bool can_process_mc_data(Input_T *input, CanRx_Msg_T *msg) {
+  Can_MC_DataReading_T *mc_data = &msg->data.mc_data;
+  if (mc_data->type != CAN_MC_REG_SPEED_ACTUAL_RPM) {
+    return false;
+  }
+  if (input->mc->motor_speed != mc_data->value) {
+    input->generation[INPUT_MC]++;
   }
+  input->mc->motor_speed = mc_data->value;
+  return true;
+}
+
+bool can_process_voltage(Input_T *input, CanRx_Msg_T *msg) {
+  input->current_sensor->data[CS_Voltage] = msg->data.cs_voltage.voltage_mV;
+  return true;
+}
+
+bool can_process_current(Input_T *input, CanRx_Msg_T *msg) {
+  input->current_sensor->data[CS_Current] = msg->data.cs_current.current_mA;
+  return true;
+}
+
+bool can_process_power(Input_T *input, CanRx_Msg_T *msg) {
+  input->current_sensor->data[CS_Power] = msg->data.cs_power.power_W;
+  return true;
+}
+
+bool can_process_energy(Input_T *input, CanRx_Msg_T *msg) {
+  input->current_sensor->data[CS_Energy] = msg->data.cs_energy.energy_Wh;
+  return true;
+}
+
+uint32_t *misc_last_updated(Input_T *input) {
+  return &input->misc->last_updated;
+}
+
+uint32_t *mc_last_updated(Input_T *input) {
+  return &input->mc->last_updated;
+}
+
+uint32_t *cs_voltage_last_updated(Input_T *input) {
+  return &input->current_sensor->last_updated[CS_Voltage];
+}
+
+uint32_t *cs_current_last_updated(Input_T *input) {
+  return &input->current_sensor->last_updated[CS_Current];
+}
+
+uint32_t *cs_power_last_updated(Input_T *input) {
+  return &input->current_sensor->last_updated[CS_Power];
+}
+
+uint32_t *cs_energy_last_updated(Input_T *input) {
+  return &input->current_sensor->last_updated[CS_Energy];
 }
@@ -0,0 +1,46 @@
+#include "Latency.h"
+
+static Latency_Stats_T stats;
+
+void Latency_init(void) {
+  uint8_t i;
+  stats.count = 0;
+  stats.min_us = UINT32_MAX;
+  stats.max_us = 0;
+  stats.sum_us = 0;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    stats.histogram[i] = 0;
+  }
+}
+
+void Latency_record(uint32_t age_us) {
+  stats.count++;
+  stats.sum_us += age_us;
+  if (age_us < stats.min_us) {
+    stats.min_us = age_us;
+  }
+  if (age_us > stats.max_us) {
+    stats.max_us = age_us;
+  }
+
+  // Compare instead of dividing, the ages are short enough that this walks
+  // only a few buckets
+  uint8_t bucket = 0;
+  uint32_t bucket_end = LATENCY_BUCKET_US;
+  while (bucket < LATENCY_BUCKETS - 1 && age_us >= bucket_end) {
+    bucket++;
+    bucket_end += LATENCY_BUCKET_US;
+  }
+  stats.histogram[bucket]++;
+}
+
+const Latency_Stats_T *Latency_get_stats(void) {
+  return &stats;
+}
+
+uint32_t Latency_mean_us(void) {
+  if (stats.count == 0) {
+    return 0;
+  }
+  return stats.sum_us / stats.count;
+}
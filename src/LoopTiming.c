@@ -0,0 +1,73 @@
+#include "LoopTiming.h"
+
+#if LOOP_TIMING
+
+static LoopTiming_Stats_T stats[LOOP_TIMING_STAGE_COUNT];
+
+uint8_t log2_floor(uint32_t n);
+
+void LoopTiming_init(void) {
+  uint8_t stage;
+  for (stage = 0; stage < LOOP_TIMING_STAGE_COUNT; stage++) {
+    LoopTiming_Stats_T *s = &stats[stage];
+    uint8_t i;
+    s->count = 0;
+    s->min_cycles = UINT32_MAX;
+    s->max_cycles = 0;
+    for (i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+      s->histogram[i] = 0;
+    }
+  }
+}
+
+void LoopTiming_record(LoopTiming_Stage_T stage, uint32_t cycles) {
+  LoopTiming_Stats_T *s = &stats[stage];
+  s->count++;
+  if (cycles < s->min_cycles) {
+    s->min_cycles = cycles;
+  }
+  if (cycles > s->max_cycles) {
+    s->max_cycles = cycles;
+  }
+  s->histogram[LoopTiming_bucket(cycles)]++;
+}
+
+const LoopTiming_Stats_T *LoopTiming_get_stats(LoopTiming_Stage_T stage) {
+  return &stats[stage];
+}
+
+uint8_t LoopTiming_bucket(uint32_t cycles) {
+  if (cycles >> LOOP_TIMING_MIN_SHIFT == 0) {
+    return 0;
+  }
+  const uint8_t bucket = log2_floor(cycles) - LOOP_TIMING_MIN_SHIFT + 1;
+  return bucket < LOOP_TIMING_BUCKETS ? bucket : LOOP_TIMING_BUCKETS - 1;
+}
+
+// The M0 has no CLZ instruction, so binary search in five steps instead of
+// calling the libgcc loop
+uint8_t log2_floor(uint32_t n) {
+  uint8_t log = 0;
+  if (n >> 16) {
+    n >>= 16;
+    log += 16;
+  }
+  if (n >> 8) {
+    n >>= 8;
+    log += 8;
+  }
+  if (n >> 4) {
+    n >>= 4;
+    log += 4;
+  }
+  if (n >> 2) {
+    n >>= 2;
+    log += 2;
+  }
+  if (n >> 1) {
+    log += 1;
+  }
+  return log;
+}
+
+#endif // LOOP_TIMING
@@ -2,8 +2,8 @@
 
 #include <stdbool.h>
 
+#include "Calibration.h"
 #include "Common.h"
-#include "Transform.h"
 
 #define IMPLAUSIBILITY_REPORT_MS 100
 #define IMPLAUSIBILITY_THROTTLE_TRAVEL 100
@@ -11,14 +11,58 @@
 #define CONFLICT_BEGIN_THROTTLE_TRAVEL 250
 #define CONFLICT_END_THROTTLE_TRAVEL 50
 
-#define CONFLICT_BRAKE_RAW 600
+static uint16_t conflict_brake_raw = CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW;
+
+// Moves on whenever a setting changes, so that every Rules_State_T is
+// evaluated again under the new one
+static uint32_t config_generation = 0;
 
 bool check_implausibility(uint16_t accel_1, uint16_t accel_2);
 
-void Rules_update_implausibility(Adc_Input_T *adc, Rules_State_T *rules, uint32_t msTicks) {
-  uint16_t accel_1 = Transform_accel_1(adc->accel_1_raw, 1000);
-  uint16_t accel_2 = Transform_accel_2(adc->accel_2_raw, 1000);
-  bool curr_implausible = check_implausibility(accel_1, accel_2);
+void Rules_set_conflict_brake_raw(uint16_t brake_raw) {
+  conflict_brake_raw = brake_raw;
+  config_generation++;
+}
+
+void Rules_initialize(Rules_State_T *rules) {
+  rules->has_conflict = false;
+  rules->implausibility_observed = false;
+  rules->implausibility_reported = false;
+  rules->implausibility_time_ms = 0;
+  rules->adc_generation = 0;
+  rules->stale = true;
+  rules->config_generation = config_generation;
+}
+
+bool Rules_update(Input_T *input, Rules_State_T *rules) {
+  uint32_t deadline_ms;
+  const bool deadline_reached = Rules_next_deadline(rules, &deadline_ms) &&
+    (int32_t)(input->msTicks - deadline_ms) >= 0;
+  if (!rules->stale && !deadline_reached &&
+      rules->config_generation == config_generation &&
+      input->generation[INPUT_ADC] == rules->adc_generation) {
+    return false;
+  }
+
+  Rules_update_implausibility(input->derived, rules, input->msTicks);
+  Rules_update_conflict(input, rules);
+  rules->adc_generation = input->generation[INPUT_ADC];
+  rules->config_generation = config_generation;
+  rules->stale = false;
+  return true;
+}
+
+bool Rules_next_deadline(const Rules_State_T *rules, uint32_t *deadline_ms) {
+  // Time alone only matters while an implausibility waits to be reported
+  if (!rules->implausibility_observed || rules->implausibility_reported) {
+    return false;
+  }
+  *deadline_ms = rules->implausibility_time_ms + IMPLAUSIBILITY_REPORT_MS + 1;
+  return true;
+}
+
+void Rules_update_implausibility(Derived_Input_T *derived, Rules_State_T *rules, uint32_t msTicks) {
+  bool curr_implausible = check_implausibility(derived->accel_1_travel, derived->accel_2_travel);
   bool prev_implausible = rules->implausibility_observed;
 
   if (!curr_implausible) {
@@ -48,9 +92,7 @@ void Rules_update_conflict(Input_T *input, Rules_State_T *rules) {
     // Checking conflict is pointless if implausibility
     return;
   }
-  const uint16_t accel_1 = Transform_accel_1(adc->accel_1_raw, 1000);
-  const uint16_t accel_2 = Transform_accel_2(adc->accel_2_raw, 1000);
-  const uint16_t accel = min(accel_1, accel_2);
+  const uint16_t accel = input->derived->accel_travel;
 
   bool curr_conflict = rules->has_conflict;
 
@@ -66,7 +108,7 @@ void Rules_update_conflict(Input_T *input, Rules_State_T *rules) {
 
   // TODO adjust this setting based on LV voltage
   // uint16_t battery_voltage = input->misc->lv_voltage;
-  bool brake_engaged = brake > CONFLICT_BRAKE_RAW;
+  bool brake_engaged = brake > conflict_brake_raw;
 
   bool throttle_engaged = accel > CONFLICT_BEGIN_THROTTLE_TRAVEL;
 
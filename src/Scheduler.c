@@ -0,0 +1,90 @@
+#include "Scheduler.h"
+
+void run_task(const Scheduler_Entry_T *entry, Scheduler_Task_T *task, uint32_t msTicks);
+void update_next_due(Scheduler_T *scheduler);
+
+void Scheduler_init(Scheduler_T *scheduler, const Scheduler_Entry_T *entries,
+    Scheduler_Task_T *tasks, uint8_t length, uint32_t start_ms) {
+  scheduler->entries = entries;
+  scheduler->tasks = tasks;
+  scheduler->length = length;
+
+  uint8_t i;
+  for (i = 0; i < length; i++) {
+    Scheduler_Task_T *task = &tasks[i];
+    task->next_due_ms = start_ms + entries[i].phase_ms;
+    task->last_run_ms = 0;
+    task->runs = 0;
+    task->skipped = 0;
+    task->lateness_max_ms = 0;
+    task->lateness_sum_ms = 0;
+    task->jitter_max_ms = 0;
+  }
+  update_next_due(scheduler);
+}
+
+uint32_t Scheduler_poll(Scheduler_T *scheduler, uint32_t msTicks) {
+  if (!Scheduler_reached(scheduler->next_due_ms, msTicks)) {
+    return 0;
+  }
+
+  uint32_t due = 0;
+  uint8_t i;
+  for (i = 0; i < scheduler->length; i++) {
+    Scheduler_Task_T *task = &scheduler->tasks[i];
+    if (Scheduler_reached(task->next_due_ms, msTicks)) {
+      run_task(&scheduler->entries[i], task, msTicks);
+      due |= 1UL << i;
+    }
+  }
+  update_next_due(scheduler);
+  return due;
+}
+
+uint32_t Scheduler_next_due(const Scheduler_T *scheduler) {
+  return scheduler->next_due_ms;
+}
+
+bool Scheduler_reached(uint32_t deadline_ms, uint32_t msTicks) {
+  return (int32_t)(msTicks - deadline_ms) >= 0;
+}
+
+void run_task(const Scheduler_Entry_T *entry, Scheduler_Task_T *task, uint32_t msTicks) {
+  const uint32_t period = entry->period_ms;
+  const uint32_t lateness = msTicks - task->next_due_ms;
+
+  if (task->runs > 0) {
+    const uint32_t interval = msTicks - task->last_run_ms;
+    const uint32_t jitter =
+      interval > period ? interval - period : period - interval;
+    if (jitter > task->jitter_max_ms) {
+      task->jitter_max_ms = jitter;
+    }
+  }
+  if (lateness > task->lateness_max_ms) {
+    task->lateness_max_ms = lateness;
+  }
+  task->lateness_sum_ms += lateness;
+  task->last_run_ms = msTicks;
+  task->runs++;
+
+  // Releases stay on the phase + k * period grid however late this run was,
+  // so lateness never accumulates into drift. Whole periods that were missed
+  // are skipped rather than run back to back. The M0 divides in software,
+  // so only pay for it when a release was actually missed.
+  const uint32_t missed = lateness < period ? 0 : lateness / period;
+  task->skipped += missed;
+  task->next_due_ms += (missed + 1) * period;
+}
+
+void update_next_due(Scheduler_T *scheduler) {
+  uint32_t next = scheduler->tasks[0].next_due_ms;
+  uint8_t i;
+  for (i = 1; i < scheduler->length; i++) {
+    const uint32_t due = scheduler->tasks[i].next_due_ms;
+    if ((int32_t)(due - next) < 0) {
+      next = due;
+    }
+  }
+  scheduler->next_due_ms = next;
+}
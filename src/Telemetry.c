@@ -0,0 +1,185 @@
+#include "Telemetry.h"
+
+#include "Serial.h"
+
+// Nibble table for CRC-16/CCITT, 32 bytes of flash against 8 shifts per
+// byte for the bitwise version
+static const uint16_t crc_nibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+static uint8_t sequence = 0;
+static Telemetry_Stats_T stats;
+
+typedef struct {
+  uint8_t data[TELEMETRY_MAX_RECORD_SIZE];
+  uint8_t len;
+} Record_Buffer_T;
+
+void begin_record(Record_Buffer_T *buf, Telemetry_Record_T type, uint32_t msTicks);
+void put_u8(Record_Buffer_T *buf, uint8_t value);
+void put_u16(Record_Buffer_T *buf, uint16_t value);
+void put_u32(Record_Buffer_T *buf, uint32_t value);
+bool send_record(Record_Buffer_T *buf);
+uint8_t cobs_encode(const uint8_t *src, uint8_t len, uint8_t *dst);
+
+void Telemetry_init(void) {
+  static const char delimiter = 0;
+  Serial_Write(&delimiter, 1);
+}
+
+bool Telemetry_write_throttle(uint32_t msTicks, const Telemetry_Throttle_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_THROTTLE, msTicks);
+  put_u16(&buf, record->accel_1_raw);
+  put_u16(&buf, record->accel_2_raw);
+  put_u16(&buf, record->accel_1_travel);
+  put_u16(&buf, record->accel_2_travel);
+  put_u16(&buf, record->accel_torque);
+  put_u8(&buf, record->flags);
+  return send_record(&buf);
+}
+
+bool Telemetry_write_brake(uint32_t msTicks, const Telemetry_Brake_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_BRAKE, msTicks);
+  put_u16(&buf, record->brake_1_raw);
+  put_u16(&buf, record->brake_2_raw);
+  put_u8(&buf, record->brake_pressure);
+  put_u8(&buf, record->flags);
+  return send_record(&buf);
+}
+
+bool Telemetry_write_current_sensor(uint32_t msTicks, Telemetry_Record_T type,
+    const Telemetry_Current_Sensor_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, type, msTicks);
+  put_u32(&buf, (uint32_t)record->value);
+  put_u32(&buf, record->last_updated);
+  return send_record(&buf);
+}
+
+bool Telemetry_write_mc_data(uint32_t msTicks, const Telemetry_Mc_Data_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_MC_DATA, msTicks);
+  put_u16(&buf, (uint16_t)record->motor_speed);
+  put_u32(&buf, record->last_updated);
+  return send_record(&buf);
+}
+
+bool Telemetry_write_mc_state(uint32_t msTicks, const Telemetry_Mc_State_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_MC_STATE, msTicks);
+  put_u8(&buf, record->limp_state);
+  put_u8(&buf, record->flags);
+  put_u16(&buf, record->lv_voltage);
+  put_u32(&buf, record->last_updated);
+  return send_record(&buf);
+}
+
+bool Telemetry_write_latency(uint32_t msTicks, const Latency_Stats_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_LATENCY, msTicks);
+  put_u32(&buf, record->count);
+  put_u32(&buf, record->count > 0 ? record->min_us : 0);
+  put_u32(&buf, record->max_us);
+  put_u32(&buf, Latency_mean_us());
+  uint8_t i;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    put_u32(&buf, record->histogram[i]);
+  }
+  return send_record(&buf);
+}
+
+#if LOOP_TIMING
+bool Telemetry_write_loop_timing(uint32_t msTicks, LoopTiming_Stage_T stage,
+    const LoopTiming_Stats_T *record) {
+  Record_Buffer_T buf;
+  begin_record(&buf, TELEMETRY_LOOP_TIMING, msTicks);
+  put_u8(&buf, stage);
+  put_u32(&buf, record->count);
+  put_u32(&buf, record->min_cycles);
+  put_u32(&buf, record->max_cycles);
+  uint8_t i;
+  for (i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+    put_u32(&buf, record->histogram[i]);
+  }
+  return send_record(&buf);
+}
+#endif
+
+const Telemetry_Stats_T *Telemetry_get_stats(void) {
+  return &stats;
+}
+
+uint16_t Telemetry_crc16(const uint8_t *data, uint32_t len) {
+  uint16_t crc = 0xffff;
+  uint32_t i;
+  for (i = 0; i < len; i++) {
+    crc = (crc << 4) ^ crc_nibble[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ crc_nibble[(crc >> 12) ^ (data[i] & 0x0f)];
+  }
+  return crc;
+}
+
+void begin_record(Record_Buffer_T *buf, Telemetry_Record_T type, uint32_t msTicks) {
+  buf->len = 0;
+  put_u8(buf, type);
+  put_u8(buf, sequence);
+  put_u32(buf, msTicks);
+}
+
+void put_u8(Record_Buffer_T *buf, uint8_t value) {
+  buf->data[buf->len++] = value;
+}
+
+void put_u16(Record_Buffer_T *buf, uint16_t value) {
+  put_u8(buf, value);
+  put_u8(buf, value >> 8);
+}
+
+void put_u32(Record_Buffer_T *buf, uint32_t value) {
+  put_u16(buf, value);
+  put_u16(buf, value >> 16);
+}
+
+// Appends the CRC, encodes and queues the record as one serial write, so a
+// full ring drops it whole rather than leaving half a frame
+bool send_record(Record_Buffer_T *buf) {
+  uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+
+  put_u16(buf, Telemetry_crc16(buf->data, buf->len));
+  uint8_t len = cobs_encode(buf->data, buf->len, frame);
+  frame[len++] = 0;
+
+  sequence++;
+  if (Serial_Write((const char *)frame, len) == 0) {
+    stats.dropped++;
+    return false;
+  }
+  stats.records++;
+  stats.bytes += len;
+  return true;
+}
+
+// Records are shorter than 254 bytes, so there is never more than the
+// one overhead byte and no block ever needs splitting
+uint8_t cobs_encode(const uint8_t *src, uint8_t len, uint8_t *dst) {
+  uint8_t code_index = 0;
+  uint8_t out = 1;
+  uint8_t code = 1;
+  uint8_t i;
+  for (i = 0; i < len; i++) {
+    if (src[i] == 0) {
+      dst[code_index] = code;
+      code_index = out++;
+      code = 1;
+    } else {
+      dst[out++] = src[i];
+      code++;
+    }
+  }
+  dst[code_index] = code;
+  return out;
+}
@@ -1,23 +1,59 @@
 #include "Transform.h"
 
+#include "Calibration.h"
 #include "Common.h"
-
-#define ACCEL_1_LOWER_BOUND 105
-#define ACCEL_1_UPPER_BOUND 645
-#define ACCEL_2_LOWER_BOUND 71
-#define ACCEL_2_UPPER_BOUND 340
+#include "Types.h"
 
 #define BRAKE_1_LOWER_BOUND 380
 #define BRAKE_1_UPPER_BOUND 780
 #define BRAKE_2_LOWER_BOUND 220
 #define BRAKE_2_UPPER_BOUND 270
 
+// Microsecond = 1 millionth of a second
+#define MICROSECONDS_PER_SECOND 1000000ULL
+// 1000 millirevs = 1 rev
+#define MILLIREVS_PER_REV 1000ULL
+// Pointless comment to not break pattern
+#define SECONDS_PER_MINUTE 60ULL
+
+// mRPM = (us/min * mrev/rev) / (us/tooth * teeth/rev). The numerator over
+// NUM_TEETH still fits in 32 bits (2608695652), and
+// floor(floor(a / b) / c) == floor(a / (b * c)), so folding the constant
+// part in at compile time leaves one exact 32-bit divide at runtime.
+#define MRPM_US_PER_TOOTH \
+  ((uint32_t)(SECONDS_PER_MINUTE * MICROSECONDS_PER_SECOND * MILLIREVS_PER_REV / NUM_TEETH))
+
+// In RAM so that a new calibration can replace them; their reciprocals are
+// only worked out again when it does
+static Transform_Linear_T accel_1_travel = TRANSFORM_LINEAR(
+    CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+    TRANSFORM_TRAVEL_WIDTH);
+static Transform_Linear_T accel_2_travel = TRANSFORM_LINEAR(
+    CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND,
+    TRANSFORM_TRAVEL_WIDTH);
+static Transform_Linear_T accel_1_torque = TRANSFORM_LINEAR(
+    CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+    TRANSFORM_TORQUE_WIDTH);
+static Transform_Linear_T accel_2_torque = TRANSFORM_LINEAR(
+    CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND,
+    TRANSFORM_TORQUE_WIDTH);
+
+void Transform_set_accel_bounds(uint16_t accel_1_lower, uint16_t accel_1_upper,
+    uint16_t accel_2_lower, uint16_t accel_2_upper) {
+  Transform_linear_init(&accel_1_travel, accel_1_lower, accel_1_upper, TRANSFORM_TRAVEL_WIDTH);
+  Transform_linear_init(&accel_2_travel, accel_2_lower, accel_2_upper, TRANSFORM_TRAVEL_WIDTH);
+  Transform_linear_init(&accel_1_torque, accel_1_lower, accel_1_upper, TRANSFORM_TORQUE_WIDTH);
+  Transform_linear_init(&accel_2_torque, accel_2_lower, accel_2_upper, TRANSFORM_TORQUE_WIDTH);
+}
+
 uint16_t Transform_accel_1(uint16_t reading, uint16_t desired_width) {
-  return Transform_linear_transfer_fn(reading, desired_width, ACCEL_1_LOWER_BOUND, ACCEL_1_UPPER_BOUND);
+  return Transform_linear_transfer_fn(reading, desired_width,
+      accel_1_travel.lower_bound, accel_1_travel.upper_bound);
 }
 
 uint16_t Transform_accel_2(uint16_t reading, uint16_t desired_width) {
-  return Transform_linear_transfer_fn(reading, desired_width, ACCEL_2_LOWER_BOUND, ACCEL_2_UPPER_BOUND);
+  return Transform_linear_transfer_fn(reading, desired_width,
+      accel_2_travel.lower_bound, accel_2_travel.upper_bound);
 }
 
 uint16_t Transform_linear_transfer_fn(uint32_t reading, uint16_t desired_width, uint16_t lower_bound, uint16_t upper_bound) {
@@ -38,3 +74,55 @@ uint16_t Transform_linear_transfer_fn(uint32_t reading, uint16_t desired_width,
   uint16_t short_val = (uint16_t)(reading);
   return short_val;
 }
+
+uint16_t Transform_accel_1_travel(uint16_t reading) {
+  return Transform_linear_apply(&accel_1_travel, reading);
+}
+
+uint16_t Transform_accel_2_travel(uint16_t reading) {
+  return Transform_linear_apply(&accel_2_travel, reading);
+}
+
+uint16_t Transform_accel_1_torque(uint16_t reading) {
+  return Transform_linear_apply(&accel_1_torque, reading);
+}
+
+uint16_t Transform_accel_2_torque(uint16_t reading) {
+  return Transform_linear_apply(&accel_2_torque, reading);
+}
+
+void Transform_linear_init(Transform_Linear_T *fn, uint16_t lower_bound,
+    uint16_t upper_bound, uint16_t desired_width) {
+  const Transform_Linear_T init = TRANSFORM_LINEAR(lower_bound, upper_bound, desired_width);
+  *fn = init;
+}
+
+uint16_t Transform_linear_apply(const Transform_Linear_T *fn, uint32_t reading) {
+  // Same clamping as Transform_linear_transfer_fn
+  reading = max(reading, fn->lower_bound);
+  reading = min(reading, fn->upper_bound);
+
+  const uint16_t diff = fn->upper_bound - fn->lower_bound;
+  reading = reading - fn->lower_bound;
+
+  // reading <= diff, so reading * reciprocal <= desired_width * 2^16 and
+  // neither product below overflows 32 bits
+  uint32_t quotient = (reading * fn->reciprocal) >> TRANSFORM_RECIPROCAL_SHIFT;
+
+  // Truncating the reciprocal makes the estimate low by less than
+  // reading / 2^16 < 1, so it is either exact or one short of
+  // floor(reading * desired_width / diff)
+  if ((quotient + 1) * diff <= reading * fn->desired_width) {
+    quotient++;
+  }
+
+  return (uint16_t)quotient;
+}
+
+uint32_t Transform_click_time_to_mRPM(uint32_t us_per_click) {
+  // A zero period can only come from a bad capture, report the wheel stopped
+  if (us_per_click == 0) {
+    return 0;
+  }
+  return MRPM_US_PER_TOOTH / us_per_click;
+}
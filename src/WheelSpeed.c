@@ -0,0 +1,242 @@
+#include "WheelSpeed.h"
+
+#include "chip.h"
+
+#include "Clock.h"
+
+// ISR-private history of tooth periods. idx advances on every tick, even
+// disregarded ones, so it stays locked to the physical tooth the spacing
+// factors belong to.
+typedef struct {
+  uint32_t last_tick[NUM_TEETH];
+  uint64_t little_sum;
+  uint8_t idx;
+
+  // Corrected periods in the adaptive window, at the same index as last_tick
+  uint32_t window_us[NUM_TEETH];
+  uint32_t spacing[NUM_TEETH];
+} Wheel_History_T;
+
+// Published state, guarded by a sequence counter. The ISR makes seq odd
+// while it writes and even again when done, so a reader that sees the same
+// even value before and after its copy knows nothing changed in between.
+// Each wheel has exactly one writer, its own capture interrupt.
+typedef struct {
+  volatile uint32_t seq;
+  WheelSpeed_Snapshot_T data;
+} Wheel_Published_T;
+
+static Wheel_History_T history[NUM_WHEELS];
+static Wheel_Published_T published[NUM_WHEELS];
+static volatile bool disregard[NUM_WHEELS];
+static volatile bool adaptive = false;
+static volatile bool spacing_correction = false;
+static WheelSpeed_Stats_T stats[NUM_WHEELS];
+
+void update_weighted(Wheel_History_T *hist, WheelSpeed_Snapshot_T *data,
+    uint8_t idx, uint32_t tick_us);
+void update_window(Wheel_History_T *hist, WheelSpeed_Snapshot_T *data,
+    uint8_t idx, uint32_t tick_us);
+void learn_spacing(Wheel_History_T *hist, uint8_t idx, uint32_t tick_us,
+    uint32_t this_tooth_last_rev);
+
+void WheelSpeed_init(void) {
+  uint8_t wheel;
+  for (wheel = 0; wheel < NUM_WHEELS; wheel++) {
+    uint8_t tooth;
+    for (tooth = 0; tooth < NUM_TEETH; tooth++) {
+      history[wheel].last_tick[tooth] = 0;
+      history[wheel].window_us[tooth] = 0;
+      history[wheel].spacing[tooth] = WHEEL_SPEED_SPACING_ONE;
+    }
+    history[wheel].little_sum = 0;
+    history[wheel].idx = 0;
+
+    published[wheel].seq = 0;
+    published[wheel].data.count = 0;
+    published[wheel].data.latest_us = 0;
+    published[wheel].data.big_sum = 0;
+    published[wheel].data.last_updated = 0;
+    published[wheel].data.window_sum_us = 0;
+    published[wheel].data.window_count = 0;
+
+    disregard[wheel] = false;
+  }
+}
+
+void WheelSpeed_isr_tick(Wheel_T wheel, uint32_t tick_us, uint32_t msTicks) {
+  const uint32_t start_val = SysTick->VAL;
+  Wheel_History_T *hist = &history[wheel];
+  Wheel_Published_T *pub = &published[wheel];
+  WheelSpeed_Snapshot_T *data = &pub->data;
+  const uint8_t idx = hist->idx;
+
+  pub->seq++;
+  __DMB();
+
+  if (disregard[wheel]) {
+    data->count = 0;
+    data->latest_us = 0;
+    data->big_sum = 0;
+    data->window_sum_us = 0;
+    data->window_count = 0;
+    hist->little_sum = 0;
+  } else {
+    update_weighted(hist, data, idx, tick_us);
+    if (adaptive) {
+      update_window(hist, data, idx, tick_us);
+    }
+  }
+  // Update timestamp
+  data->last_updated = msTicks;
+  hist->idx = idx + 1 == NUM_TEETH ? 0 : idx + 1;
+
+  __DMB();
+  pub->seq++;
+
+  WheelSpeed_Stats_T *wheel_stats = &stats[wheel];
+  wheel_stats->ticks++;
+  const uint32_t cycles = Clock_span(start_val, SysTick->VAL);
+  if (cycles > wheel_stats->isr_max_cycles) {
+    wheel_stats->isr_max_cycles = cycles;
+  }
+}
+
+void update_weighted(Wheel_History_T *hist, WheelSpeed_Snapshot_T *data,
+    uint8_t idx, uint32_t tick_us) {
+  const uint32_t count = data->count;
+  const uint32_t this_tooth_last_rev =
+    count < NUM_TEETH ? 0 : hist->last_tick[idx];
+
+  if (spacing_correction && count >= NUM_TEETH) {
+    learn_spacing(hist, idx, tick_us, this_tooth_last_rev);
+  }
+
+  // Register tick
+  hist->last_tick[idx] = tick_us;
+  data->count = count + 1;
+  data->latest_us = tick_us;
+
+  // Update big sum
+  data->big_sum += NUM_TEETH * (uint64_t)tick_us;
+  data->big_sum -= hist->little_sum;
+
+  // Update little sum
+  hist->little_sum += tick_us;
+  hist->little_sum -= this_tooth_last_rev;
+}
+
+// Keeps the fewest newest teeth whose corrected periods add up to at least
+// WHEEL_SPEED_WINDOW_US. Each tick adds one tooth and drops at most
+// NUM_TEETH - 1, so the loop is bounded.
+void update_window(Wheel_History_T *hist, WheelSpeed_Snapshot_T *data,
+    uint8_t idx, uint32_t tick_us) {
+  uint32_t corrected = tick_us;
+  if (spacing_correction) {
+    corrected = ((uint64_t)tick_us * hist->spacing[idx]) >> 16;
+  }
+
+  uint32_t sum = data->window_sum_us;
+  uint8_t count = data->window_count;
+
+  // The slot about to be written holds the oldest tooth once the window
+  // spans a whole revolution
+  if (count == NUM_TEETH) {
+    sum -= hist->window_us[idx];
+    count--;
+  }
+  hist->window_us[idx] = corrected;
+  sum += corrected;
+  count++;
+
+  while (count > 1) {
+    uint8_t oldest = idx + NUM_TEETH - (count - 1);
+    if (oldest >= NUM_TEETH) {
+      oldest -= NUM_TEETH;
+    }
+    const uint32_t without_oldest = sum - hist->window_us[oldest];
+    if (without_oldest < WHEEL_SPEED_WINDOW_US) {
+      break;
+    }
+    sum = without_oldest;
+    count--;
+  }
+
+  data->window_sum_us = sum;
+  data->window_count = count;
+}
+
+// Moves this tooth's factor towards revolution mean / tooth period. One
+// software division per tick, and only while the speed is steady and low
+// enough for the Q16 arithmetic to fit in 32 bits.
+void learn_spacing(Wheel_History_T *hist, uint8_t idx, uint32_t tick_us,
+    uint32_t this_tooth_last_rev) {
+  const uint32_t diff = tick_us > this_tooth_last_rev ?
+    tick_us - this_tooth_last_rev : this_tooth_last_rev - tick_us;
+  if (tick_us == 0 || tick_us > UINT16_MAX ||
+      diff > (tick_us >> WHEEL_SPEED_SPACING_STEADY_SHIFT)) {
+    return;
+  }
+
+  if (hist->little_sum > (uint32_t)NUM_TEETH * UINT16_MAX) {
+    return;
+  }
+  const uint32_t mean = (uint32_t)hist->little_sum / NUM_TEETH;
+  const uint32_t target = (mean << 16) / tick_us;
+  const int32_t error = (int32_t)(target - hist->spacing[idx]);
+  hist->spacing[idx] += error / (1 << WHEEL_SPEED_SPACING_LEARN_SHIFT);
+}
+
+void WheelSpeed_read(Wheel_T wheel, WheelSpeed_Snapshot_T *snapshot) {
+  Wheel_Published_T *pub = &published[wheel];
+  uint32_t seq;
+
+  while (1) {
+    seq = pub->seq;
+    __DMB();
+    // Only the ISR can run between these two reads of seq, never the other
+    // way round, so an odd value is never seen here in practice
+    *snapshot = pub->data;
+    __DMB();
+    if ((seq & 1) == 0 && seq == pub->seq) {
+      return;
+    }
+    stats[wheel].read_retries++;
+  }
+}
+
+uint32_t WheelSpeed_weighted_us(const WheelSpeed_Snapshot_T *snapshot) {
+  if (snapshot->count < NUM_TEETH) {
+    return snapshot->latest_us;
+  }
+  return snapshot->big_sum / SUM_ALL_TEETH;
+}
+
+uint32_t WheelSpeed_adaptive_us(const WheelSpeed_Snapshot_T *snapshot,
+    uint32_t since_last_us) {
+  if (snapshot->window_count == 0) {
+    return 0;
+  }
+  const uint32_t avg = snapshot->window_sum_us / snapshot->window_count;
+  return since_last_us > avg ? since_last_us : avg;
+}
+
+void WheelSpeed_set_adaptive(bool enabled) {
+  adaptive = enabled;
+}
+
+void WheelSpeed_set_spacing_correction(bool enabled) {
+  spacing_correction = enabled;
+}
+
+uint32_t WheelSpeed_spacing_factor(Wheel_T wheel, uint8_t tooth) {
+  return history[wheel].spacing[tooth];
+}
+
+void WheelSpeed_set_disregard(Wheel_T wheel, bool value) {
+  disregard[wheel] = value;
+}
+
+const WheelSpeed_Stats_T *WheelSpeed_get_stats(Wheel_T wheel) {
+  return &stats[wheel];
+}
@@ -1,10 +1,20 @@
 #include "Adc.h"
+#include "Calibration.h"
+#include "CanHealth.h"
+#include "CanRx.h"
+#include "CanTx.h"
+#include "Clock.h"
+#include "Event.h"
 #include "Input.h"
+#include "Latency.h"
+#include "LoopTiming.h"
 #include "Output.h"
 #include "Serial.h"
 #include "State.h"
+#include "Telemetry.h"
 
 #include "Timer.h"
+#include "WheelSpeed.h"
 
 #include "MY17_Can_Library.h"
 /*****************************************************************************
@@ -13,22 +23,25 @@
 
 const uint32_t OscRateIn = 12000000;
 
-#define SERIAL_BAUDRATE 115200
-#define CAN_BAUDRATE 500000
-
-volatile uint32_t msTicks;
-
-// integers in [0:4294967296] representing the number of clock cycles between
-// ticks from wheel speed sensors
-volatile uint32_t last_tick[NUM_WHEELS][NUM_TEETH];
+// 1 sleeps between passes until an interrupt posts an event or the next
+// deadline comes up, 0 polls continuously
+#ifndef EVENT_DRIVEN_LOOP
+#define EVENT_DRIVEN_LOOP 0
+#endif
 
-volatile uint32_t num_ticks[NUM_WHEELS];
-volatile uint64_t big_sum[NUM_WHEELS];
-volatile uint64_t little_sum[NUM_WHEELS];
+// 1 reports wheel speed from the adaptive time window, 0 from the weighted
+// sum over the last revolution
+#ifndef WHEEL_SPEED_ADAPTIVE
+#define WHEEL_SPEED_ADAPTIVE 0
+#endif
 
-volatile bool disregard[NUM_WHEELS];
+// 1 learns and applies per-tooth spacing factors in the adaptive window
+#ifndef WHEEL_SPEED_SPACING_CORRECTION
+#define WHEEL_SPEED_SPACING_CORRECTION 0
+#endif
 
-volatile uint32_t last_updated[NUM_WHEELS];
+#define SERIAL_BAUDRATE 115200
+#define CAN_BAUDRATE 500000
 
 #define WHEEL_SPEED_TIMEOUT_MS 100
 
@@ -37,9 +50,11 @@ uint32_t last_speed_read_ms = 0;
 
 static Input_T input;
 static Adc_Input_T adc_input;
+static Derived_Input_T derived_input;
 static Speed_Input_T speed_input;
 static Mc_Input_T mc_input;
 static Current_Sensor_Input_T current_sensor_input;
+static Energy_Input_T energy_input;
 static Misc_Input_T misc_input;
 
 static State_T state;
@@ -55,6 +70,16 @@ static Can_Output_T can_output;
  /* Private function */
 void SysTick_Handler(void) {
   msTicks++;
+  // CAN frames are only ever read out of the driver here, the main loop just
+  // drains the ring this fills
+  if (CanRx_isr_receive(msTicks) > 0) {
+    Event_post(EVENT_CAN_RX);
+  }
+  // One step of bus-off recovery at most, before anything is sent
+  CanHealth_isr_update(msTicks);
+  // Frames the controller had no room for go out as soon as it does
+  CanTx_isr_drain();
+  Event_tick(msTicks);
 }
 
 /****************************************************************************/
@@ -65,34 +90,9 @@ void handle_interrupt(LPC_TIMER_T* timer, Wheel_T wheel) {
   const uint32_t curr_tick = Chip_TIMER_ReadCapture(timer, 0) / CYCLES_PER_MICROSECOND;
 
   // Interrupt can now proceed
+  WheelSpeed_isr_tick(wheel, curr_tick, msTicks);
 
-  if (disregard[wheel]) {
-    num_ticks[wheel] = 0;
-    big_sum[wheel] = 0;
-    little_sum[wheel] = 0;
-    last_updated[wheel] = msTicks;
-    return;
-  }
-
-  const uint32_t count = num_ticks[wheel];
-  const uint8_t idx = count % NUM_TEETH;
-  const uint32_t this_tooth_last_rev =
-    count < NUM_TEETH ? 0 : last_tick[wheel][idx];
-
-  // Register tick
-  last_tick[wheel][idx] = curr_tick;
-  num_ticks[wheel]++;
-
-  // Update big sum
-  big_sum[wheel] += NUM_TEETH * curr_tick;
-  big_sum[wheel] -= little_sum[wheel];
-
-  // Update little sum
-  little_sum[wheel] += curr_tick;
-  little_sum[wheel] -= this_tooth_last_rev;
-
-  // Update timestamp
-  last_updated[wheel] = msTicks;
+  Event_post(EVENT_WHEEL_TICK);
 }
 
 // Interrupt handler for timer 0 capture pin. This function get called automatically on
@@ -112,14 +112,19 @@ void Set_Interrupt_Priorities(void) {
   NVIC_SetPriority(TIMER_32_0_IRQn, 0);
   NVIC_SetPriority(TIMER_32_1_IRQn, 1);
   /* Give the SysTick function a lower priority */
-  NVIC_SetPriority(SysTick_IRQn, 2);	
+  NVIC_SetPriority(SysTick_IRQn, 2);
+  /* Debug output can always wait */
+  NVIC_SetPriority(UART0_IRQn, 3);
+  /* CAN_IRQn keeps its reset priority of 0, level with timer 0 */
 }
 
 void initialize_structs(void) {
   input.adc = &adc_input;
+  input.derived = &derived_input;
   input.speed = &speed_input;
   input.mc = &mc_input;
   input.current_sensor = &current_sensor_input;
+  input.energy = &energy_input;
   input.misc = &misc_input;
 
   state.rules = &rules_state;
@@ -128,18 +133,20 @@ void initialize_structs(void) {
   output.can = &can_output;
   output.logging = &logging_output;
 
-  uint8_t wheel;
-  for(wheel = 0; wheel < NUM_WHEELS; wheel++) {
-    uint8_t tooth;
-    for(tooth = 0; tooth < NUM_TEETH; tooth++) {
-      last_tick[wheel][tooth] = 0;
-    }
-    num_ticks[wheel] = 0;
-    big_sum[wheel] = 0;
-    little_sum[wheel] = 0;
-    disregard[wheel] = false;
-    last_updated[wheel] = 0;
-  }
+  State_initialize(&state);
+
+  // Pedal bounds, brake thresholds and message periods from flash
+  Calibration_load();
+
+  WheelSpeed_init();
+  WheelSpeed_set_adaptive(WHEEL_SPEED_ADAPTIVE);
+  WheelSpeed_set_spacing_correction(WHEEL_SPEED_SPACING_CORRECTION);
+
+  Latency_init();
+
+#if LOOP_TIMING
+  LoopTiming_init();
+#endif
 }
 
 /**
@@ -153,31 +160,52 @@ void fill_input(void) {
     last_speed_read_ms = msTicks;
     uint8_t wheel;
     for(wheel = 0; wheel < NUM_WHEELS; wheel++) {
-      const uint32_t count = num_ticks[wheel];
-      uint8_t idx;
-      if (count > 0) {
-        // If there are x ticks so far, the last tick is index (x - 1)
-        idx = (count - 1) % NUM_TEETH;
-      } else {
-        idx = 0;
-      }
+      WheelSpeed_Snapshot_T snapshot;
+      WheelSpeed_read(wheel, &snapshot);
+
+      const uint32_t count = snapshot.count;
       input.speed->tick_count[wheel] = count;
-      input.speed->tick_us[wheel] = last_tick[wheel][idx];
-      if (count < NUM_TEETH) {
-        input.speed->moving_avg_us[wheel] = 0;
-      } else {
-        const uint32_t avg = big_sum[wheel] / SUM_ALL_TEETH;
-        input.speed->moving_avg_us[wheel] = avg;
-      }
+      input.speed->tick_us[wheel] = snapshot.latest_us;
+      const uint32_t weighted_us = WheelSpeed_weighted_us(&snapshot);
+      input.speed->moving_avg_us[wheel] = count < NUM_TEETH ? 0 : weighted_us;
+#if WHEEL_SPEED_ADAPTIVE
+      // msTicks only bounds the time since the tick to within a tick
+      const uint32_t since_last_ms = msTicks - snapshot.last_updated;
+      const uint32_t since_last_us =
+        since_last_ms > 0 ? (since_last_ms - 1) * 1000 : 0;
+      input.speed->period_us[wheel] =
+        WheelSpeed_adaptive_us(&snapshot, since_last_us);
+#else
+      input.speed->period_us[wheel] = weighted_us;
+#endif
       const bool timeout =
-        last_updated[wheel] + WHEEL_SPEED_TIMEOUT_MS < msTicks;
+        snapshot.last_updated + WHEEL_SPEED_TIMEOUT_MS < msTicks;
       input.speed->wheel_stopped[wheel] = timeout || count == 0;
-      disregard[wheel] = timeout;
+      WheelSpeed_set_disregard(wheel, timeout);
     }
   }
   Input_fill_input(&input);
 }
 
+/**
+ * Arms a wakeup for the earliest periodic work of any stage
+ */
+void schedule_wakeup(void) {
+  const uint32_t wheel_deadline =
+    last_speed_read_ms + WHEEL_SPEED_READ_PERIOD_MS + 1;
+  const uint32_t input_deadline = Input_next_deadline(&input);
+  const uint32_t state_deadline = State_next_deadline(&state);
+
+  uint32_t deadline = wheel_deadline;
+  if ((int32_t)(input_deadline - deadline) < 0) {
+    deadline = input_deadline;
+  }
+  if ((int32_t)(state_deadline - deadline) < 0) {
+    deadline = state_deadline;
+  }
+  Event_set_deadline(deadline);
+}
+
 void update_state(void) {
   State_update_state(&input, &state, &output);
 }
@@ -200,6 +228,9 @@ int main(void) {
 
   Serial_Init(SERIAL_BAUDRATE);
   Can_Init(CAN_BAUDRATE);
+  CanRx_init();
+  CanHealth_init();
+  CanTx_init();
 
   ADC_Init();
   Timer_Init();
@@ -210,10 +241,39 @@ int main(void) {
   initialize_structs();
 
   Serial_Println("Started up");
+  Telemetry_init();
+
+#if EVENT_DRIVEN_LOOP
+  schedule_wakeup();
+#endif
 
   while (1) {
+#if EVENT_DRIVEN_LOOP
+    Event_wait();
+#endif
+
+    const uint32_t pass_start = Clock_cycles();
+    uint32_t start = pass_start;
     fill_input();
+    uint32_t end = Clock_cycles();
+    Event_record_task(EVENT_TASK_INPUT, end - start);
+    LOOP_TIMING_RECORD(LOOP_TIMING_INPUT, end - start);
+
+    start = end;
     update_state();
+    end = Clock_cycles();
+    Event_record_task(EVENT_TASK_STATE, end - start);
+    LOOP_TIMING_RECORD(LOOP_TIMING_STATE, end - start);
+
+    start = end;
     process_output();
+    end = Clock_cycles();
+    Event_record_task(EVENT_TASK_OUTPUT, end - start);
+    LOOP_TIMING_RECORD(LOOP_TIMING_OUTPUT, end - start);
+    LOOP_TIMING_RECORD(LOOP_TIMING_PASS, end - pass_start);
+
+#if EVENT_DRIVEN_LOOP
+    schedule_wakeup();
+#endif
   }
 }
@@ -1,40 +1,61 @@
 #include "Output.h"
 
 #include "chip.h"
-#include "can.h"
 
 #include <MY17_Can_Library.h>
 
+#include "Calibration.h"
+#include "CanTx.h"
+#include "Clock.h"
 #include "Common.h"
+#include "Energy.h"
+#include "Latency.h"
 #include "Serial.h"
+#include "Telemetry.h"
 #include "Transform.h"
 
-#define TWO_BYTE_MAX 32767
-#define TEN_BIT_MAX 1023
-#define BYTE_MAX 255
+static uint16_t brake_engaged_hv_raw = CALIBRATION_DEFAULT_BRAKE_ENGAGED_HV_RAW;
+static uint16_t brake_engaged_lv_raw = CALIBRATION_DEFAULT_BRAKE_ENGAGED_LV_RAW;
 
-// Microsecond = 1 millionth of a second
-#define MICROSECONDS_PER_SECOND_F 1000000.0
-// 1000 millirevs = 1 rev
-#define MILLIREVS_PER_REV_F 1000.0
-// Pointless comment to not break pattern
-#define SECONDS_PER_MINUTE 60
+// The DriverOutput last worked out, and what from. Its inputs change less
+// often than it is sent, so when none has the same frame goes out again.
+typedef struct {
+  bool valid;
+  uint32_t generation[INPUT_SOURCES];
+  bool implausible;
+  bool conflict;
+  Can_FrontCanNode_DriverOutput_T msg;
+} Driver_Output_Cache_T;
+
+static Driver_Output_Cache_T driver_output_cache;
 
-static bool resettingPeripheral = false;
+static Output_Stats_T stats;
 
 void process_can(Input_T *input, State_T *state, Can_Output_T *can);
 void process_logging(Input_T *input, State_T *state, Logging_Output_T *logging);
 
-Can_ErrorID_T write_can_driver_output(Input_T *input, Rules_State_T *rules);
-Can_ErrorID_T write_can_raw_values(Adc_Input_T *adc);
-Can_ErrorID_T write_can_wheel_speed(Speed_Input_T *speed);
-void handle_can_error(Can_ErrorID_T error);
-uint32_t click_time_to_mRPM(uint32_t cycles_per_click);
+void write_can_driver_output(Input_T *input, Rules_State_T *rules);
+bool driver_output_current(Input_T *input, Rules_State_T *rules);
+Can_FrontCanNode_DriverOutput_T compute_driver_output(Input_T *input, Rules_State_T *rules);
+void write_can_raw_values(Adc_Input_T *adc);
+void write_can_wheel_speed(Speed_Input_T *speed);
+void write_can_energy(Energy_Input_T *energy);
+
+void write_log_throttle(Input_T *input, Rules_State_T *rules);
+void write_log_brake(Input_T *input, Rules_State_T *rules);
+void write_log_current_sensor(Input_T *input, Current_Sensor_Values_T value);
+void write_log_mc_data(Input_T *input);
+void write_log_mc_state(Input_T *input);
+void write_log_latency(Input_T *input);
+#if LOOP_TIMING
+void write_log_loop_timing(Input_T *input);
+#endif
 
 void Output_initialize(Output_T *output) {
   output->can->send_driver_output_msg = false;
   output->can->send_raw_values_msg = false;
   output->can->send_wheel_speed_msg = false;
+  output->can->send_energy_msg = false;
 
   output->logging->write_throttle_log = false;
   output->logging->write_brake_log = false;
@@ -44,6 +65,19 @@ void Output_initialize(Output_T *output) {
   }
   output->logging->write_mc_data_log = false;
   output->logging->write_mc_state_log = false;
+  output->logging->write_latency_log = false;
+
+  driver_output_cache.valid = false;
+}
+
+void Output_set_brake_engaged_raw(uint16_t hv_raw, uint16_t lv_raw) {
+  brake_engaged_hv_raw = hv_raw;
+  brake_engaged_lv_raw = lv_raw;
+  driver_output_cache.valid = false;
+}
+
+const Output_Stats_T *Output_get_stats(void) {
+  return &stats;
 }
 
 void Output_process_output(Input_T *input, State_T *state, Output_T *output) {
@@ -54,30 +88,27 @@ void Output_process_output(Input_T *input, State_T *state, Output_T *output) {
 void process_can(Input_T *input, State_T *state, Can_Output_T *can) {
   if (can->send_driver_output_msg) {
     can->send_driver_output_msg = false;
-    handle_can_error(write_can_driver_output(input, state->rules));
+    write_can_driver_output(input, state->rules);
   }
   if (can->send_raw_values_msg) {
     can->send_raw_values_msg = false;
-    handle_can_error(write_can_raw_values(input->adc));
+    write_can_raw_values(input->adc);
   }
   if (can->send_wheel_speed_msg) {
     can->send_wheel_speed_msg = false;
-    handle_can_error(write_can_wheel_speed(input->speed));
+    write_can_wheel_speed(input->speed);
+  }
+  if (can->send_energy_msg) {
+    can->send_energy_msg = false;
+    write_can_energy(input->energy);
   }
-}
 
-void handle_can_error(Can_ErrorID_T error) {
-  if (error != Can_Error_NONE && error != Can_Error_NO_RX) {
-    /* Serial_Print("can_write_err: "); */
-    /* Serial_PrintlnNumber(error, 16); */
-    if (!resettingPeripheral) {
-      resettingPeripheral = true;
-      // TODO add this to CAN library
-      CAN_ResetPeripheral();
-      Can_Init(500000);
-    }
-  } else {
-    resettingPeripheral = false;
+  // Also retries anything deferred that SysTick has not got out yet
+  CanTx_flush();
+
+  uint32_t age_us;
+  if (CanTx_take_sent(CAN_TX_DRIVER_OUTPUT, &age_us)) {
+    Latency_record(age_us);
   }
 }
 
@@ -89,14 +120,55 @@ void handle_can_error(Can_ErrorID_T error) {
 #define SPEED_TOP_CUTOFF_PERCENTAGE 10
 #define SPEED_TOP_CUTOFF_ACTUAL ((MAX_INT_16 * (SPEED_TOP_CUTOFF_PERCENTAGE)) / 100)
 
-#define SPEED_WIDTH_ACTUAL ((SPEED_TOP_CUTOFF_ACTUAL) - (SPEED_BOTTOM_CUTOFF_ACTUAL))
-
 #define TORQUE_BOTTOM_CUTOFF_PERCENTAGE 50
 #define TORQUE_BOTTOM_CUTOFF_ACTUAL ((MAX_INT_16 * (TORQUE_BOTTOM_CUTOFF_PERCENTAGE)) / 100)
 
 #define TORQUE_TOP_CUTOFF_ACTUAL MAX_INT_16
 
-#define TORQUE_HEIGHT_ACTUAL ((TORQUE_TOP_CUTOFF_ACTUAL) - (TORQUE_BOTTOM_CUTOFF_ACTUAL))
+// One straight piece of the torque cap, from (speed_0, torque_0) up to but
+// not including speed_1, where it reaches torque_1. The cap may only rise
+// with speed. Interpolation uses the reciprocal worked out here at compile
+// time, so it is floor(torque_0 + (speed - speed_0) * rise / run) exactly
+// without a runtime divide.
+typedef struct {
+  int16_t base_torque;
+  Transform_Linear_T line;
+} Ramp_Segment_T;
+
+#define RAMP_SEGMENT(speed_0, torque_0, speed_1, torque_1) \
+  { (torque_0), TRANSFORM_LINEAR((speed_0), (speed_1), (torque_1) - (torque_0)) }
+
+// Torque cap against absolute motor speed, segments in order of speed. At
+// or above the end of the last segment torque is not limited.
+static const Ramp_Segment_T torque_ramp[] = {
+  // Launch at half torque
+  RAMP_SEGMENT(0, TORQUE_BOTTOM_CUTOFF_ACTUAL,
+      SPEED_BOTTOM_CUTOFF_ACTUAL, TORQUE_BOTTOM_CUTOFF_ACTUAL),
+  // then ramp up to full torque
+  RAMP_SEGMENT(SPEED_BOTTOM_CUTOFF_ACTUAL, TORQUE_BOTTOM_CUTOFF_ACTUAL,
+      SPEED_TOP_CUTOFF_ACTUAL, TORQUE_TOP_CUTOFF_ACTUAL),
+};
+
+#define TORQUE_RAMP_LENGTH (sizeof(torque_ramp) / sizeof(torque_ramp[0]))
+
+#define LIMP_RECIPROCAL_SHIFT 17
+
+// ceil(2^17 / divisor) is 2^17 / divisor plus excess / divisor, where
+// excess = divisor * reciprocal - 2^17 < divisor. Scaling |torque| by it
+// and shifting gives floor(|torque| / divisor) whenever
+// |torque| * excess < 2^17, which holds for every int16_t torque with the
+// divisors below (excess is 0, 1 and 0). The product stays under 2^32.
+#define LIMP_RECIPROCAL(divisor) \
+  (((1UL << LIMP_RECIPROCAL_SHIFT) + (divisor) - 1) / (divisor))
+
+// Indexed by limp state; CAN_LIMP_NORMAL passes torque through untouched
+static const uint32_t limp_reciprocal[] = {
+  [CAN_LIMP_50] = LIMP_RECIPROCAL(2),
+  [CAN_LIMP_33] = LIMP_RECIPROCAL(3),
+  [CAN_LIMP_25] = LIMP_RECIPROCAL(4),
+};
+
+#define LIMP_RECIPROCAL_LENGTH (sizeof(limp_reciprocal) / sizeof(limp_reciprocal[0]))
 
 int16_t int16_min(int16_t x, int16_t y) {
   if (x < y) {
@@ -118,68 +190,72 @@ int16_t apply_torque_ramp(int16_t motor_speed, int16_t requested_torque) {
     motor_speed = motor_speed * -1;
   }
 
-  // If we don't need to limit, return the regular torque
-  if (motor_speed >= SPEED_TOP_CUTOFF_ACTUAL) {
-    return requested_torque;
-  }
-
-  // If we are going below the baseline, return at most baseline torque
-  if (motor_speed <= SPEED_BOTTOM_CUTOFF_ACTUAL) {
-    const int16_t min_applied_torque =
-        int16_min(requested_torque, TORQUE_BOTTOM_CUTOFF_ACTUAL);
-    return min_applied_torque;
+  uint8_t i;
+  for (i = 0; i < TORQUE_RAMP_LENGTH; i++) {
+    const Ramp_Segment_T *segment = &torque_ramp[i];
+    if (motor_speed < segment->line.upper_bound) {
+      const int16_t max_allowable_torque =
+          segment->base_torque + Transform_linear_apply(&segment->line, motor_speed);
+      return int16_min(requested_torque, max_allowable_torque);
+    }
   }
 
-  // How much faster than baseline are we going?
-  uint32_t speed_ramp_width = motor_speed - SPEED_BOTTOM_CUTOFF_ACTUAL;
+  // If we don't need to limit, return the regular torque
+  return requested_torque;
+}
 
-  // Sanity check
-  if (speed_ramp_width > SPEED_WIDTH_ACTUAL) {
-    speed_ramp_width = SPEED_WIDTH_ACTUAL;
-    Serial_Println("BUG: SPEED_WIDTH");
+int16_t apply_limp(Can_Vcu_LimpState_T limp, int16_t torque) {
+  if (limp == CAN_LIMP_NORMAL || (uint32_t)limp >= LIMP_RECIPROCAL_LENGTH) {
+    return torque;
   }
 
-  // How much more torque than baseline can we apply?
-  uint32_t torque_ramp_height = speed_ramp_width * TORQUE_HEIGHT_ACTUAL / SPEED_WIDTH_ACTUAL;
+  // Divide the magnitude and put the sign back, which truncates toward
+  // zero like torque / divisor
+  const uint32_t magnitude = torque < 0 ? -(int32_t)torque : torque;
+  const int16_t scaled =
+      (int16_t)((magnitude * limp_reciprocal[limp]) >> LIMP_RECIPROCAL_SHIFT);
+  return torque < 0 ? -scaled : scaled;
+}
 
-  // How much torque can we apply at all?
-  uint32_t max_allowable_torque = TORQUE_BOTTOM_CUTOFF_ACTUAL + torque_ramp_height;
+void write_can_driver_output(Input_T *input, Rules_State_T *rules) {
+  Driver_Output_Cache_T *cache = &driver_output_cache;
+  stats.driver_outputs++;
 
-  // Sanity check
-  if (max_allowable_torque > MAX_INT_16) {
-    torque_ramp_height = MAX_INT_16;
-    Serial_Println("BUG: TORQUE_WIDTH");
+  if (!driver_output_current(input, rules)) {
+    cache->msg = compute_driver_output(input, rules);
+    uint8_t source;
+    for (source = 0; source < INPUT_SOURCES; source++) {
+      cache->generation[source] = input->generation[source];
+    }
+    cache->implausible = rules->implausibility_reported;
+    cache->conflict = rules->has_conflict;
+    cache->valid = true;
+    stats.driver_outputs_computed++;
   }
 
-  const int16_t max_requested_torque =
-      int16_min(requested_torque, max_allowable_torque);
-
-  return max_requested_torque;
+  CanTx_queue_driver_output(&cache->msg, input->derived->adc_sampled_us);
 }
 
-int16_t apply_limp(Can_Vcu_LimpState_T limp, int16_t torque) {
-  switch(limp) {
-    case CAN_LIMP_50:
-      return torque / 2;
-      break;
-    case CAN_LIMP_33:
-      return torque / 3;
-      break;
-    case CAN_LIMP_25:
-      return torque / 4;
-      break;
-    case CAN_LIMP_NORMAL:
-    default:
-      return torque;
-      break;
+bool driver_output_current(Input_T *input, Rules_State_T *rules) {
+  const Driver_Output_Cache_T *cache = &driver_output_cache;
+  if (!cache->valid ||
+      cache->implausible != rules->implausibility_reported ||
+      cache->conflict != rules->has_conflict) {
+    return false;
   }
+  uint8_t source;
+  for (source = 0; source < INPUT_SOURCES; source++) {
+    if (cache->generation[source] != input->generation[source]) {
+      return false;
+    }
+  }
+  return true;
 }
 
-Can_ErrorID_T write_can_driver_output(Input_T *input, Rules_State_T *rules) {
+Can_FrontCanNode_DriverOutput_T compute_driver_output(Input_T *input, Rules_State_T *rules) {
   Adc_Input_T *adc = input->adc;
-  uint16_t accel_1 = Transform_accel_1(adc->accel_1_raw, TWO_BYTE_MAX);
-  uint16_t accel_2 = Transform_accel_2(adc->accel_2_raw, TWO_BYTE_MAX);
-  uint16_t accel = min(accel_1, accel_2);
+  Derived_Input_T *derived = input->derived;
+  uint16_t accel = derived->accel_torque;
 
   uint16_t brake = adc->brake_1_raw;
   bool implausible = rules->implausibility_reported;
@@ -200,7 +276,7 @@ Can_ErrorID_T write_can_driver_output(Input_T *input, Rules_State_T *rules) {
 
   msg.torque = controlled_torque;
 
-  msg.brake_pressure = scale(brake, TEN_BIT_MAX, BYTE_MAX);
+  msg.brake_pressure = derived->brake_pressure;
   msg.throttle_implausible = implausible;
   msg.brake_throttle_conflict = conflict;
 
@@ -223,9 +299,9 @@ Can_ErrorID_T write_can_driver_output(Input_T *input, Rules_State_T *rules) {
     /* uint16_t brake_min = 350; */
     /* uint16_t brake_min_scaled = brake_min + lv_voltage * 3 / 2; */
     /* brake_engaged_threshold = brake_min_scaled + 50; */
-    brake_engaged_threshold = 260;
+    brake_engaged_threshold = brake_engaged_hv_raw;
   } else {
-    brake_engaged_threshold = 220;
+    brake_engaged_threshold = brake_engaged_lv_raw;
   }
 
   msg.brake_engaged = brake > brake_engaged_threshold;
@@ -241,10 +317,10 @@ Can_ErrorID_T write_can_driver_output(Input_T *input, Rules_State_T *rules) {
   /* Serial_Print(msg.throttle_implausible ? "true" : "false"); */
   /* Serial_Print(", conflict: "); */
   /* Serial_Println(msg.brake_throttle_conflict ? "true" : "false"); */
-  return Can_FrontCanNode_DriverOutput_Write(&msg);
+  return msg;
 }
 
-Can_ErrorID_T write_can_raw_values(Adc_Input_T *adc) {
+void write_can_raw_values(Adc_Input_T *adc) {
   Can_FrontCanNode_RawValues_T msg;
 
   msg.accel_1_raw = adc->accel_1_raw;
@@ -252,10 +328,10 @@ Can_ErrorID_T write_can_raw_values(Adc_Input_T *adc) {
   msg.brake_1_raw = adc->brake_1_raw;
   msg.brake_2_raw = adc->brake_2_raw;
 
-  return Can_FrontCanNode_RawValues_Write(&msg);
+  CanTx_queue_raw_values(&msg, adc->sampled_us);
 }
 
-Can_ErrorID_T write_can_wheel_speed(Speed_Input_T *speed) {
+void write_can_wheel_speed(Speed_Input_T *speed) {
   Can_FrontCanNode_WheelSpeed_T msg;
 
   uint8_t wheel;
@@ -270,29 +346,133 @@ Can_ErrorID_T write_can_wheel_speed(Speed_Input_T *speed) {
       *ptr = 0;
       continue;
     }
-    if (speed->tick_count[wheel] < NUM_TEETH) {
-      *ptr = click_time_to_mRPM(speed->tick_us[wheel]);
-    } else {
-      *ptr = click_time_to_mRPM(speed->moving_avg_us[wheel]);
+    *ptr = Transform_click_time_to_mRPM(speed->period_us[wheel]);
+  }
+
+  CanTx_queue_wheel_speed(&msg, Clock_us());
+}
+
+void write_can_energy(Energy_Input_T *energy) {
+  Frame frame;
+
+  Energy_summary_frame(energy, &frame);
+
+  CanTx_queue_energy(&frame, Clock_us());
+}
+
+void process_logging(Input_T *input, State_T *state, Logging_Output_T *logging) {
+  if (logging->write_throttle_log) {
+    logging->write_throttle_log = false;
+    write_log_throttle(input, state->rules);
+  }
+  if (logging->write_brake_log) {
+    logging->write_brake_log = false;
+    write_log_brake(input, state->rules);
+  }
+  uint8_t i;
+  for (i = 0; i < CS_VALUES_LENGTH; i++) {
+    if (logging->write_cs_log[i]) {
+      logging->write_cs_log[i] = false;
+      write_log_current_sensor(input, i);
     }
   }
+  if (logging->write_mc_data_log) {
+    logging->write_mc_data_log = false;
+    write_log_mc_data(input);
+  }
+  if (logging->write_mc_state_log) {
+    logging->write_mc_state_log = false;
+    write_log_mc_state(input);
+  }
+  if (logging->write_latency_log) {
+    logging->write_latency_log = false;
+    write_log_latency(input);
+  }
+#if LOOP_TIMING
+  if (logging->write_loop_timing_log) {
+    logging->write_loop_timing_log = false;
+    write_log_loop_timing(input);
+  }
+#endif
+}
+
+// A full serial ring drops the record, which the decoder sees as a gap in
+// the sequence numbers, so the write results are not checked here
+
+void write_log_throttle(Input_T *input, Rules_State_T *rules) {
+  Telemetry_Throttle_T record;
 
-  return Can_FrontCanNode_WheelSpeed_Write(&msg);
+  record.accel_1_raw = input->adc->accel_1_raw;
+  record.accel_2_raw = input->adc->accel_2_raw;
+  record.accel_1_travel = input->derived->accel_1_travel;
+  record.accel_2_travel = input->derived->accel_2_travel;
+  record.accel_torque = input->derived->accel_torque;
+  record.flags = 0;
+  if (rules->implausibility_observed) {
+    record.flags |= TELEMETRY_THROTTLE_IMPLAUSIBILITY_OBSERVED;
+  }
+  if (rules->implausibility_reported) {
+    record.flags |= TELEMETRY_THROTTLE_IMPLAUSIBILITY_REPORTED;
+  }
+
+  Telemetry_write_throttle(input->msTicks, &record);
 }
 
-uint32_t click_time_to_mRPM(uint32_t us_per_click) {
-  const float us_per_rev = us_per_click * 1.0 * NUM_TEETH;
+void write_log_brake(Input_T *input, Rules_State_T *rules) {
+  Telemetry_Brake_T record;
 
-  const float s_per_rev = us_per_rev / MICROSECONDS_PER_SECOND_F;
+  record.brake_1_raw = input->adc->brake_1_raw;
+  record.brake_2_raw = input->adc->brake_2_raw;
+  record.brake_pressure = input->derived->brake_pressure;
+  record.flags = rules->has_conflict ? TELEMETRY_BRAKE_CONFLICT : 0;
 
-  const float mrev_per_s = MILLIREVS_PER_REV_F / s_per_rev;
+  Telemetry_write_brake(input->msTicks, &record);
+}
 
-  const float mrev_per_min = mrev_per_s * SECONDS_PER_MINUTE;
-  return (uint32_t)mrev_per_min;
+void write_log_current_sensor(Input_T *input, Current_Sensor_Values_T value) {
+  Telemetry_Current_Sensor_T record;
+
+  record.value = input->current_sensor->data[value];
+  record.last_updated = input->current_sensor->last_updated[value];
+
+  Telemetry_write_current_sensor(input->msTicks, TELEMETRY_CS_VOLTAGE + value, &record);
 }
 
-void process_logging(Input_T *input, State_T *state, Logging_Output_T *logging) {
-  UNUSED(input);
-  UNUSED(state);
-  UNUSED(logging);
+void write_log_mc_data(Input_T *input) {
+  Telemetry_Mc_Data_T record;
+
+  record.motor_speed = input->mc->motor_speed;
+  record.last_updated = input->mc->last_updated;
+
+  Telemetry_write_mc_data(input->msTicks, &record);
+}
+
+void write_log_mc_state(Input_T *input) {
+  Telemetry_Mc_State_T record;
+
+  record.limp_state = input->misc->limp_state;
+  record.flags = input->misc->hv_enabled ? TELEMETRY_MC_STATE_HV_ENABLED : 0;
+  record.lv_voltage = input->misc->lv_voltage;
+  record.last_updated = input->misc->last_updated;
+
+  Telemetry_write_mc_state(input->msTicks, &record);
+}
+
+void write_log_latency(Input_T *input) {
+  Telemetry_write_latency(input->msTicks, Latency_get_stats());
+}
+
+#if LOOP_TIMING
+// Stages take turns, since the four records together would not fit in the
+// serial ring alongside everything else
+void write_log_loop_timing(Input_T *input) {
+  static LoopTiming_Stage_T stage = 0;
+
+  Telemetry_write_loop_timing(input->msTicks, stage, LoopTiming_get_stats(stage));
+
+  stage++;
+  if (stage == LOOP_TIMING_STAGE_COUNT) {
+    stage = 0;
+  }
 }
+#endif
@@ -1,11 +1,28 @@
 #include "Serial.h"
 
-#include <stdlib.h>
-#include <string.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "chip.h"
 
+// Bytes the UART takes per THRE interrupt
+#define UART_TX_FIFO_SIZE 16
+
+// Enough for a 32 bit number in base 2
+#define MAX_DIGITS 32
+
+// Filled by the main loop, drained by UART_IRQHandler. The producer masks
+// the THRE interrupt while it touches the ring, so the two never overlap.
+static char tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+
+static Serial_Drop_Policy_T drop_policy = SERIAL_DROP_NEWEST;
+static Serial_Stats_T stats;
+
+void fill_tx_fifo(void);
+uint8_t format_number(uint32_t n, uint32_t base, char *end);
+
 void Serial_Init(uint32_t baudrate) {
   Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_6, (IOCON_FUNC1 | IOCON_MODE_INACT)); /* RXD */
   Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_7, (IOCON_FUNC1 | IOCON_MODE_INACT)); /* TXD */
@@ -16,28 +33,145 @@ void Serial_Init(uint32_t baudrate) {
   Chip_UART_ConfigData(LPC_USART, (UART_LCR_WLEN8 | UART_LCR_SBS_1BIT | UART_LCR_PARITY_DIS));
   Chip_UART_SetupFIFOS(LPC_USART, (UART_FCR_FIFO_EN | UART_FCR_TRG_LEV2));
   Chip_UART_TXEnable(LPC_USART);
+
+  // THRE is only enabled while there is something to send
+  Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+  NVIC_EnableIRQ(UART0_IRQn);
+}
+
+void Serial_SetDropPolicy(Serial_Drop_Policy_T policy) {
+  drop_policy = policy;
+}
+
+const Serial_Stats_T *Serial_GetStats(void) {
+  return &stats;
+}
+
+void UART_IRQHandler(void) {
+  fill_tx_fifo();
+  if (tx_tail == tx_head) {
+    Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+  }
+}
+
+uint32_t Serial_Write(const char *data, uint32_t len) {
+  uint32_t queued = len;
+
+  Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+
+  uint32_t used = tx_head - tx_tail;
+  if (len > SERIAL_TX_RING_SIZE - used) {
+    if (drop_policy == SERIAL_DROP_NEWEST || len > SERIAL_TX_RING_SIZE) {
+      stats.dropped_writes++;
+      stats.dropped_bytes += len;
+      queued = 0;
+    } else {
+      const uint32_t overwritten = len - (SERIAL_TX_RING_SIZE - used);
+      tx_tail += overwritten;
+      used -= overwritten;
+      stats.dropped_bytes += overwritten;
+    }
+  }
+
+  uint32_t head = tx_head;
+  uint32_t i;
+  for (i = 0; i < queued; i++) {
+    tx_ring[head & SERIAL_TX_RING_MASK] = data[i];
+    head++;
+  }
+  tx_head = head;
+
+  stats.queued_bytes += queued;
+  if (used + queued > stats.high_water) {
+    stats.high_water = used + queued;
+  }
+
+  // If the transmitter is idle THRE will not fire on its own, so start it
+  // off here and let the interrupt take the rest
+  fill_tx_fifo();
+  if (tx_tail != tx_head) {
+    Chip_UART_IntEnable(LPC_USART, UART_IER_THREINT);
+  }
+  return queued;
 }
 
 uint32_t Serial_Print(const char *str) {
-  return Chip_UART_SendBlocking(LPC_USART, str, strlen(str));
+  uint32_t len = 0;
+  while (str[len] != '\0') {
+    len++;
+  }
+  return Serial_Write(str, len);
 }
 
 void Serial_Print_Void(const char *str) {
-  Chip_UART_SendBlocking(LPC_USART, str, strlen(str));
+  Serial_Print(str);
 }
+
 uint32_t Serial_Println(const char *str) {
   uint32_t count = Serial_Print(str);
-  return count + Serial_Print("\r\n");
+  return count + Serial_Write("\r\n", 2);
 }
 
 uint32_t Serial_PrintNumber(uint32_t n, uint32_t base) {
-  const uint8_t max_digits = 33;
-  char n_str[max_digits];
-  itoa(n, n_str, base);
-  return Serial_Print(n_str);
+  char n_str[MAX_DIGITS];
+  char *end = n_str + MAX_DIGITS;
+  const uint8_t len = format_number(n, base, end);
+  return Serial_Write(end - len, len);
 }
 
 uint32_t Serial_PrintlnNumber(uint32_t n, uint32_t base) {
-  uint32_t count = Serial_PrintNumber(n, base);
-  return count + Serial_Print("\r\n");
+  char n_str[MAX_DIGITS + 2];
+  char *end = n_str + MAX_DIGITS;
+  const uint8_t len = format_number(n, base, end);
+  end[0] = '\r';
+  end[1] = '\n';
+  // One write, so a full ring drops the number and its line ending together
+  return Serial_Write(end - len, len + 2);
+}
+
+// Moves up to a FIFO's worth of bytes into the UART. Called with THRE
+// masked or from its interrupt.
+void fill_tx_fifo(void) {
+  if ((Chip_UART_ReadLineStatus(LPC_USART) & UART_LSR_THRE) == 0) {
+    return;
+  }
+  uint32_t tail = tx_tail;
+  uint8_t sent;
+  for (sent = 0; sent < UART_TX_FIFO_SIZE && tail != tx_head; sent++) {
+    Chip_UART_SendByte(LPC_USART, tx_ring[tail & SERIAL_TX_RING_MASK]);
+    tail++;
+  }
+  tx_tail = tail;
+}
+
+// Writes the digits of n backwards so they end just before end, and returns
+// how many there are. Power of two bases shift instead of dividing, which
+// the M0 has to do in software.
+uint8_t format_number(uint32_t n, uint32_t base, char *end) {
+  static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  uint8_t len = 0;
+
+  if (base < 2 || base > 36) {
+    base = 10;
+  }
+
+  if ((base & (base - 1)) == 0) {
+    uint8_t shift = 0;
+    while ((1UL << shift) != base) {
+      shift++;
+    }
+    do {
+      *--end = digits[n & (base - 1)];
+      n >>= shift;
+      len++;
+    } while (n != 0);
+  } else {
+    do {
+      const uint32_t q = n / base;
+      *--end = digits[n - q * base];
+      n = q;
+      len++;
+    } while (n != 0);
+  }
+  return len;
 }
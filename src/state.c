@@ -1,78 +1,178 @@
 #include "State.h"
 
+#include "Calibration.h"
 #include "Common.h"
 #include "Rules.h"
 #include "Transform.h"
 
-#define DRIVER_OUTPUT_MSG_MS 20
-#define RAW_VALUES_MSG_MS 100
-#define WHEEL_SPEED_MSG_MS 20
-
-void update_can_state(Input_T *input, State_T *state, Output_T *output);
-
-bool period_reached(uint32_t start, uint32_t period, uint32_t msTicks);
-void update_can_driver_output(Message_State_T *state, Can_Output_T *output, uint32_t msTicks);
-void update_can_raw_values(Message_State_T *state, Can_Output_T *output, uint32_t msTicks);
-void update_can_wheel_speed(Message_State_T *state, Can_Output_T *output, uint32_t msTicks);
+void update_message_state(Input_T *input, State_T *state, Output_T *output);
+
+bool *can_driver_output_flag(Output_T *output);
+bool *can_raw_values_flag(Output_T *output);
+bool *can_wheel_speed_flag(Output_T *output);
+bool *can_energy_flag(Output_T *output);
+bool *logging_throttle_flag(Output_T *output);
+bool *logging_brake_flag(Output_T *output);
+bool *logging_mc_data_flag(Output_T *output);
+bool *logging_cs_voltage_flag(Output_T *output);
+bool *logging_cs_current_flag(Output_T *output);
+bool *logging_cs_power_flag(Output_T *output);
+bool *logging_cs_energy_flag(Output_T *output);
+bool *logging_mc_state_flag(Output_T *output);
+bool *logging_latency_flag(Output_T *output);
+#if LOOP_TIMING
+bool *logging_loop_timing_flag(Output_T *output);
+#endif
+
+// Phases spread the 20 ms frames and the slower outputs over different ticks
+// so that no single pass has to send everything. In RAM so that a new
+// calibration can change the periods.
+static Scheduler_Entry_T message_schedule[MESSAGE_LENGTH] = {
+  [MESSAGE_CAN_DRIVER_OUTPUT] = { CALIBRATION_DEFAULT_DRIVER_OUTPUT_MSG_MS, 0 },
+  [MESSAGE_CAN_RAW_VALUES] = { CALIBRATION_DEFAULT_RAW_VALUES_MSG_MS, 5 },
+  [MESSAGE_CAN_WHEEL_SPEED] = { CALIBRATION_DEFAULT_WHEEL_SPEED_MSG_MS, 10 },
+  [MESSAGE_CAN_ENERGY] = { CALIBRATION_DEFAULT_ENERGY_MSG_MS, 55 },
+  [MESSAGE_LOGGING_THROTTLE] = { CALIBRATION_DEFAULT_LOGGING_THROTTLE_MS, 15 },
+  [MESSAGE_LOGGING_BRAKE] = { CALIBRATION_DEFAULT_LOGGING_BRAKE_MS, 16 },
+  [MESSAGE_LOGGING_MC_DATA] = { CALIBRATION_DEFAULT_LOGGING_MC_DATA_MS, 17 },
+  [MESSAGE_LOGGING_CS_VOLTAGE] = { CALIBRATION_DEFAULT_LOGGING_CS_MS, 25 },
+  [MESSAGE_LOGGING_CS_CURRENT] = { CALIBRATION_DEFAULT_LOGGING_CS_MS, 45 },
+  [MESSAGE_LOGGING_CS_POWER] = { CALIBRATION_DEFAULT_LOGGING_CS_MS, 65 },
+  [MESSAGE_LOGGING_CS_ENERGY] = { CALIBRATION_DEFAULT_LOGGING_CS_MS, 85 },
+  [MESSAGE_LOGGING_MC_STATE] = { CALIBRATION_DEFAULT_LOGGING_MC_STATE_MS, 95 },
+  [MESSAGE_LOGGING_LATENCY] = { CALIBRATION_DEFAULT_LOGGING_LATENCY_MS, 33 },
+#if LOOP_TIMING
+  [MESSAGE_LOGGING_LOOP_TIMING] = { CALIBRATION_DEFAULT_LOGGING_LOOP_TIMING_MS, 7 },
+#endif
+};
+
+// Output flag each message raises when it falls due
+typedef bool *(*Message_Flag_Fn_T)(Output_T *output);
+
+static const Message_Flag_Fn_T message_flag[MESSAGE_LENGTH] = {
+  [MESSAGE_CAN_DRIVER_OUTPUT] = can_driver_output_flag,
+  [MESSAGE_CAN_RAW_VALUES] = can_raw_values_flag,
+  [MESSAGE_CAN_WHEEL_SPEED] = can_wheel_speed_flag,
+  [MESSAGE_CAN_ENERGY] = can_energy_flag,
+  [MESSAGE_LOGGING_THROTTLE] = logging_throttle_flag,
+  [MESSAGE_LOGGING_BRAKE] = logging_brake_flag,
+  [MESSAGE_LOGGING_MC_DATA] = logging_mc_data_flag,
+  [MESSAGE_LOGGING_CS_VOLTAGE] = logging_cs_voltage_flag,
+  [MESSAGE_LOGGING_CS_CURRENT] = logging_cs_current_flag,
+  [MESSAGE_LOGGING_CS_POWER] = logging_cs_power_flag,
+  [MESSAGE_LOGGING_CS_ENERGY] = logging_cs_energy_flag,
+  [MESSAGE_LOGGING_MC_STATE] = logging_mc_state_flag,
+  [MESSAGE_LOGGING_LATENCY] = logging_latency_flag,
+#if LOOP_TIMING
+  [MESSAGE_LOGGING_LOOP_TIMING] = logging_loop_timing_flag,
+#endif
+};
+
+static State_Stats_T stats;
 
 void State_initialize(State_T *state) {
-  state->rules->has_conflict = false;
-  state->rules->implausibility_observed = false;
-  state->rules->implausibility_reported = false;
-  state->rules->implausibility_time_ms = 0;
+  Rules_initialize(state->rules);
 
-  state->message->can_driver_output_ms = 0;
-  state->message->can_raw_values_ms = 0;
-  state->message->can_wheel_speed_ms = 0;
-  state->message->logging_throttle_ms = 0;
-  state->message->logging_brake_ms = 0;
+  Message_State_T *message = state->message;
+  Scheduler_init(&message->scheduler, message_schedule, message->tasks,
+      MESSAGE_LENGTH, 0);
 }
 
 void State_update_state(Input_T *input, State_T *state, Output_T *output) {
-  Rules_update_implausibility(input->adc, state->rules, input->msTicks);
-  Rules_update_conflict(input, state->rules);
-  update_can_state(input, state, output);
+  stats.passes++;
+  if (Rules_update(input, state->rules)) {
+    stats.rules_runs++;
+  }
+  update_message_state(input, state, output);
 }
 
-void update_can_state(Input_T *input, State_T *state, Output_T *output) {
-  Message_State_T *message = state->message;
-  Can_Output_T *can = output->can;
-  const uint32_t msTicks = input->msTicks;
+void State_set_message_periods(const uint16_t *periods_ms) {
+  // Each message picks up its new period after its next release
+  uint8_t i;
+  for (i = 0; i < MESSAGE_LENGTH; i++) {
+    message_schedule[i].period_ms = periods_ms[i];
+  }
+}
+
+uint32_t State_next_deadline(State_T *state) {
+  const uint32_t message_deadline = Scheduler_next_due(&state->message->scheduler);
+  uint32_t rules_deadline;
+  if (Rules_next_deadline(state->rules, &rules_deadline) &&
+      (int32_t)(rules_deadline - message_deadline) < 0) {
+    return rules_deadline;
+  }
+  return message_deadline;
+}
 
-  update_can_driver_output(message, can, msTicks);
-  update_can_raw_values(message, can, msTicks);
-  update_can_wheel_speed(message, can, msTicks);
+const State_Stats_T *State_get_stats(void) {
+  return &stats;
 }
 
-void update_can_driver_output(Message_State_T *message, Can_Output_T *can, uint32_t msTicks) {
-  uint32_t *last_msg = &message->can_driver_output_ms;
+void update_message_state(Input_T *input, State_T *state, Output_T *output) {
+  uint32_t due = Scheduler_poll(&state->message->scheduler, input->msTicks);
 
-  if(period_reached(*last_msg, DRIVER_OUTPUT_MSG_MS, msTicks)) {
-    *last_msg = msTicks;
-    can->send_driver_output_msg = true;
+  uint8_t i;
+  for (i = 0; due != 0; i++, due >>= 1) {
+    if (due & 1) {
+      *message_flag[i](output) = true;
+    }
   }
 }
 
-void update_can_raw_values(Message_State_T *message, Can_Output_T *can, uint32_t msTicks) {
-  uint32_t *last_msg = &message->can_raw_values_ms;
+bool *can_driver_output_flag(Output_T *output) {
+  return &output->can->send_driver_output_msg;
+}
 
-  if(period_reached(*last_msg, RAW_VALUES_MSG_MS, msTicks)) {
-    *last_msg = msTicks;
-    can->send_raw_values_msg = true;
-  }
+bool *can_raw_values_flag(Output_T *output) {
+  return &output->can->send_raw_values_msg;
 }
 
-void update_can_wheel_speed(Message_State_T *message, Can_Output_T *can, uint32_t msTicks) {
-  uint32_t *last_msg = &message->can_wheel_speed_ms;
+bool *can_wheel_speed_flag(Output_T *output) {
+  return &output->can->send_wheel_speed_msg;
+}
 
-  if(period_reached(*last_msg, WHEEL_SPEED_MSG_MS, msTicks)) {
-    *last_msg = msTicks;
-    can->send_wheel_speed_msg = true;
-  }
+bool *can_energy_flag(Output_T *output) {
+  return &output->can->send_energy_msg;
+}
+
+bool *logging_throttle_flag(Output_T *output) {
+  return &output->logging->write_throttle_log;
 }
 
-bool period_reached(uint32_t start, uint32_t period, uint32_t msTicks) {
-  const uint32_t next_time = start + period;
-  return next_time < msTicks;
+bool *logging_brake_flag(Output_T *output) {
+  return &output->logging->write_brake_log;
 }
 
+bool *logging_mc_data_flag(Output_T *output) {
+  return &output->logging->write_mc_data_log;
+}
+
+bool *logging_cs_voltage_flag(Output_T *output) {
+  return &output->logging->write_cs_log[CS_Voltage];
+}
+
+bool *logging_cs_current_flag(Output_T *output) {
+  return &output->logging->write_cs_log[CS_Current];
+}
+
+bool *logging_cs_power_flag(Output_T *output) {
+  return &output->logging->write_cs_log[CS_Power];
+}
+
+bool *logging_cs_energy_flag(Output_T *output) {
+  return &output->logging->write_cs_log[CS_Energy];
+}
+
+bool *logging_mc_state_flag(Output_T *output) {
+  return &output->logging->write_mc_state_log;
+}
+
+bool *logging_latency_flag(Output_T *output) {
+  return &output->logging->write_latency_log;
+}
+
+#if LOOP_TIMING
+bool *logging_loop_timing_flag(Output_T *output) {
+  return &output->logging->write_loop_timing_log;
+}
+#endif
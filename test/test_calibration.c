@@ -0,0 +1,150 @@
+#include "unity.h"
+
+#include <stddef.h>
+
+#include "Calibration.h"
+#include "CanTx.h"
+#include "Sim.h"
+#include "Transform.h"
+
+#define FIELD(name) (offsetof(Calibration_Values_T, name) / sizeof(uint16_t))
+
+static Frame last_reply;
+static uint32_t replies;
+
+static void capture_reply(const Sim_Can_Msg_T *msg) {
+  if (msg->type == Can_Unknown_Msg && msg->data.unknown.id == CALIBRATION_REPLY_ID) {
+    last_reply = msg->data.unknown;
+    replies++;
+  }
+}
+
+static Calibration_Status_T request(uint8_t command, uint8_t field, uint16_t value, bool hv) {
+  Frame frame;
+  frame.id = CALIBRATION_REQUEST_ID;
+  frame.len = 4;
+  frame.data[0] = command;
+  frame.data[1] = field;
+  frame.data[2] = value & 0xFF;
+  frame.data[3] = value >> 8;
+  return Calibration_handle_frame(&frame, hv);
+}
+
+void setUp(void) {
+  Sim_flash_erase();
+  CanTx_init();
+  Sim_set_can_tx_hook(capture_reply);
+  replies = 0;
+  Calibration_load();
+}
+
+void tearDown(void) {
+  Sim_set_can_tx_hook(NULL);
+  Sim_set_can_tx_error(Can_Error_NONE);
+}
+
+void test_blank_flash_uses_defaults(void) {
+  TEST_ASSERT_FALSE(Calibration_load());
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+      Calibration_get()->accel_1_upper_bound);
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW,
+      Calibration_get()->conflict_brake_raw);
+}
+
+void test_commit_stores_and_applies(void) {
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_OK,
+      request(CALIBRATION_CMD_WRITE, FIELD(accel_1_upper_bound), 600, false));
+  // Staged only
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+      Calibration_get()->accel_1_upper_bound);
+
+  const uint32_t erases = Sim_flash_erases();
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_OK, request(CALIBRATION_CMD_COMMIT, 0, 0, false));
+  TEST_ASSERT_EQUAL_UINT32(erases + 1, Sim_flash_erases());
+  TEST_ASSERT_EQUAL_UINT16(600, Calibration_get()->accel_1_upper_bound);
+  TEST_ASSERT_EQUAL_UINT16(TRANSFORM_TRAVEL_WIDTH, Transform_accel_1_travel(600));
+  TEST_ASSERT_EQUAL_UINT16(Transform_accel_1(400, TRANSFORM_TORQUE_WIDTH),
+      Transform_accel_1_torque(400));
+
+  // Survives a reboot
+  TEST_ASSERT_TRUE(Calibration_load());
+  TEST_ASSERT_EQUAL_UINT16(600, Calibration_get()->accel_1_upper_bound);
+}
+
+void test_commit_refused_with_hv_on(void) {
+  request(CALIBRATION_CMD_WRITE, FIELD(conflict_brake_raw), 500, false);
+  const uint32_t erases = Sim_flash_erases();
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_HV_ON, request(CALIBRATION_CMD_COMMIT, 0, 0, true));
+  TEST_ASSERT_EQUAL_UINT32(erases, Sim_flash_erases());
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW,
+      Calibration_get()->conflict_brake_raw);
+}
+
+void test_commit_refuses_bad_values(void) {
+  request(CALIBRATION_CMD_WRITE, FIELD(accel_2_lower_bound),
+      CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND, false);
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_INVALID, request(CALIBRATION_CMD_COMMIT, 0, 0, false));
+
+  request(CALIBRATION_CMD_DISCARD, 0, 0, false);
+  request(CALIBRATION_CMD_WRITE, FIELD(message_period_ms[0]), 0, false);
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_INVALID, request(CALIBRATION_CMD_COMMIT, 0, 0, false));
+}
+
+void test_discard_restores_staged_values(void) {
+  request(CALIBRATION_CMD_WRITE, FIELD(brake_engaged_hv_raw), 300, false);
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_OK, request(CALIBRATION_CMD_DISCARD, 0, 0, false));
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_OK,
+      request(CALIBRATION_CMD_READ, FIELD(brake_engaged_hv_raw), 0, false));
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_BRAKE_ENGAGED_HV_RAW,
+      last_reply.data[3] | last_reply.data[4] << 8);
+}
+
+void test_replies_carry_status_and_value(void) {
+  request(CALIBRATION_CMD_WRITE, FIELD(brake_engaged_lv_raw), 0x1AB, false);
+  TEST_ASSERT_EQUAL_UINT32(1, replies);
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_CMD_WRITE, last_reply.data[0]);
+  TEST_ASSERT_EQUAL_UINT8(FIELD(brake_engaged_lv_raw), last_reply.data[1]);
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_OK, last_reply.data[2]);
+  TEST_ASSERT_EQUAL_UINT8(0xAB, last_reply.data[3]);
+  TEST_ASSERT_EQUAL_UINT8(0x01, last_reply.data[4]);
+
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_BAD_FIELD,
+      request(CALIBRATION_CMD_WRITE, CALIBRATION_FIELDS, 1, false));
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_BAD_COMMAND, request(0x7F, 0, 0, false));
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_BAD_COMMAND, last_reply.data[2]);
+}
+
+void test_reply_waits_for_room_in_the_controller(void) {
+  Sim_set_can_tx_error(Can_Error_TX_BUFFER_FULL);
+  request(CALIBRATION_CMD_READ, FIELD(conflict_brake_raw), 0, false);
+  TEST_ASSERT_EQUAL_UINT32(0, replies);
+
+  Sim_set_can_tx_error(Can_Error_NONE);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(1, replies);
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_CMD_READ, last_reply.data[0]);
+}
+
+void test_damaged_block_falls_back_to_defaults(void) {
+  request(CALIBRATION_CMD_WRITE, FIELD(accel_1_lower_bound), 120, false);
+  TEST_ASSERT_EQUAL_INT(CALIBRATION_OK, request(CALIBRATION_CMD_COMMIT, 0, 0, false));
+
+  // Flip a bit inside the values
+  Sim_flash()[8] ^= 0x01;
+  TEST_ASSERT_FALSE(Calibration_load());
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND,
+      Calibration_get()->accel_1_lower_bound);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_flash_uses_defaults);
+  RUN_TEST(test_commit_stores_and_applies);
+  RUN_TEST(test_commit_refused_with_hv_on);
+  RUN_TEST(test_commit_refuses_bad_values);
+  RUN_TEST(test_discard_restores_staged_values);
+  RUN_TEST(test_replies_carry_status_and_value);
+  RUN_TEST(test_reply_waits_for_room_in_the_controller);
+  RUN_TEST(test_damaged_block_falls_back_to_defaults);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+#include "unity.h"
+
+#include "CanHealth.h"
+#include "Sim.h"
+
+// Enough transmit errors to push the error counter past 255
+#define BUS_OFF_ERRORS 32
+// Past 127, error passive but still on the bus
+#define PASSIVE_ERRORS 16
+
+// Carries on across tests, so that a disturbance one test leaves behind is
+// over by the time the next one starts
+static uint32_t now_ms = 1000;
+
+// One SysTick every simulated millisecond up to until_ms
+static void run_until(uint32_t until_ms) {
+  while (now_ms < until_ms) {
+    now_ms++;
+    Sim_set_now_us((uint64_t)now_ms * 1000);
+    CanHealth_isr_update(now_ms);
+  }
+}
+
+// First ms at which the state machine is in the given state, or UINT32_MAX
+static uint32_t run_until_state(CanHealth_State_T state, uint32_t limit_ms) {
+  while (now_ms < limit_ms) {
+    run_until(now_ms + 1);
+    if (CanHealth_state() == state) {
+      return now_ms;
+    }
+  }
+  return UINT32_MAX;
+}
+
+void setUp(void) {
+  run_until(now_ms + 1000);
+  Can_Init(500000);
+  CanHealth_init();
+}
+
+void tearDown(void) {
+}
+
+void test_error_passive_keeps_transmitting(void) {
+  Sim_can_error_burst(PASSIVE_ERRORS, 0);
+  run_until(now_ms + 1);
+  TEST_ASSERT_EQUAL_INT(CAN_HEALTH_ERROR_PASSIVE, CanHealth_state());
+  TEST_ASSERT_TRUE(CanHealth_can_transmit());
+  run_until(now_ms + 5);
+  TEST_ASSERT_EQUAL_UINT32(1, CanHealth_get_stats()->error_passive_entries);
+}
+
+void test_bus_off_waits_out_the_backoff_then_recovers(void) {
+  Sim_can_error_burst(BUS_OFF_ERRORS, 0);
+  const uint32_t bus_off_ms = now_ms + 1;
+  run_until(bus_off_ms);
+  TEST_ASSERT_EQUAL_INT(CAN_HEALTH_BUS_OFF, CanHealth_state());
+  TEST_ASSERT_FALSE(CanHealth_can_transmit());
+
+  // Nothing is asked of the controller until the backoff is over
+  run_until(bus_off_ms + CAN_HEALTH_BACKOFF_MIN_MS - 1);
+  TEST_ASSERT_EQUAL_INT(CAN_HEALTH_BUS_OFF, CanHealth_state());
+  run_until(bus_off_ms + CAN_HEALTH_BACKOFF_MIN_MS);
+  TEST_ASSERT_EQUAL_INT(CAN_HEALTH_RECOVERING, CanHealth_state());
+
+  // The sequence itself is under 3 ms at 500 kbit/s
+  const uint32_t active_ms = run_until_state(CAN_HEALTH_ERROR_ACTIVE, bus_off_ms + 50);
+  TEST_ASSERT_TRUE(active_ms <= bus_off_ms + CAN_HEALTH_BACKOFF_MIN_MS + 4);
+  TEST_ASSERT_TRUE(CanHealth_can_transmit());
+
+  const CanHealth_Stats_T *stats = CanHealth_get_stats();
+  TEST_ASSERT_EQUAL_UINT32(1, stats->bus_offs);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->recoveries);
+  TEST_ASSERT_EQUAL_UINT32(active_ms - bus_off_ms, stats->recover_max_ms);
+  TEST_ASSERT_EQUAL_UINT32(active_ms - bus_off_ms, CanHealth_mean_recover_ms());
+}
+
+void test_disturbed_bus_times_out_and_backs_off(void) {
+  // Still disturbed well past the first attempt
+  Sim_can_error_burst(BUS_OFF_ERRORS, 300 * 1000);
+  const uint32_t bus_off_ms = now_ms + 1;
+  run_until(bus_off_ms + CAN_HEALTH_BACKOFF_MIN_MS + CAN_HEALTH_RECOVERY_TIMEOUT_MS);
+  TEST_ASSERT_EQUAL_INT(CAN_HEALTH_BUS_OFF, CanHealth_state());
+  TEST_ASSERT_EQUAL_UINT32(1, CanHealth_get_stats()->recovery_timeouts);
+  TEST_ASSERT_EQUAL_UINT32(CAN_HEALTH_BACKOFF_MIN_MS * 2, CanHealth_get_stats()->backoff_ms);
+
+  const uint32_t active_ms = run_until_state(CAN_HEALTH_ERROR_ACTIVE, bus_off_ms + 1000);
+  TEST_ASSERT_TRUE(active_ms != UINT32_MAX);
+  TEST_ASSERT_TRUE(active_ms > bus_off_ms + 300);
+  TEST_ASSERT_EQUAL_UINT32(1, CanHealth_get_stats()->recoveries);
+}
+
+void test_repeated_bus_off_doubles_the_backoff(void) {
+  uint32_t expected_ms = CAN_HEALTH_BACKOFF_MIN_MS;
+  uint8_t i;
+  for (i = 0; i < 10; i++) {
+    Sim_can_error_burst(BUS_OFF_ERRORS, 0);
+    run_until(now_ms + 1);
+    TEST_ASSERT_EQUAL_UINT32(expected_ms, CanHealth_get_stats()->backoff_ms);
+    TEST_ASSERT_TRUE(run_until_state(CAN_HEALTH_ERROR_ACTIVE, now_ms + 2000) != UINT32_MAX);
+    expected_ms = expected_ms * 2 > CAN_HEALTH_BACKOFF_MAX_MS ?
+      CAN_HEALTH_BACKOFF_MAX_MS : expected_ms * 2;
+  }
+
+  // A quiet spell and the next bus-off starts from the minimum again
+  run_until(now_ms + CAN_HEALTH_STABLE_MS);
+  Sim_can_error_burst(BUS_OFF_ERRORS, 0);
+  run_until(now_ms + 1);
+  TEST_ASSERT_EQUAL_UINT32(CAN_HEALTH_BACKOFF_MIN_MS, CanHealth_get_stats()->backoff_ms);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_error_passive_keeps_transmitting);
+  RUN_TEST(test_bus_off_waits_out_the_backoff_then_recovers);
+  RUN_TEST(test_disturbed_bus_times_out_and_backs_off);
+  RUN_TEST(test_repeated_bus_off_doubles_the_backoff);
+  return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include "unity.h"
+
+#include <string.h>
+
+#include "Calibration.h"
+#include "CanHealth.h"
+#include "CanRx.h"
+#include "Sim.h"
+
+static uint32_t now_ms = 0;
+
+static void put_unknown(uint16_t id) {
+  Sim_Can_Msg_T frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.type = Can_Unknown_Msg;
+  frame.data.unknown.id = id;
+  Sim_can_receive(&frame);
+}
+
+static void put_typed(Can_MsgID_T type) {
+  Sim_Can_Msg_T frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.type = type;
+  Sim_can_receive(&frame);
+}
+
+static uint32_t drain(void) {
+  uint32_t count = 0;
+  CanRx_Msg_T msg;
+  while (CanRx_pop(&msg)) {
+    count++;
+  }
+  return count;
+}
+
+void setUp(void) {
+  Can_Init(500000);
+  CanRx_init();
+  CanHealth_init();
+  drain();
+}
+
+void tearDown(void) {
+}
+
+void test_subscribed_frames_are_read(void) {
+  put_typed(Can_Vcu_DashHeartbeat_Msg);
+  put_typed(Can_MC_DataReading_Msg);
+  put_typed(Can_CurrentSensor_Voltage_Msg);
+  put_typed(Can_CurrentSensor_Current_Msg);
+  put_typed(Can_CurrentSensor_Power_Msg);
+  put_typed(Can_CurrentSensor_Energy_Msg);
+  TEST_ASSERT_EQUAL_UINT32(6, CanRx_isr_receive(now_ms++));
+  TEST_ASSERT_EQUAL_UINT32(6, drain());
+}
+
+void test_other_traffic_never_reaches_the_cpu(void) {
+  const uint32_t filtered = Sim_can_stats()->rx_filtered;
+  uint16_t id;
+  for (id = 0x300; id < 0x308; id++) {
+    put_unknown(id);
+  }
+  // Off by one bit from a subscribed ID
+  put_unknown(VCU_DASH_HEARTBEAT__id ^ 1);
+  TEST_ASSERT_EQUAL_UINT32(0, Sim_can_rx_pending());
+  TEST_ASSERT_EQUAL_UINT32(0, CanRx_isr_receive(now_ms++));
+  TEST_ASSERT_EQUAL_UINT32(9, Sim_can_stats()->rx_filtered - filtered);
+}
+
+void test_calibration_requests_get_through(void) {
+  put_unknown(0x300);
+  put_unknown(CALIBRATION_REQUEST_ID);
+  TEST_ASSERT_EQUAL_UINT32(1, CanRx_isr_receive(now_ms++));
+
+  CanRx_Msg_T msg;
+  TEST_ASSERT_TRUE(CanRx_pop(&msg));
+  TEST_ASSERT_EQUAL_INT(Can_Unknown_Msg, msg.type);
+  TEST_ASSERT_EQUAL_UINT16(CALIBRATION_REQUEST_ID, msg.data.unknown.id);
+}
+
+void test_recovery_closes_a_reopened_catch_all(void) {
+  // As if the library had set itself up again
+  CCAN_MSG_OBJ_T obj;
+  obj.msgobj = CAN_LIBRARY_RX_MSGOBJ;
+  obj.mode_id = CAN_MSGOBJ_STD;
+  obj.mask = 0;
+  LPC_CCAN_API->config_rxmsgobj(&obj);
+  put_unknown(0x300);
+  TEST_ASSERT_EQUAL_UINT32(1, CanRx_isr_receive(now_ms++));
+  drain();
+
+  Sim_can_error_burst(32, 0);
+  uint32_t limit_ms = now_ms + 1000;
+  while (CanHealth_get_stats()->recoveries == 0 && now_ms < limit_ms) {
+    now_ms++;
+    Sim_set_now_us((uint64_t)now_ms * 1000);
+    CanHealth_isr_update(now_ms);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, CanHealth_get_stats()->recoveries);
+
+  put_unknown(0x300);
+  put_typed(Can_Vcu_DashHeartbeat_Msg);
+  TEST_ASSERT_EQUAL_UINT32(1, CanRx_isr_receive(now_ms++));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_subscribed_frames_are_read);
+  RUN_TEST(test_other_traffic_never_reaches_the_cpu);
+  RUN_TEST(test_calibration_requests_get_through);
+  RUN_TEST(test_recovery_closes_a_reopened_catch_all);
+  return UNITY_END();
+}
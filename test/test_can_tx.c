@@ -0,0 +1,228 @@
+#include "unity.h"
+
+#include <string.h>
+
+#include "CanHealth.h"
+#include "CanTx.h"
+#include "Clock.h"
+#include "Sim.h"
+
+#define MAX_SENT 8
+
+static Sim_Can_Msg_T sent[MAX_SENT];
+static uint32_t sent_count;
+static bool drain_from_hook;
+
+static void capture(const Sim_Can_Msg_T *msg) {
+  if (sent_count < MAX_SENT) {
+    sent[sent_count] = *msg;
+  }
+  sent_count++;
+  if (drain_from_hook) {
+    // SysTick going off in the middle of a main loop write
+    CanTx_isr_drain();
+  }
+}
+
+// Clock_us goes by msTicks plus SysTick's count within the millisecond
+static void set_now_us(uint64_t now_us) {
+  Sim_set_now_us(now_us);
+  msTicks = now_us / 1000;
+}
+
+static void queue_driver_output(int16_t torque) {
+  Can_FrontCanNode_DriverOutput_T msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.torque = torque;
+  CanTx_queue_driver_output(&msg, Clock_us());
+}
+
+static void queue_raw_values(uint16_t accel_1_raw) {
+  Can_FrontCanNode_RawValues_T msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.accel_1_raw = accel_1_raw;
+  CanTx_queue_raw_values(&msg, Clock_us());
+}
+
+static void queue_wheel_speed(uint32_t left_mRPM) {
+  Can_FrontCanNode_WheelSpeed_T msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.front_left_wheel_speed_mRPM = left_mRPM;
+  CanTx_queue_wheel_speed(&msg, Clock_us());
+}
+
+void setUp(void) {
+  Can_Init(500000);
+  CanHealth_init();
+  CanTx_init();
+  Sim_set_can_tx_error(Can_Error_NONE);
+  Sim_set_can_tx_hook(capture);
+  sent_count = 0;
+  drain_from_hook = false;
+}
+
+void tearDown(void) {
+  Sim_set_can_tx_hook(NULL);
+  Sim_set_can_tx_error(Can_Error_NONE);
+}
+
+void test_flush_sends_in_priority_order(void) {
+  queue_wheel_speed(1);
+  queue_raw_values(2);
+  queue_driver_output(3);
+  CanTx_flush();
+
+  TEST_ASSERT_EQUAL_UINT32(3, sent_count);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_DriverOutput_Msg, sent[0].type);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_RawValues_Msg, sent[1].type);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_WheelSpeed_Msg, sent[2].type);
+
+  // Nothing is sent twice
+  CanTx_flush();
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(3, sent_count);
+}
+
+void test_full_controller_keeps_only_the_latest_frame(void) {
+  const CanTx_Stats_T before = *CanTx_get_stats();
+  const uint32_t resets = Sim_can_stats()->resets;
+
+  Sim_set_can_tx_error(Can_Error_TX_BUFFER_FULL);
+  queue_driver_output(10);
+  CanTx_flush();
+  queue_driver_output(20);
+  CanTx_flush();
+  queue_driver_output(30);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(0, sent_count);
+
+  // Room again: the interrupt gets the newest value out without the main
+  // loop, and a full buffer is no reason to reset
+  Sim_set_can_tx_error(Can_Error_NONE);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(1, sent_count);
+  TEST_ASSERT_EQUAL_INT16(30, sent[0].data.driver_output.torque);
+
+  const CanTx_Stats_T *after = CanTx_get_stats();
+  TEST_ASSERT_EQUAL_UINT32(3, after->queued - before.queued);
+  TEST_ASSERT_EQUAL_UINT32(1, after->sent - before.sent);
+  TEST_ASSERT_EQUAL_UINT32(2, after->coalesced - before.coalesced);
+  TEST_ASSERT_EQUAL_UINT32(3, after->deferred - before.deferred);
+  TEST_ASSERT_EQUAL_UINT32(0, after->errors - before.errors);
+  TEST_ASSERT_EQUAL_UINT32(resets, Sim_can_stats()->resets);
+}
+
+void test_deferred_frames_keep_priority(void) {
+  Sim_set_can_tx_error(Can_Error_TX_BUFFER_FULL);
+  queue_wheel_speed(1);
+  CanTx_flush();
+  queue_raw_values(2);
+  CanTx_flush();
+  queue_driver_output(3);
+
+  Sim_set_can_tx_error(Can_Error_NONE);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(3, sent_count);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_DriverOutput_Msg, sent[0].type);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_RawValues_Msg, sent[1].type);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_WheelSpeed_Msg, sent[2].type);
+}
+
+void test_other_errors_keep_the_frame_without_a_reset(void) {
+  const CanTx_Stats_T before = *CanTx_get_stats();
+  const uint32_t resets = Sim_can_stats()->resets;
+
+  Sim_set_can_tx_error(Can_Error_ACK);
+  queue_driver_output(5);
+  CanTx_flush();
+  CanTx_flush();
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(3, CanTx_get_stats()->errors - before.errors);
+  TEST_ASSERT_EQUAL_UINT32(resets, Sim_can_stats()->resets);
+
+  Sim_set_can_tx_error(Can_Error_NONE);
+  CanTx_flush();
+  TEST_ASSERT_EQUAL_UINT32(1, sent_count);
+  TEST_ASSERT_EQUAL_INT16(5, sent[0].data.driver_output.torque);
+}
+
+void test_rejected_frame_is_dropped_and_unblocks_the_rest(void) {
+  const CanTx_Stats_T before = *CanTx_get_stats();
+
+  const uint64_t start_us = Sim_now_us() + 1000;
+  set_now_us(start_us);
+
+  Sim_set_can_tx_error(Can_Error_ACK);
+  queue_driver_output(1);
+  queue_raw_values(2);
+  CanTx_isr_drain();
+  set_now_us(start_us + CAN_TX_ERROR_TIMEOUT_US - 1);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(0, CanTx_get_stats()->dropped - before.dropped);
+
+  // Gives up on DriverOutput and moves on to RawValues, which fails too but
+  // has only just started to
+  set_now_us(start_us + CAN_TX_ERROR_TIMEOUT_US);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(1, CanTx_get_stats()->dropped - before.dropped);
+  TEST_ASSERT_EQUAL_UINT32(4, CanTx_get_stats()->errors - before.errors);
+
+  Sim_set_can_tx_error(Can_Error_NONE);
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(1, sent_count);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_RawValues_Msg, sent[0].type);
+}
+
+void test_nothing_is_written_while_off_the_bus(void) {
+  const uint32_t refused = Sim_can_stats()->tx_refused;
+  Sim_can_error_burst(32, 0);
+  CanHealth_isr_update(0);
+  TEST_ASSERT_FALSE(CanHealth_can_transmit());
+
+  queue_driver_output(7);
+  CanTx_flush();
+  CanTx_isr_drain();
+  TEST_ASSERT_EQUAL_UINT32(0, sent_count);
+  TEST_ASSERT_EQUAL_UINT32(refused, Sim_can_stats()->tx_refused);
+}
+
+void test_interrupt_leaves_main_loop_writes_alone(void) {
+  drain_from_hook = true;
+  queue_driver_output(1);
+  queue_raw_values(2);
+  CanTx_flush();
+  // Had the drain run inside the first write, RawValues would have gone
+  // out from there and again from the flush
+  TEST_ASSERT_EQUAL_UINT32(2, sent_count);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_DriverOutput_Msg, sent[0].type);
+  TEST_ASSERT_EQUAL_INT(Can_FrontCanNode_RawValues_Msg, sent[1].type);
+}
+
+void test_take_sent_reports_each_frame_once(void) {
+  uint32_t age_us;
+  TEST_ASSERT_FALSE(CanTx_take_sent(CAN_TX_DRIVER_OUTPUT, &age_us));
+
+  Can_FrontCanNode_DriverOutput_T msg;
+  memset(&msg, 0, sizeof(msg));
+  CanTx_queue_driver_output(&msg, Clock_us() - 1500);
+  TEST_ASSERT_FALSE(CanTx_take_sent(CAN_TX_DRIVER_OUTPUT, &age_us));
+
+  CanTx_flush();
+  TEST_ASSERT_TRUE(CanTx_take_sent(CAN_TX_DRIVER_OUTPUT, &age_us));
+  TEST_ASSERT_EQUAL_UINT32(1500, age_us);
+  TEST_ASSERT_FALSE(CanTx_take_sent(CAN_TX_DRIVER_OUTPUT, &age_us));
+  TEST_ASSERT_FALSE(CanTx_take_sent(CAN_TX_RAW_VALUES, &age_us));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_flush_sends_in_priority_order);
+  RUN_TEST(test_full_controller_keeps_only_the_latest_frame);
+  RUN_TEST(test_deferred_frames_keep_priority);
+  RUN_TEST(test_other_errors_keep_the_frame_without_a_reset);
+  RUN_TEST(test_rejected_frame_is_dropped_and_unblocks_the_rest);
+  RUN_TEST(test_nothing_is_written_while_off_the_bus);
+  RUN_TEST(test_interrupt_leaves_main_loop_writes_alone);
+  RUN_TEST(test_take_sent_reports_each_frame_once);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+#include "unity.h"
+
+#include "Energy.h"
+
+#define WINDOW_MS 1000
+
+static Current_Sensor_Input_T cs;
+static Energy_Input_T energy;
+
+// One voltage and current reading from the sensor, arriving at ms
+static void sample(uint32_t ms, int32_t voltage_mV, int32_t current_mA) {
+  cs.data[CS_Voltage] = voltage_mV;
+  cs.last_updated[CS_Voltage] = ms;
+  cs.data[CS_Current] = current_mA;
+  cs.last_updated[CS_Current] = ms;
+  Energy_update(&energy, &cs, ms);
+}
+
+void setUp(void) {
+  uint8_t i;
+  for (i = 0; i < CS_VALUES_LENGTH; i++) {
+    cs.data[i] = 0;
+    cs.last_updated[i] = 0;
+  }
+  Energy_init(&energy);
+  Energy_set_window_ms(WINDOW_MS);
+}
+
+void tearDown(void) {
+  Energy_set_window_ms(ENERGY_DEFAULT_WINDOW_MS);
+}
+
+void test_constant_power_over_a_window(void) {
+  // 400 V at 100 A is 40 kW, sampled every 10 ms
+  uint32_t ms;
+  for (ms = 10; ms < WINDOW_MS; ms += 10) {
+    sample(ms, 400000, 100000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, energy.windows);
+  // Integrated from the first sample, 980 ms before the last
+  TEST_ASSERT_TRUE(energy.total_nJ == 40000LL * 980 * 1000000);
+
+  sample(WINDOW_MS, 400000, 100000);
+  TEST_ASSERT_EQUAL_UINT32(1, energy.windows);
+  TEST_ASSERT_EQUAL_INT32(39600, energy.window_energy_J);
+  TEST_ASSERT_EQUAL_INT32(39600, energy.window_power_W);
+  TEST_ASSERT_TRUE(energy.window_nJ == 0);
+}
+
+void test_trapezoid_is_exact_for_a_ramp(void) {
+  // Current rises from 0 to 100 A over 100 ms at 100 V
+  uint32_t ms;
+  for (ms = 100; ms <= 200; ms += 10) {
+    sample(ms, 100000, (int32_t)(ms - 100) * 1000);
+  }
+  // Half of 10 kW for 100 ms is 500 J
+  TEST_ASSERT_TRUE(energy.total_nJ == 500LL * 1000000000);
+}
+
+void test_nothing_is_added_without_a_new_sample(void) {
+  sample(10, 400000, 100000);
+  sample(20, 400000, 100000);
+  const int64_t total_nJ = energy.total_nJ;
+  Energy_update(&energy, &cs, 30);
+  Energy_update(&energy, &cs, 40);
+  TEST_ASSERT_TRUE(energy.total_nJ == total_nJ);
+}
+
+void test_gaps_and_stale_voltage_are_not_integrated(void) {
+  sample(10, 400000, 100000);
+  // Sensor quiet for longer than ENERGY_MAX_GAP_MS
+  sample(10 + ENERGY_MAX_GAP_MS + 10, 400000, 100000);
+  TEST_ASSERT_TRUE(energy.total_nJ == 0);
+  TEST_ASSERT_EQUAL_UINT32(1, energy.gaps);
+
+  // Current keeps coming but voltage stopped
+  const uint32_t voltage_ms = cs.last_updated[CS_Voltage];
+  cs.last_updated[CS_Current] = voltage_ms + ENERGY_MAX_GAP_MS + 10;
+  Energy_update(&energy, &cs, cs.last_updated[CS_Current]);
+  TEST_ASSERT_TRUE(energy.total_nJ == 0);
+  TEST_ASSERT_EQUAL_UINT32(2, energy.gaps);
+
+  // Both back, and integration picks up from the next pair of samples
+  const uint32_t back_ms = cs.last_updated[CS_Current] + 10;
+  sample(back_ms, 400000, 100000);
+  sample(back_ms + 10, 400000, 100000);
+  TEST_ASSERT_TRUE(energy.total_nJ == 40000LL * 10 * 1000000);
+}
+
+void test_summary_frame_carries_regen(void) {
+  // 400 V at -50 A for the whole window
+  uint32_t ms;
+  for (ms = 0; ms <= WINDOW_MS; ms += 10) {
+    sample(ms + 1, 400000, -50000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, energy.windows);
+  TEST_ASSERT_EQUAL_INT32(-20000, energy.window_energy_J);
+
+  Frame frame;
+  Energy_summary_frame(&energy, &frame);
+  TEST_ASSERT_EQUAL_UINT16(ENERGY_SUMMARY_ID, frame.id);
+  TEST_ASSERT_EQUAL_UINT8(8, frame.len);
+  const int32_t energy_J = (int32_t)(frame.data[0] | frame.data[1] << 8 |
+      frame.data[2] << 16 | (uint32_t)frame.data[3] << 24);
+  const int32_t power_W = (int32_t)(frame.data[4] | frame.data[5] << 8 |
+      frame.data[6] << 16 | (uint32_t)frame.data[7] << 24);
+  TEST_ASSERT_EQUAL_INT32(energy.window_energy_J, energy_J);
+  TEST_ASSERT_EQUAL_INT32(energy.window_power_W, power_W);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_constant_power_over_a_window);
+  RUN_TEST(test_trapezoid_is_exact_for_a_ramp);
+  RUN_TEST(test_nothing_is_added_without_a_new_sample);
+  RUN_TEST(test_gaps_and_stale_voltage_are_not_integrated);
+  RUN_TEST(test_summary_frame_carries_regen);
+  return UNITY_END();
+}
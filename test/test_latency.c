@@ -0,0 +1,45 @@
+#include "unity.h"
+
+#include "Latency.h"
+
+void setUp(void) {
+  Latency_init();
+}
+
+void tearDown(void) {
+}
+
+void test_buckets(void) {
+  Latency_record(0);
+  Latency_record(LATENCY_BUCKET_US - 1);
+  Latency_record(LATENCY_BUCKET_US);
+  Latency_record(10500);
+  Latency_record(40000);
+
+  const Latency_Stats_T *stats = Latency_get_stats();
+  TEST_ASSERT_EQUAL_UINT32(2, stats->histogram[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[1]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[10]);
+  // Everything from 11 ms up shares the last bucket
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[LATENCY_BUCKETS - 1]);
+}
+
+void test_min_max_mean(void) {
+  TEST_ASSERT_EQUAL_UINT32(0, Latency_mean_us());
+  Latency_record(3000);
+  Latency_record(1000);
+  Latency_record(8000);
+
+  const Latency_Stats_T *stats = Latency_get_stats();
+  TEST_ASSERT_EQUAL_UINT32(3, stats->count);
+  TEST_ASSERT_EQUAL_UINT32(1000, stats->min_us);
+  TEST_ASSERT_EQUAL_UINT32(8000, stats->max_us);
+  TEST_ASSERT_EQUAL_UINT32(4000, Latency_mean_us());
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_buckets);
+  RUN_TEST(test_min_max_mean);
+  return UNITY_END();
+}
@@ -0,0 +1,62 @@
+#include "unity.h"
+
+#include "LoopTiming.h"
+
+void setUp(void) {
+  LoopTiming_init();
+}
+
+void tearDown(void) {
+}
+
+void test_bucket_edges(void) {
+  TEST_ASSERT_EQUAL_UINT8(0, LoopTiming_bucket(0));
+  TEST_ASSERT_EQUAL_UINT8(0, LoopTiming_bucket((1 << LOOP_TIMING_MIN_SHIFT) - 1));
+  TEST_ASSERT_EQUAL_UINT8(1, LoopTiming_bucket(1 << LOOP_TIMING_MIN_SHIFT));
+  TEST_ASSERT_EQUAL_UINT8(1, LoopTiming_bucket((2 << LOOP_TIMING_MIN_SHIFT) - 1));
+  TEST_ASSERT_EQUAL_UINT8(2, LoopTiming_bucket(2 << LOOP_TIMING_MIN_SHIFT));
+  // 20 ms at 48 MHz is just under 2^20
+  TEST_ASSERT_EQUAL_UINT8(LOOP_TIMING_BUCKETS - 2, LoopTiming_bucket(960000));
+  TEST_ASSERT_EQUAL_UINT8(LOOP_TIMING_BUCKETS - 1, LoopTiming_bucket(1UL << 20));
+  TEST_ASSERT_EQUAL_UINT8(LOOP_TIMING_BUCKETS - 1, LoopTiming_bucket(UINT32_MAX));
+}
+
+// Bucket of every span from 2^log up to 2^(log + 1) - 1
+uint8_t expected_bucket(uint8_t log) {
+  if (log < LOOP_TIMING_MIN_SHIFT) {
+    return 0;
+  }
+  const uint8_t bucket = log - LOOP_TIMING_MIN_SHIFT + 1;
+  return bucket < LOOP_TIMING_BUCKETS ? bucket : LOOP_TIMING_BUCKETS - 1;
+}
+
+void test_every_power_of_two(void) {
+  uint8_t log;
+  for (log = 1; log < 32; log++) {
+    TEST_ASSERT_EQUAL_UINT8(expected_bucket(log), LoopTiming_bucket(1UL << log));
+    TEST_ASSERT_EQUAL_UINT8(expected_bucket(log - 1), LoopTiming_bucket((1UL << log) - 1));
+  }
+}
+
+void test_min_max_count(void) {
+  LoopTiming_record(LOOP_TIMING_STATE, 500);
+  LoopTiming_record(LOOP_TIMING_STATE, 90);
+  LoopTiming_record(LOOP_TIMING_STATE, 4000);
+
+  const LoopTiming_Stats_T *stats = LoopTiming_get_stats(LOOP_TIMING_STATE);
+  TEST_ASSERT_EQUAL_UINT32(3, stats->count);
+  TEST_ASSERT_EQUAL_UINT32(90, stats->min_cycles);
+  TEST_ASSERT_EQUAL_UINT32(4000, stats->max_cycles);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[LoopTiming_bucket(500)]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats->histogram[LoopTiming_bucket(4000)]);
+  TEST_ASSERT_EQUAL_UINT32(0, LoopTiming_get_stats(LOOP_TIMING_INPUT)->count);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bucket_edges);
+  RUN_TEST(test_every_power_of_two);
+  RUN_TEST(test_min_max_count);
+  return UNITY_END();
+}
@@ -0,0 +1,516 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Calibration.h"
+#include "Rules.h"
+#include "Transform.h"
+#include "Types.h"
+
+// The rule text, kept apart from the constants in src/Rules.c so that a
+// change there is checked against the rules rather than against itself.
+// Travel is in thousandths, as in Derived_Input_T.
+
+// EV2.3.4: sensors more than 10% apart. The firmware also counts exactly
+// 10%, which errs on the safe side, so that is what is checked.
+#define SPEC_IMPLAUSIBLE_TRAVEL 100
+// EV2.3.5: an implausibility lasting longer than this cuts power
+#define SPEC_REPORT_MS 100
+// EV2.5: brakes engaged with more than 25% throttle
+#define SPEC_CONFLICT_BEGIN_TRAVEL 250
+// EV2.5.1: the conflict lasts until the throttle is under 5%
+#define SPEC_CONFLICT_END_TRAVEL 50
+
+#define TEN_BIT_VALUES 1024
+
+// Once past the reporting limit, how much longer an implausibility has
+// lasted no longer changes anything, so elapsed times stop counting here
+#define ELAPSED_SATURATED (SPEC_REPORT_MS + 1)
+#define ELAPSED_VALUES (ELAPSED_SATURATED + 1)
+
+// Everything the rules can tell apart about one set of inputs
+enum {
+  IN_IMPLAUSIBLE = 1 << 0,
+  IN_THROTTLE_BEGIN = 1 << 1,
+  IN_THROTTLE_END = 1 << 2,
+  IN_BRAKE = 1 << 3,
+  IN_PEDAL_CLASSES = IN_BRAKE,
+  IN_CLASSES = IN_BRAKE << 1
+};
+
+// Rules_State_T with the timestamp made relative, plus ghost: how long the
+// inputs have really been implausible, as counted here rather than by the
+// firmware
+typedef struct {
+  bool has_conflict;
+  bool observed;
+  bool reported;
+  uint8_t elapsed;
+  uint8_t ghost;
+} Abstract_T;
+
+#define FLAG_COMBINATIONS 8
+#define ABSTRACT_STATES (FLAG_COMBINATIONS * ELAPSED_VALUES * ELAPSED_VALUES)
+
+typedef struct {
+  uint16_t accel_1_lower;
+  uint16_t accel_1_upper;
+  uint16_t accel_2_lower;
+  uint16_t accel_2_upper;
+  uint16_t conflict_brake_raw;
+} Config_T;
+
+typedef struct {
+  bool seen;
+  uint16_t accel_1_travel;
+  uint16_t accel_2_travel;
+} Pedal_Rep_T;
+
+static uint16_t accel_1_travel[TEN_BIT_VALUES];
+static uint16_t accel_2_travel[TEN_BIT_VALUES];
+static Pedal_Rep_T pedal_reps[IN_PEDAL_CLASSES];
+static bool brake_seen[2];
+static uint16_t brake_reps[2];
+static uint16_t brake_threshold;
+
+static uint64_t visited[(ABSTRACT_STATES + 63) / 64];
+static uint32_t queue[ABSTRACT_STATES];
+
+// Times of the previous update to run each transition at: an ordinary one,
+// one where implausibility_time_ms lies before zero, and one where msTicks
+// wraps during the step
+static const uint32_t update_times[] = { 1000, SPEC_REPORT_MS / 2, UINT32_MAX - SPEC_REPORT_MS / 2 };
+
+static uint8_t saturate(uint32_t ms) {
+  return ms > ELAPSED_SATURATED ? ELAPSED_SATURATED : ms;
+}
+
+static uint32_t encode(Abstract_T s) {
+  const uint32_t flags = s.has_conflict << 2 | s.observed << 1 | s.reported;
+  return (flags * ELAPSED_VALUES + s.elapsed) * ELAPSED_VALUES + s.ghost;
+}
+
+static Abstract_T decode(uint32_t index) {
+  Abstract_T s;
+  s.ghost = index % ELAPSED_VALUES;
+  index /= ELAPSED_VALUES;
+  s.elapsed = index % ELAPSED_VALUES;
+  index /= ELAPSED_VALUES;
+  s.has_conflict = index & 4;
+  s.observed = index & 2;
+  s.reported = index & 1;
+  return s;
+}
+
+static uint8_t pedal_class(uint16_t travel_1, uint16_t travel_2) {
+  const uint16_t high = travel_1 > travel_2 ? travel_1 : travel_2;
+  const uint16_t low = travel_1 > travel_2 ? travel_2 : travel_1;
+  uint8_t in = 0;
+  if (high - low >= SPEC_IMPLAUSIBLE_TRAVEL) {
+    in |= IN_IMPLAUSIBLE;
+  }
+  // The throttle rules go by the lower of the two sensors
+  if (low > SPEC_CONFLICT_BEGIN_TRAVEL) {
+    in |= IN_THROTTLE_BEGIN;
+  }
+  if (low < SPEC_CONFLICT_END_TRAVEL) {
+    in |= IN_THROTTLE_END;
+  }
+  return in;
+}
+
+// One pass of State_update_state's rules stage on real firmware, starting
+// from s with the previous update at now
+static Abstract_T step_firmware(Abstract_T s, uint16_t travel_1, uint16_t travel_2,
+    uint16_t brake_raw, uint32_t now, uint32_t dt) {
+  Rules_State_T rules = {
+    .has_conflict = s.has_conflict,
+    .implausibility_observed = s.observed,
+    .implausibility_time_ms = now - s.elapsed,
+    .implausibility_reported = s.reported,
+  };
+
+  Adc_Input_T adc;
+  Derived_Input_T derived;
+  memset(&adc, 0, sizeof(adc));
+  memset(&derived, 0, sizeof(derived));
+  adc.brake_1_raw = brake_raw;
+  derived.accel_1_travel = travel_1;
+  derived.accel_2_travel = travel_2;
+  derived.accel_travel = travel_1 < travel_2 ? travel_1 : travel_2;
+
+  Input_T input;
+  memset(&input, 0, sizeof(input));
+  input.adc = &adc;
+  input.derived = &derived;
+  input.msTicks = now + dt;
+
+  Rules_update_implausibility(&derived, &rules, input.msTicks);
+  Rules_update_conflict(&input, &rules);
+
+  Abstract_T next;
+  next.has_conflict = rules.has_conflict;
+  next.observed = rules.implausibility_observed;
+  next.reported = rules.implausibility_reported;
+  next.elapsed = next.observed ? saturate(input.msTicks - rules.implausibility_time_ms) : 0;
+  next.ghost = 0;
+  return next;
+}
+
+static Abstract_T step_class(Abstract_T s, uint8_t in, uint32_t now, uint32_t dt) {
+  const Pedal_Rep_T *pedal = &pedal_reps[in & (IN_PEDAL_CLASSES - 1)];
+  return step_firmware(s, pedal->accel_1_travel, pedal->accel_2_travel,
+      brake_reps[(in & IN_BRAKE) != 0], now, dt);
+}
+
+static bool same_firmware_state(Abstract_T a, Abstract_T b) {
+  return a.has_conflict == b.has_conflict && a.observed == b.observed &&
+    a.reported == b.reported && a.elapsed == b.elapsed;
+}
+
+static void fail_transition(const char *rule, Abstract_T s, uint8_t in, uint32_t dt, Abstract_T next) {
+  char msg[200];
+  snprintf(msg, sizeof(msg),
+      "%s: from conflict %u observed %u reported %u elapsed %u (really %u) "
+      "with inputs 0x%x after %u ms went to conflict %u observed %u reported %u",
+      rule, s.has_conflict, s.observed, s.reported, s.elapsed, s.ghost, in, dt,
+      next.has_conflict, next.observed, next.reported);
+  TEST_FAIL_MESSAGE(msg);
+}
+
+// The rules every step has to keep, given the state it started from and
+// the inputs it saw
+static void check_transition(Abstract_T s, uint8_t in, uint32_t dt, Abstract_T next) {
+  const bool implausible = in & IN_IMPLAUSIBLE;
+  if (next.observed != implausible) {
+    fail_transition("EV2.3.4 implausibility not tracked", s, in, dt, next);
+  }
+  if (next.reported != (implausible && next.ghost > SPEC_REPORT_MS)) {
+    fail_transition("EV2.3.5 implausibility reported at the wrong time", s, in, dt, next);
+  }
+  // While an implausibility is reported no torque is sent, so the conflict
+  // rules only bind outside of one
+  if (s.has_conflict && !(in & IN_THROTTLE_END) && !next.has_conflict) {
+    fail_transition("EV2.5.1 conflict released above 5% throttle", s, in, dt, next);
+  }
+  if (s.has_conflict && (in & IN_THROTTLE_END) && !next.reported && next.has_conflict) {
+    fail_transition("EV2.5.1 conflict held under 5% throttle", s, in, dt, next);
+  }
+  if (!s.has_conflict && (in & IN_BRAKE) && (in & IN_THROTTLE_BEGIN) && !next.reported &&
+      !next.has_conflict) {
+    fail_transition("EV2.5 conflict missed", s, in, dt, next);
+  }
+  if (!s.has_conflict && next.has_conflict && !((in & IN_BRAKE) && (in & IN_THROTTLE_BEGIN))) {
+    fail_transition("EV2.5 conflict raised without brake and throttle", s, in, dt, next);
+  }
+}
+
+void configure(const Config_T *config) {
+  Transform_set_accel_bounds(config->accel_1_lower, config->accel_1_upper,
+      config->accel_2_lower, config->accel_2_upper);
+  Rules_set_conflict_brake_raw(config->conflict_brake_raw);
+  brake_threshold = config->conflict_brake_raw;
+
+  uint16_t raw;
+  for (raw = 0; raw < TEN_BIT_VALUES; raw++) {
+    accel_1_travel[raw] = Transform_accel_1_travel(raw);
+    accel_2_travel[raw] = Transform_accel_2_travel(raw);
+  }
+}
+
+// Sorts the whole 10-bit pedal and brake input space into classes and
+// keeps one representative of each
+void find_input_classes(void) {
+  memset(pedal_reps, 0, sizeof(pedal_reps));
+  memset(brake_seen, 0, sizeof(brake_seen));
+
+  uint16_t raw_1, raw_2;
+  for (raw_1 = 0; raw_1 < TEN_BIT_VALUES; raw_1++) {
+    for (raw_2 = 0; raw_2 < TEN_BIT_VALUES; raw_2++) {
+      Pedal_Rep_T *rep = &pedal_reps[pedal_class(accel_1_travel[raw_1], accel_2_travel[raw_2])];
+      if (!rep->seen) {
+        rep->seen = true;
+        rep->accel_1_travel = accel_1_travel[raw_1];
+        rep->accel_2_travel = accel_2_travel[raw_2];
+      }
+    }
+  }
+
+  uint16_t brake;
+  for (brake = 0; brake < TEN_BIT_VALUES; brake++) {
+    const bool engaged = brake > brake_threshold;
+    if (!brake_seen[engaged]) {
+      brake_seen[engaged] = true;
+      brake_reps[engaged] = brake;
+    }
+  }
+}
+
+static bool class_seen(uint8_t in) {
+  return pedal_reps[in & (IN_PEDAL_CLASSES - 1)].seen && brake_seen[(in & IN_BRAKE) != 0];
+}
+
+// The exploration below only tries one input per class, which is only sound
+// if the firmware treats every member of a class alike. Check that for every
+// raw reading against a set of probe states that covers each branch.
+void check_classes_are_uniform(void) {
+  static const Abstract_T probes[] = {
+    { false, false, false, 0, 0 },
+    { false, true, false, 0, 0 },
+    { false, true, false, SPEC_REPORT_MS, 0 },
+    { false, true, true, ELAPSED_SATURATED, 0 },
+    { true, false, false, 0, 0 },
+    { true, true, false, 0, 0 },
+    { true, true, false, SPEC_REPORT_MS, 0 },
+    { true, true, true, ELAPSED_SATURATED, 0 },
+  };
+  const uint8_t probe_count = sizeof(probes) / sizeof(probes[0]);
+  const uint32_t now = update_times[0];
+
+  uint8_t p, engaged;
+  for (p = 0; p < probe_count; p++) {
+    for (engaged = 0; engaged < 2; engaged++) {
+      if (!brake_seen[engaged]) {
+        continue;
+      }
+      const uint16_t brake = brake_reps[engaged];
+      uint16_t raw_1, raw_2;
+      for (raw_1 = 0; raw_1 < TEN_BIT_VALUES; raw_1++) {
+        for (raw_2 = 0; raw_2 < TEN_BIT_VALUES; raw_2++) {
+          const uint16_t travel_1 = accel_1_travel[raw_1];
+          const uint16_t travel_2 = accel_2_travel[raw_2];
+          const Pedal_Rep_T *rep = &pedal_reps[pedal_class(travel_1, travel_2)];
+          const Abstract_T actual = step_firmware(probes[p], travel_1, travel_2, brake, now, 1);
+          const Abstract_T expected = step_firmware(probes[p],
+              rep->accel_1_travel, rep->accel_2_travel, brake, now, 1);
+          if (!same_firmware_state(actual, expected)) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "accel %u/%u brake %u behaves unlike the rest of its class",
+                raw_1, raw_2, brake);
+            TEST_FAIL_MESSAGE(msg);
+          }
+        }
+      }
+    }
+
+    uint8_t pedal;
+    for (pedal = 0; pedal < IN_PEDAL_CLASSES; pedal++) {
+      if (!pedal_reps[pedal].seen) {
+        continue;
+      }
+      const Pedal_Rep_T *rep = &pedal_reps[pedal];
+      uint16_t brake;
+      for (brake = 0; brake < TEN_BIT_VALUES; brake++) {
+        const Abstract_T actual = step_firmware(probes[p],
+            rep->accel_1_travel, rep->accel_2_travel, brake, now, 1);
+        const Abstract_T expected = step_firmware(probes[p],
+            rep->accel_1_travel, rep->accel_2_travel, brake_reps[brake > brake_threshold], now, 1);
+        if (!same_firmware_state(actual, expected)) {
+          char msg[96];
+          snprintf(msg, sizeof(msg), "brake %u behaves unlike the rest of its class", brake);
+          TEST_FAIL_MESSAGE(msg);
+        }
+      }
+    }
+  }
+}
+
+// Breadth-first search from the state State_initialize leaves behind, over
+// every input class and every gap between updates up to the point where
+// longer gaps stop making a difference
+void explore(void) {
+  memset(visited, 0, sizeof(visited));
+  const Abstract_T initial = { false, false, false, 0, 0 };
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  queue[tail++] = encode(initial);
+  visited[encode(initial) / 64] |= 1ULL << (encode(initial) % 64);
+
+  bool reached_report = false;
+  bool reached_conflict = false;
+
+  while (head < tail) {
+    const Abstract_T s = decode(queue[head++]);
+    reached_report |= s.reported;
+    reached_conflict |= s.has_conflict;
+
+    uint8_t in;
+    for (in = 0; in < IN_CLASSES; in++) {
+      if (!class_seen(in)) {
+        continue;
+      }
+      uint32_t dt;
+      for (dt = 0; dt <= ELAPSED_SATURATED; dt++) {
+        Abstract_T next = step_class(s, in, update_times[0], dt);
+        uint8_t t;
+        for (t = 1; t < sizeof(update_times) / sizeof(update_times[0]); t++) {
+          const Abstract_T again = step_class(s, in, update_times[t], dt);
+          if (!same_firmware_state(next, again)) {
+            fail_transition("Result depends on the time of day", s, in, dt, again);
+          }
+        }
+
+        if (in & IN_IMPLAUSIBLE) {
+          next.ghost = s.observed ? saturate(s.ghost + dt) : 0;
+        }
+        check_transition(s, in, dt, next);
+
+        const uint32_t index = encode(next);
+        if (!(visited[index / 64] & (1ULL << (index % 64)))) {
+          visited[index / 64] |= 1ULL << (index % 64);
+          queue[tail++] = index;
+        }
+      }
+    }
+  }
+
+  // Guard against the checks above passing because nothing was explored
+  if (!reached_report) {
+    TEST_FAIL_MESSAGE("No reachable state reports an implausibility");
+  }
+  if (class_seen(IN_BRAKE | IN_THROTTLE_BEGIN) && !reached_conflict) {
+    TEST_FAIL_MESSAGE("No reachable state has a conflict");
+  }
+}
+
+void check_config(const Config_T *config) {
+  configure(config);
+  find_input_classes();
+  check_classes_are_uniform();
+  explore();
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+  Calibration_load();
+}
+
+void test_default_calibration(void) {
+  const Config_T config = {
+    CALIBRATION_DEFAULT_ACCEL_1_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_1_UPPER_BOUND,
+    CALIBRATION_DEFAULT_ACCEL_2_LOWER_BOUND, CALIBRATION_DEFAULT_ACCEL_2_UPPER_BOUND,
+    CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW,
+  };
+  check_config(&config);
+}
+
+void test_full_range_pedals_and_light_brake(void) {
+  const Config_T config = { 0, 1023, 0, 1023, 0 };
+  check_config(&config);
+}
+
+void test_mismatched_pedals_and_heavy_brake(void) {
+  const Config_T config = { 400, 480, 10, 900, 1022 };
+  check_config(&config);
+}
+
+// Input to Rules_update, with the pedals SPEC_IMPLAUSIBLE_TRAVEL apart or not
+typedef struct {
+  Adc_Input_T adc;
+  Derived_Input_T derived;
+  Input_T input;
+  Rules_State_T rules;
+} Incremental_T;
+
+static void incremental_init(Incremental_T *t, bool implausible) {
+  memset(t, 0, sizeof(*t));
+  t->input.adc = &t->adc;
+  t->input.derived = &t->derived;
+  t->derived.accel_1_travel = 0;
+  t->derived.accel_2_travel = implausible ? SPEC_IMPLAUSIBLE_TRAVEL * 2 : 0;
+  Rules_initialize(&t->rules);
+}
+
+static bool incremental_update(Incremental_T *t, uint32_t now) {
+  t->input.msTicks = now;
+  return Rules_update(&t->input, &t->rules);
+}
+
+void test_update_skips_unchanged_input(void) {
+  Incremental_T t;
+  incremental_init(&t, false);
+  TEST_ASSERT_TRUE(incremental_update(&t, 1000));
+  TEST_ASSERT_FALSE(incremental_update(&t, 1001));
+  TEST_ASSERT_FALSE(incremental_update(&t, 5000));
+
+  // Pressing the throttle with the brake on is only seen once the ADC
+  // generation moves on
+  t.adc.brake_1_raw = 1023;
+  t.derived.accel_travel = 1000;
+  t.input.generation[INPUT_ADC]++;
+  TEST_ASSERT_TRUE(incremental_update(&t, 5001));
+  TEST_ASSERT_TRUE(t.rules.has_conflict);
+
+  // Nor do the other sources matter to the rules
+  t.input.generation[INPUT_MC]++;
+  t.input.generation[INPUT_MISC]++;
+  TEST_ASSERT_FALSE(incremental_update(&t, 5002));
+
+  // A new threshold can change the outcome for the same input
+  Rules_set_conflict_brake_raw(CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW);
+  TEST_ASSERT_TRUE(incremental_update(&t, 5003));
+}
+
+void test_instances_are_tracked_apart(void) {
+  Incremental_T a;
+  Incremental_T b;
+  incremental_init(&a, false);
+  TEST_ASSERT_TRUE(incremental_update(&a, 1000));
+
+  // A second instance starting out does not make the first run again
+  incremental_init(&b, false);
+  TEST_ASSERT_FALSE(incremental_update(&a, 1001));
+  TEST_ASSERT_TRUE(incremental_update(&b, 1001));
+  TEST_ASSERT_FALSE(incremental_update(&b, 1002));
+
+  // A new setting reaches both
+  Rules_set_conflict_brake_raw(CALIBRATION_DEFAULT_CONFLICT_BRAKE_RAW);
+  TEST_ASSERT_TRUE(incremental_update(&a, 1003));
+  TEST_ASSERT_TRUE(incremental_update(&b, 1003));
+  TEST_ASSERT_FALSE(incremental_update(&a, 1004));
+}
+
+void test_update_reports_at_the_deadline(void) {
+  Incremental_T t;
+  incremental_init(&t, true);
+  uint32_t deadline_ms;
+  TEST_ASSERT_FALSE(Rules_next_deadline(&t.rules, &deadline_ms));
+
+  TEST_ASSERT_TRUE(incremental_update(&t, 1000));
+  TEST_ASSERT_TRUE(t.rules.implausibility_observed);
+  TEST_ASSERT_TRUE(Rules_next_deadline(&t.rules, &deadline_ms));
+  TEST_ASSERT_EQUAL_UINT32(1000 + SPEC_REPORT_MS + 1, deadline_ms);
+
+  TEST_ASSERT_FALSE(incremental_update(&t, 1000 + SPEC_REPORT_MS));
+  TEST_ASSERT_FALSE(t.rules.implausibility_reported);
+  // Nothing about the input changed, but the report is due
+  TEST_ASSERT_TRUE(incremental_update(&t, 1000 + SPEC_REPORT_MS + 1));
+  TEST_ASSERT_TRUE(t.rules.implausibility_reported);
+  TEST_ASSERT_FALSE(Rules_next_deadline(&t.rules, &deadline_ms));
+  TEST_ASSERT_FALSE(incremental_update(&t, 1000 + SPEC_REPORT_MS * 10));
+}
+
+void test_deadline_across_msticks_wrap(void) {
+  Incremental_T t;
+  incremental_init(&t, true);
+  const uint32_t start = UINT32_MAX - SPEC_REPORT_MS / 2;
+  TEST_ASSERT_TRUE(incremental_update(&t, start));
+  TEST_ASSERT_FALSE(incremental_update(&t, start + SPEC_REPORT_MS));
+  TEST_ASSERT_TRUE(incremental_update(&t, start + SPEC_REPORT_MS + 1));
+  TEST_ASSERT_TRUE(t.rules.implausibility_reported);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_default_calibration);
+  RUN_TEST(test_full_range_pedals_and_light_brake);
+  RUN_TEST(test_mismatched_pedals_and_heavy_brake);
+  RUN_TEST(test_update_skips_unchanged_input);
+  RUN_TEST(test_instances_are_tracked_apart);
+  RUN_TEST(test_update_reports_at_the_deadline);
+  RUN_TEST(test_deadline_across_msticks_wrap);
+  return UNITY_END();
+}
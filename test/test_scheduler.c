@@ -0,0 +1,96 @@
+#include "unity.h"
+
+#include "Scheduler.h"
+
+#define TASKS 3
+
+static const Scheduler_Entry_T entries[TASKS] = {
+  { 20, 0 },
+  { 100, 5 },
+  { 20, 10 },
+};
+
+static Scheduler_T scheduler;
+static Scheduler_Task_T tasks[TASKS];
+
+void setUp(void) {
+  Scheduler_init(&scheduler, entries, tasks, TASKS, 0);
+}
+
+void tearDown(void) {
+}
+
+// Polls once per tick over [from, to) and returns how often task ran
+uint32_t count_runs(uint32_t from, uint32_t to, uint8_t task) {
+  uint32_t runs = 0;
+  uint32_t ms;
+  for (ms = from; ms != to; ms++) {
+    if (Scheduler_poll(&scheduler, ms) & (1UL << task)) {
+      runs++;
+    }
+  }
+  return runs;
+}
+
+void test_releases_follow_phase(void) {
+  TEST_ASSERT_EQUAL_UINT32(1 << 0, Scheduler_poll(&scheduler, 0));
+  TEST_ASSERT_EQUAL_UINT32(5, Scheduler_next_due(&scheduler));
+  TEST_ASSERT_EQUAL_UINT32(0, Scheduler_poll(&scheduler, 4));
+  TEST_ASSERT_EQUAL_UINT32(1 << 1, Scheduler_poll(&scheduler, 5));
+  TEST_ASSERT_EQUAL_UINT32(10, Scheduler_next_due(&scheduler));
+  TEST_ASSERT_EQUAL_UINT32(1 << 2, Scheduler_poll(&scheduler, 10));
+  TEST_ASSERT_EQUAL_UINT32(20, Scheduler_next_due(&scheduler));
+}
+
+void test_no_drift(void) {
+  // The old start + period < msTicks check ran every 21 ms, so this would
+  // have come out at 477
+  TEST_ASSERT_EQUAL_UINT32(500, count_runs(0, 10000, 0));
+  TEST_ASSERT_EQUAL_UINT32(100, count_runs(10000, 20000, 1));
+}
+
+void test_late_run_keeps_grid(void) {
+  Scheduler_poll(&scheduler, 0);
+  // 7 ms late for the release at 20
+  TEST_ASSERT_TRUE(Scheduler_poll(&scheduler, 27) & (1 << 0));
+  TEST_ASSERT_EQUAL_UINT32(40, tasks[0].next_due_ms);
+  TEST_ASSERT_EQUAL_UINT32(7, tasks[0].lateness_max_ms);
+  TEST_ASSERT_EQUAL_UINT32(7, tasks[0].jitter_max_ms);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].skipped);
+}
+
+void test_missed_releases_are_skipped(void) {
+  Scheduler_poll(&scheduler, 0);
+  // Releases at 20, 40 and 60 all passed, run once and resume at 80
+  TEST_ASSERT_TRUE(Scheduler_poll(&scheduler, 65) & (1 << 0));
+  TEST_ASSERT_EQUAL_UINT32(80, tasks[0].next_due_ms);
+  TEST_ASSERT_EQUAL_UINT32(2, tasks[0].skipped);
+  TEST_ASSERT_EQUAL_UINT32(0, Scheduler_poll(&scheduler, 66) & (1 << 0));
+}
+
+void test_tick_wrap(void) {
+  const uint32_t start = UINT32_MAX - 1000;
+  Scheduler_init(&scheduler, entries, tasks, TASKS, start);
+  TEST_ASSERT_EQUAL_UINT32(100, count_runs(start, start + 2000, 0));
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].lateness_max_ms);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks[0].jitter_max_ms);
+  TEST_ASSERT_EQUAL_UINT32(start + 2000, tasks[0].next_due_ms);
+}
+
+void test_reached(void) {
+  TEST_ASSERT_TRUE(Scheduler_reached(10, 10));
+  TEST_ASSERT_FALSE(Scheduler_reached(11, 10));
+  TEST_ASSERT_TRUE(Scheduler_reached(UINT32_MAX, 3));
+  TEST_ASSERT_FALSE(Scheduler_reached(3, UINT32_MAX));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_releases_follow_phase);
+  RUN_TEST(test_no_drift);
+  RUN_TEST(test_late_run_keeps_grid);
+  RUN_TEST(test_missed_releases_are_skipped);
+  RUN_TEST(test_tick_wrap);
+  RUN_TEST(test_reached);
+  return UNITY_END();
+}
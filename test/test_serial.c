@@ -0,0 +1,103 @@
+#include "unity.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Serial.h"
+#include "Sim.h"
+
+void UART_IRQHandler(void);
+
+static char sent[1024];
+static uint32_t sent_len;
+static uint64_t now_us;
+
+static void capture(uint8_t byte) {
+  if (sent_len < sizeof(sent) - 1) {
+    sent[sent_len++] = (char)byte;
+    sent[sent_len] = '\0';
+  }
+}
+
+// Runs the THRE interrupt until the ring is empty
+static void drain(void) {
+  uint64_t due;
+  while ((due = Sim_uart_irq_us()) != UINT64_MAX) {
+    now_us = due > now_us ? due : now_us;
+    Sim_set_now_us(now_us);
+    UART_IRQHandler();
+  }
+}
+
+void setUp(void) {
+  Sim_set_serial_tx_hook(capture);
+  Serial_Init(115200);
+  Serial_SetDropPolicy(SERIAL_DROP_NEWEST);
+  drain();
+  sent_len = 0;
+  sent[0] = '\0';
+}
+
+void tearDown(void) {
+  Sim_set_serial_tx_hook(NULL);
+}
+
+void test_numbers(void) {
+  Serial_PrintNumber(0, 10);
+  Serial_Print(" ");
+  Serial_PrintNumber(4294967295UL, 10);
+  Serial_Print(" ");
+  Serial_PrintNumber(0xbeef, 16);
+  Serial_Print(" ");
+  Serial_PrintlnNumber(5, 2);
+  drain();
+  TEST_ASSERT_EQUAL_STRING("0 4294967295 beef 101\r\n", sent);
+}
+
+void test_print_does_not_wait(void) {
+  const uint32_t before = Sim_serial_bytes();
+  TEST_ASSERT_EQUAL_UINT32(40 + 2, Serial_Println("0123456789012345678901234567890123456789"));
+  // Only the hardware FIFO has been filled so far
+  TEST_ASSERT_EQUAL_UINT32(16, Sim_serial_bytes() - before);
+  drain();
+  TEST_ASSERT_EQUAL_UINT32(42, Sim_serial_bytes() - before);
+  TEST_ASSERT_EQUAL_UINT32(0, Sim_uart_overruns());
+}
+
+void test_drop_newest_keeps_queue(void) {
+  const Serial_Stats_T before = *Serial_GetStats();
+  char block[200];
+  memset(block, 'a', sizeof(block));
+  // 16 bytes go straight to the FIFO, leaving 184 of the ring used
+  TEST_ASSERT_EQUAL_UINT32(200, Serial_Write(block, 200));
+  TEST_ASSERT_EQUAL_UINT32(60, Serial_Write(block, 60));
+  TEST_ASSERT_EQUAL_UINT32(0, Serial_Write(block, 20));
+  drain();
+  TEST_ASSERT_EQUAL_UINT32(260, sent_len);
+  TEST_ASSERT_EQUAL_UINT32(1, Serial_GetStats()->dropped_writes - before.dropped_writes);
+  TEST_ASSERT_EQUAL_UINT32(20, Serial_GetStats()->dropped_bytes - before.dropped_bytes);
+}
+
+void test_drop_oldest_keeps_latest(void) {
+  const Serial_Stats_T before = *Serial_GetStats();
+  char block[SERIAL_TX_RING_SIZE];
+  memset(block, 'a', sizeof(block));
+  Serial_SetDropPolicy(SERIAL_DROP_OLDEST);
+  // 16 bytes go straight to the FIFO, the rest fills the ring
+  Serial_Write(block, SERIAL_TX_RING_SIZE);
+  Serial_Write(block, 100);
+  TEST_ASSERT_EQUAL_UINT32(6, Serial_Println("last"));
+  TEST_ASSERT_EQUAL_UINT32(84 + 6, Serial_GetStats()->dropped_bytes - before.dropped_bytes);
+  drain();
+  TEST_ASSERT_EQUAL_UINT32(16 + SERIAL_TX_RING_SIZE, sent_len);
+  TEST_ASSERT_EQUAL_STRING("last\r\n", sent + sent_len - 6);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_numbers);
+  RUN_TEST(test_print_does_not_wait);
+  RUN_TEST(test_drop_newest_keeps_queue);
+  RUN_TEST(test_drop_oldest_keeps_latest);
+  return UNITY_END();
+}
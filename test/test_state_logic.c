@@ -1,7 +1,7 @@
 #include "unity.h"
 
-#include "state_types.h"
-#include "state.h"
+#include "Types.h"
+#include "State.h"
 
 void test_demo(void) {
   TEST_ASSERT_EQUAL_INT(0, 0);
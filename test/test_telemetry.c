@@ -0,0 +1,127 @@
+#include "unity.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Serial.h"
+#include "Sim.h"
+#include "Telemetry.h"
+
+void UART_IRQHandler(void);
+
+static uint8_t sent[2048];
+static uint32_t sent_len;
+static uint64_t now_us;
+
+static void capture(uint8_t byte) {
+  if (sent_len < sizeof(sent)) {
+    sent[sent_len++] = byte;
+  }
+}
+
+static void drain(void) {
+  uint64_t due;
+  while ((due = Sim_uart_irq_us()) != UINT64_MAX) {
+    now_us = due > now_us ? due : now_us;
+    Sim_set_now_us(now_us);
+    UART_IRQHandler();
+  }
+}
+
+// Decodes the COBS frame starting at sent[*pos] up to its delimiter, and
+// returns its decoded length
+static uint32_t next_record(uint32_t *pos, uint8_t *record) {
+  uint32_t out = 0;
+  while (sent[*pos] != 0) {
+    const uint8_t code = sent[(*pos)++];
+    uint8_t i;
+    for (i = 1; i < code; i++) {
+      record[out++] = sent[(*pos)++];
+    }
+    if (sent[*pos] != 0) {
+      record[out++] = 0;
+    }
+  }
+  (*pos)++;
+  return out;
+}
+
+void setUp(void) {
+  Sim_set_serial_tx_hook(capture);
+  Serial_Init(115200);
+  Serial_SetDropPolicy(SERIAL_DROP_NEWEST);
+  drain();
+  sent_len = 0;
+}
+
+void tearDown(void) {
+  Sim_set_serial_tx_hook(NULL);
+}
+
+void test_crc_check_value(void) {
+  TEST_ASSERT_EQUAL_UINT16(0x29b1, Telemetry_crc16((const uint8_t *)"123456789", 9));
+}
+
+void test_record_round_trip(void) {
+  // Zeros in the payload have to survive COBS
+  Telemetry_Mc_State_T state = { 2, TELEMETRY_MC_STATE_HV_ENABLED, 0, 0x01000200 };
+  Telemetry_init();
+  TEST_ASSERT_TRUE(Telemetry_write_mc_state(0x12345678, &state));
+  drain();
+
+  // The lone delimiter from Telemetry_init comes first
+  TEST_ASSERT_EQUAL_UINT8(0, sent[0]);
+  uint32_t pos = 1;
+  uint8_t record[TELEMETRY_MAX_RECORD_SIZE];
+  const uint32_t len = next_record(&pos, record);
+  TEST_ASSERT_EQUAL_UINT32(sent_len, pos);
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_HEADER_SIZE + TELEMETRY_MC_STATE_SIZE + TELEMETRY_CRC_SIZE, len);
+  TEST_ASSERT_TRUE(memchr(sent + 1, 0, sent_len - 2) == NULL);
+
+  // Everything after the type and sequence number
+  const uint8_t expected[] = {
+    0x78, 0x56, 0x34, 0x12,
+    2, TELEMETRY_MC_STATE_HV_ENABLED, 0, 0, 0x00, 0x02, 0x00, 0x01,
+  };
+  TEST_ASSERT_EQUAL_UINT8(TELEMETRY_MC_STATE, record[0]);
+  TEST_ASSERT_EQUAL_INT(0, memcmp(expected, record + 2, sizeof(expected)));
+  const uint16_t crc = record[len - 2] | record[len - 1] << 8;
+  TEST_ASSERT_EQUAL_UINT16(Telemetry_crc16(record, len - 2), crc);
+}
+
+void test_sequence_counts_drops(void) {
+  Telemetry_Current_Sensor_T cs = { -5, 7 };
+  const Telemetry_Stats_T before = *Telemetry_get_stats();
+
+  // The first record leaves 2 bytes in the ring after filling the FIFO.
+  // Pad it so the second cannot fit.
+  char block[SERIAL_TX_RING_SIZE];
+  memset(block, 'x', sizeof(block));
+  TEST_ASSERT_TRUE(Telemetry_write_current_sensor(1, TELEMETRY_CS_POWER, &cs));
+  Serial_Write(block, SERIAL_TX_RING_SIZE - 10);
+  TEST_ASSERT_FALSE(Telemetry_write_current_sensor(2, TELEMETRY_CS_POWER, &cs));
+  drain();
+  TEST_ASSERT_TRUE(Telemetry_write_current_sensor(3, TELEMETRY_CS_POWER, &cs));
+  drain();
+
+  TEST_ASSERT_EQUAL_UINT32(2, Telemetry_get_stats()->records - before.records);
+  TEST_ASSERT_EQUAL_UINT32(1, Telemetry_get_stats()->dropped - before.dropped);
+
+  uint8_t first[TELEMETRY_MAX_RECORD_SIZE];
+  uint8_t last[TELEMETRY_MAX_RECORD_SIZE];
+  uint32_t pos = 0;
+  next_record(&pos, first);
+  // Skip the filler, which has no delimiter of its own
+  pos = sent_len - (TELEMETRY_HEADER_SIZE + TELEMETRY_CS_SIZE + TELEMETRY_CRC_SIZE + 2);
+  next_record(&pos, last);
+  TEST_ASSERT_EQUAL_UINT8((uint8_t)(first[1] + 2), last[1]);
+  TEST_ASSERT_EQUAL_UINT8(3, last[2]);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_check_value);
+  RUN_TEST(test_record_round_trip);
+  RUN_TEST(test_sequence_counts_drops);
+  return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include "unity.h"
+
+#include <stdio.h>
+
+#include "Types.h"
+
+// Firmware functions from src/output.c
+int16_t apply_torque_ramp(int16_t motor_speed, int16_t requested_torque);
+int16_t apply_limp(Can_Vcu_LimpState_T limp, int16_t torque);
+
+// The divide-based versions the tables replaced
+static int16_t reference_torque_ramp(int16_t motor_speed, int16_t requested_torque) {
+  const int32_t bottom_speed = 32767 * 1 / 100;
+  const int32_t top_speed = 32767 * 10 / 100;
+  const int32_t bottom_torque = 32767 * 50 / 100;
+  const int32_t height = 32767 - bottom_torque;
+
+  int32_t speed = motor_speed == -32768 ? 32767 : motor_speed;
+  if (speed < 0) {
+    speed = -speed;
+  }
+  if (speed >= top_speed) {
+    return requested_torque;
+  }
+  if (speed <= bottom_speed) {
+    return requested_torque < bottom_torque ? requested_torque : bottom_torque;
+  }
+  const uint32_t cap = bottom_torque +
+    (uint32_t)(speed - bottom_speed) * height / (top_speed - bottom_speed);
+  return requested_torque < (int32_t)cap ? requested_torque : (int16_t)cap;
+}
+
+static int16_t reference_limp(Can_Vcu_LimpState_T limp, int16_t torque) {
+  switch (limp) {
+    case CAN_LIMP_50:
+      return torque / 2;
+    case CAN_LIMP_33:
+      return torque / 3;
+    case CAN_LIMP_25:
+      return torque / 4;
+    case CAN_LIMP_NORMAL:
+    default:
+      return torque;
+  }
+}
+
+// The result is min(request, cap), so a full-scale request exposes the cap
+// itself; the others cover requests on either side of it
+void test_ramp_matches_divide_at_every_speed(void) {
+  static const int16_t requests[] = { INT16_MIN, -1, 0, 16382, 16383, 16384, 24000, INT16_MAX };
+  uint8_t r;
+  for (r = 0; r < sizeof(requests) / sizeof(requests[0]); r++) {
+    int32_t speed;
+    for (speed = INT16_MIN; speed <= INT16_MAX; speed++) {
+      const int16_t expected = reference_torque_ramp(speed, requests[r]);
+      const int16_t actual = apply_torque_ramp(speed, requests[r]);
+      if (expected != actual) {
+        char msg[80];
+        snprintf(msg, sizeof(msg), "speed %d request %d: expected %d got %d",
+            speed, requests[r], expected, actual);
+        TEST_FAIL_MESSAGE(msg);
+      }
+    }
+  }
+}
+
+void test_limp_matches_divide_at_every_torque(void) {
+  uint8_t limp;
+  for (limp = CAN_LIMP_NORMAL; limp <= CAN_LIMP_25; limp++) {
+    int32_t torque;
+    for (torque = INT16_MIN; torque <= INT16_MAX; torque++) {
+      const int16_t expected = reference_limp((Can_Vcu_LimpState_T)limp, torque);
+      const int16_t actual = apply_limp((Can_Vcu_LimpState_T)limp, torque);
+      if (expected != actual) {
+        char msg[80];
+        snprintf(msg, sizeof(msg), "limp %u torque %d: expected %d got %d",
+            limp, torque, expected, actual);
+        TEST_FAIL_MESSAGE(msg);
+      }
+    }
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp_matches_divide_at_every_speed);
+  RUN_TEST(test_limp_matches_divide_at_every_torque);
+  return UNITY_END();
+}
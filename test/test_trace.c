@@ -0,0 +1,105 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Trace.h"
+
+static char path[] = "testbin/test_trace.trace";
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+  remove(path);
+}
+
+void test_round_trip(void) {
+  Can_FrontCanNode_RawValues_T raw = { 110, 75, 700, 230 };
+  Can_Vcu_DashHeartbeat_T vcu = { true, 800, CAN_LIMP_33 };
+  Can_MC_DataReading_T mc = { CAN_MC_REG_SPEED_ACTUAL_RPM, -1500 };
+  Can_FrontCanNode_DriverOutput_T driver = { -12, 303, 49, true, false, true, 0 };
+
+  Trace_Writer_T writer;
+  Trace_Record_T record;
+  TEST_ASSERT_TRUE(Trace_create(&writer, path));
+  Trace_from_raw_values(&record, 11, &raw);
+  TEST_ASSERT_TRUE(Trace_write(&writer, &record));
+  Trace_from_vcu_dash(&record, 12, &vcu);
+  TEST_ASSERT_TRUE(Trace_write(&writer, &record));
+  Trace_from_mc_data(&record, 13, &mc);
+  TEST_ASSERT_TRUE(Trace_write(&writer, &record));
+  Trace_from_driver_output(&record, 20, &driver);
+  TEST_ASSERT_TRUE(Trace_write(&writer, &record));
+  TEST_ASSERT_TRUE(Trace_close_writer(&writer));
+
+  Trace_Reader_T reader;
+  TEST_ASSERT_TRUE(Trace_open(&reader, path) == NULL);
+  const Trace_Record_T *records;
+  TEST_ASSERT_EQUAL_UINT32(4, Trace_next_window(&reader, &records));
+
+  Can_FrontCanNode_RawValues_T raw_out;
+  TEST_ASSERT_EQUAL_UINT32(11, records[0].time_ms);
+  TEST_ASSERT_EQUAL_UINT8(TRACE_RAW_VALUES, records[0].type);
+  Trace_to_raw_values(&records[0], &raw_out);
+  TEST_ASSERT_TRUE(memcmp(&raw, &raw_out, sizeof(raw)) == 0);
+
+  Can_Vcu_DashHeartbeat_T vcu_out;
+  TEST_ASSERT_EQUAL_UINT8(TRACE_VCU_DASH, records[1].type);
+  Trace_to_vcu_dash(&records[1], &vcu_out);
+  TEST_ASSERT_TRUE(vcu_out.hv_light);
+  TEST_ASSERT_EQUAL_UINT16(800, vcu_out.lv_battery_voltage);
+  TEST_ASSERT_EQUAL_INT(CAN_LIMP_33, vcu_out.limp_state);
+
+  Can_MC_DataReading_T mc_out;
+  TEST_ASSERT_EQUAL_UINT8(TRACE_MC_DATA, records[2].type);
+  Trace_to_mc_data(&records[2], &mc_out);
+  TEST_ASSERT_EQUAL_INT(CAN_MC_REG_SPEED_ACTUAL_RPM, mc_out.type);
+  TEST_ASSERT_EQUAL_INT(-1500, mc_out.value);
+
+  Can_FrontCanNode_DriverOutput_T driver_out;
+  TEST_ASSERT_EQUAL_UINT32(20, records[3].time_ms);
+  TEST_ASSERT_EQUAL_UINT8(TRACE_DRIVER_OUTPUT, records[3].type);
+  Trace_to_driver_output(&records[3], &driver_out);
+  TEST_ASSERT_EQUAL_INT(-12, driver_out.torque);
+  TEST_ASSERT_EQUAL_INT(303, driver_out.torque_before_control);
+  TEST_ASSERT_EQUAL_UINT8(49, driver_out.brake_pressure);
+  TEST_ASSERT_TRUE(driver_out.throttle_implausible);
+  TEST_ASSERT_FALSE(driver_out.brake_throttle_conflict);
+  TEST_ASSERT_TRUE(driver_out.brake_engaged);
+
+  TEST_ASSERT_EQUAL_UINT32(0, Trace_next_window(&reader, &records));
+  Trace_close(&reader);
+}
+
+void test_rejects_partial_record(void) {
+  Trace_Writer_T writer;
+  Trace_Record_T record;
+  Can_MC_DataReading_T mc = { CAN_MC_REG_SPEED_ACTUAL_RPM, 0 };
+  TEST_ASSERT_TRUE(Trace_create(&writer, path));
+  Trace_from_mc_data(&record, 1, &mc);
+  TEST_ASSERT_TRUE(Trace_write(&writer, &record));
+  // A log cut off mid-write
+  fputc(0, writer.file);
+  TEST_ASSERT_TRUE(Trace_close_writer(&writer));
+
+  Trace_Reader_T reader;
+  TEST_ASSERT_TRUE(Trace_open(&reader, path) != NULL);
+}
+
+void test_rejects_other_files(void) {
+  FILE *file = fopen(path, "wb");
+  fputs("not a trace at all", file);
+  fclose(file);
+
+  Trace_Reader_T reader;
+  TEST_ASSERT_EQUAL_STRING("not a trace file", Trace_open(&reader, path));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_rejects_partial_record);
+  RUN_TEST(test_rejects_other_files);
+  return UNITY_END();
+}
@@ -0,0 +1,92 @@
+#include "unity.h"
+
+#include <stdio.h>
+
+#include "Transform.h"
+
+#define TEN_BIT_VALUES 1024
+#define UINT16_VALUES 65536UL
+
+// Every reading Transform_linear_apply can be handed, not just 10-bit ones
+void check_against_divide(const Transform_Linear_T *fn) {
+  uint32_t reading;
+  for (reading = 0; reading < UINT16_VALUES; reading++) {
+    const uint16_t expected = Transform_linear_transfer_fn(reading,
+        fn->desired_width, fn->lower_bound, fn->upper_bound);
+    const uint16_t actual = Transform_linear_apply(fn, reading);
+    if (expected != actual) {
+      char msg[96];
+      snprintf(msg, sizeof(msg), "[%u:%u] width %u reading %u: expected %u got %u",
+          fn->lower_bound, fn->upper_bound, fn->desired_width, reading, expected, actual);
+      TEST_FAIL_MESSAGE(msg);
+    }
+  }
+}
+
+void test_accel_travel_matches_divide(void) {
+  uint32_t reading;
+  for (reading = 0; reading < UINT16_VALUES; reading++) {
+    TEST_ASSERT_EQUAL_UINT16(Transform_accel_1(reading, TRANSFORM_TRAVEL_WIDTH),
+        Transform_accel_1_travel(reading));
+    TEST_ASSERT_EQUAL_UINT16(Transform_accel_2(reading, TRANSFORM_TRAVEL_WIDTH),
+        Transform_accel_2_travel(reading));
+  }
+}
+
+void test_accel_torque_matches_divide(void) {
+  uint32_t reading;
+  for (reading = 0; reading < UINT16_VALUES; reading++) {
+    TEST_ASSERT_EQUAL_UINT16(Transform_accel_1(reading, TRANSFORM_TORQUE_WIDTH),
+        Transform_accel_1_torque(reading));
+    TEST_ASSERT_EQUAL_UINT16(Transform_accel_2(reading, TRANSFORM_TORQUE_WIDTH),
+        Transform_accel_2_torque(reading));
+  }
+}
+
+void test_brake_bounds_match_divide(void) {
+  const Transform_Linear_T fns[] = {
+    TRANSFORM_LINEAR(380, 780, TRANSFORM_TRAVEL_WIDTH),
+    TRANSFORM_LINEAR(380, 780, TRANSFORM_TORQUE_WIDTH),
+    TRANSFORM_LINEAR(380, 780, 255),
+    TRANSFORM_LINEAR(220, 270, TRANSFORM_TRAVEL_WIDTH),
+    TRANSFORM_LINEAR(220, 270, TRANSFORM_TORQUE_WIDTH),
+    TRANSFORM_LINEAR(220, 270, 255),
+  };
+  uint8_t i;
+  for (i = 0; i < sizeof(fns) / sizeof(fns[0]); i++) {
+    check_against_divide(&fns[i]);
+  }
+}
+
+// Any width, any 10-bit reading, over the widest and narrowest bound pairs
+void test_every_width_matches_divide(void) {
+  const uint16_t bounds[][2] = { { 0, 1023 }, { 105, 645 }, { 511, 512 } };
+  uint8_t b;
+  for (b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+    uint32_t width;
+    for (width = 0; width < UINT16_VALUES; width++) {
+      const uint16_t lower = bounds[b][0];
+      const uint16_t upper = bounds[b][1];
+      const Transform_Linear_T fn = TRANSFORM_LINEAR(lower, upper, width);
+      uint32_t reading;
+      for (reading = 0; reading < TEN_BIT_VALUES; reading++) {
+        if (Transform_linear_apply(&fn, reading) !=
+            Transform_linear_transfer_fn(reading, width, lower, upper)) {
+          char msg[80];
+          snprintf(msg, sizeof(msg), "[%u:%u] width %u reading %u",
+              lower, upper, width, reading);
+          TEST_FAIL_MESSAGE(msg);
+        }
+      }
+    }
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_accel_travel_matches_divide);
+  RUN_TEST(test_accel_torque_matches_divide);
+  RUN_TEST(test_brake_bounds_match_divide);
+  RUN_TEST(test_every_width_matches_divide);
+  return UNITY_END();
+}
@@ -0,0 +1,203 @@
+#include "unity.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "Types.h"
+#include "WheelSpeed.h"
+
+#define STRESS_TICKS 5000
+#define STRESS_PERIOD_US 50
+
+// The nth tick (from 1) of the stress test is n us long, so any snapshot
+// fully determines what every other field should be
+static volatile uint32_t isr_ticks = 0;
+
+void setUp(void) {
+  WheelSpeed_init();
+  WheelSpeed_set_adaptive(true);
+  isr_ticks = 0;
+}
+
+void tearDown(void) {
+  WheelSpeed_set_adaptive(false);
+}
+
+uint64_t expected_big_sum(uint32_t count) {
+  uint64_t sum = 0;
+  uint32_t j;
+  for (j = 0; j < NUM_TEETH && j < count; j++) {
+    sum += (uint64_t)(NUM_TEETH - j) * (count - j);
+  }
+  return sum;
+}
+
+void on_alarm(int sig) {
+  UNUSED(sig);
+  isr_ticks++;
+  WheelSpeed_isr_tick(LEFT, isr_ticks, isr_ticks);
+}
+
+void test_weighted_sum(void) {
+  WheelSpeed_Snapshot_T snapshot;
+  uint32_t n;
+  for (n = 1; n <= 3 * NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, n, n);
+    WheelSpeed_read(LEFT, &snapshot);
+    TEST_ASSERT_EQUAL_UINT32(n, snapshot.count);
+    TEST_ASSERT_EQUAL_UINT32(n, snapshot.latest_us);
+    TEST_ASSERT_EQUAL_UINT32(n, snapshot.last_updated);
+    if (n >= NUM_TEETH) {
+      TEST_ASSERT_EQUAL_UINT64(expected_big_sum(n), snapshot.big_sum);
+    }
+  }
+
+  // Constant tooth periods average to exactly that period
+  WheelSpeed_init();
+  for (n = 0; n < 2 * NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(RIGHT, 1234, n);
+  }
+  WheelSpeed_read(RIGHT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(1234, snapshot.big_sum / SUM_ALL_TEETH);
+}
+
+void test_disregard_restarts(void) {
+  WheelSpeed_Snapshot_T snapshot;
+  uint32_t n;
+  for (n = 0; n < NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, 500, n);
+  }
+  WheelSpeed_set_disregard(LEFT, true);
+  WheelSpeed_isr_tick(LEFT, 80000, 200);
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot.count);
+  TEST_ASSERT_EQUAL_UINT64(0, snapshot.big_sum);
+  TEST_ASSERT_EQUAL_UINT32(200, snapshot.last_updated);
+
+  WheelSpeed_set_disregard(LEFT, false);
+  for (n = 0; n < NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, 700, 201 + n);
+  }
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TEETH, snapshot.count);
+  TEST_ASSERT_EQUAL_UINT32(700, snapshot.big_sum / SUM_ALL_TEETH);
+}
+
+void test_adaptive_window(void) {
+  WheelSpeed_Snapshot_T snapshot;
+  uint32_t n;
+
+  // 8 ms teeth: three of them are the fewest that cover 20 ms
+  for (n = 0; n < 2 * NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, 8000, n);
+  }
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(3, snapshot.window_count);
+  TEST_ASSERT_EQUAL_UINT32(8000, WheelSpeed_adaptive_us(&snapshot, 0));
+
+  // One slow tooth covers the window alone, and takes over immediately
+  WheelSpeed_isr_tick(LEFT, 30000, n);
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(1, snapshot.window_count);
+  TEST_ASSERT_EQUAL_UINT32(30000, WheelSpeed_adaptive_us(&snapshot, 0));
+
+  // No tick for longer than the estimate bounds the period from below
+  TEST_ASSERT_EQUAL_UINT32(45000, WheelSpeed_adaptive_us(&snapshot, 45000));
+
+  // Fast teeth fill the window up to a whole revolution and no further
+  for (n = 0; n < 3 * NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, 100, n);
+  }
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TEETH, snapshot.window_count);
+  TEST_ASSERT_EQUAL_UINT32(100 * NUM_TEETH, snapshot.window_sum_us);
+}
+
+void test_window_untouched_when_off(void) {
+  WheelSpeed_Snapshot_T snapshot;
+  uint32_t n;
+
+  WheelSpeed_set_adaptive(false);
+  for (n = 0; n < 2 * NUM_TEETH; n++) {
+    WheelSpeed_isr_tick(LEFT, 8000, n);
+  }
+  WheelSpeed_read(LEFT, &snapshot);
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot.window_count);
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot.window_sum_us);
+  // The weighted sum does not depend on it
+  TEST_ASSERT_EQUAL_UINT32(8000, WheelSpeed_weighted_us(&snapshot));
+}
+
+void test_spacing_correction_learns(void) {
+  WheelSpeed_Snapshot_T snapshot;
+  uint32_t n;
+
+  // Tooth 0 is 10% long, the rest share the difference
+  WheelSpeed_set_spacing_correction(true);
+  for (n = 0; n < 200 * NUM_TEETH; n++) {
+    const uint32_t period = n % NUM_TEETH == 0 ? 11000 : 10000 - 1000 / (NUM_TEETH - 1);
+    WheelSpeed_isr_tick(LEFT, period, n);
+  }
+  WheelSpeed_set_spacing_correction(false);
+
+  // 10000 / 11000 in Q16 is 59578
+  const uint32_t factor = WheelSpeed_spacing_factor(LEFT, 0);
+  TEST_ASSERT_TRUE(factor > 59578 - 100 && factor < 59578 + 100);
+
+  // With one tooth per window, the long tooth now reads close to the mean
+  WheelSpeed_set_spacing_correction(true);
+  WheelSpeed_isr_tick(LEFT, 11000, n);
+  WheelSpeed_read(LEFT, &snapshot);
+  WheelSpeed_set_spacing_correction(false);
+  const uint32_t last = snapshot.window_sum_us / snapshot.window_count;
+  TEST_ASSERT_TRUE(last > 9950 && last < 10050);
+}
+
+// A signal stands in for the capture interrupt, preempting the reader at
+// arbitrary points. Every snapshot must be one the ISR actually published.
+void test_consistent_under_preemption(void) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_alarm;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGALRM, &action, NULL);
+
+  struct itimerval timer =
+    { { 0, STRESS_PERIOD_US }, { 0, STRESS_PERIOD_US } };
+  setitimer(ITIMER_REAL, &timer, NULL);
+
+  uint32_t torn = 0;
+  uint32_t reads = 0;
+  while (isr_ticks < STRESS_TICKS) {
+    reads++;
+    WheelSpeed_Snapshot_T snapshot;
+    WheelSpeed_read(LEFT, &snapshot);
+    const uint32_t n = snapshot.count;
+    if (snapshot.latest_us != n || snapshot.last_updated != n ||
+        snapshot.big_sum != expected_big_sum(n)) {
+      torn++;
+    }
+  }
+
+  struct itimerval stop = { { 0, 0 }, { 0, 0 } };
+  setitimer(ITIMER_REAL, &stop, NULL);
+  signal(SIGALRM, SIG_DFL);
+
+  printf("%u ticks during %u reads, %u retries\n",
+      isr_ticks, reads, WheelSpeed_get_stats(LEFT)->read_retries);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_weighted_sum);
+  RUN_TEST(test_disregard_restarts);
+  RUN_TEST(test_adaptive_window);
+  RUN_TEST(test_window_untouched_when_off);
+  RUN_TEST(test_spacing_correction_learns);
+  RUN_TEST(test_consistent_under_preemption);
+  return UNITY_END();
+}
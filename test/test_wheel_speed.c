@@ -0,0 +1,72 @@
+#include "unity.h"
+
+#include <stdio.h>
+
+#include "Transform.h"
+#include "Types.h"
+
+// Everything above this many us per tooth is under 156 mRPM, so it is
+// sampled rather than swept
+#define EXHAUSTIVE_LIMIT_US (1UL << 24)
+#define SAMPLE_STRIDE_US 997
+
+// The float conversion this replaced, kept as the reference
+uint32_t click_time_to_mRPM_float(uint32_t us_per_click) {
+  const float us_per_rev = us_per_click * 1.0 * NUM_TEETH;
+
+  const float s_per_rev = us_per_rev / 1000000.0;
+
+  const float mrev_per_s = 1000.0 / s_per_rev;
+
+  const float mrev_per_min = mrev_per_s * 60;
+  return (uint32_t)mrev_per_min;
+}
+
+// The float version carries about 24 bits of precision, so allow it to be
+// off from the exact result by a few parts in 2^22
+bool within_float_error(uint32_t us) {
+  const uint32_t exact = Transform_click_time_to_mRPM(us);
+  const uint32_t approx = click_time_to_mRPM_float(us);
+  const uint32_t diff = exact > approx ? exact - approx : approx - exact;
+  return diff <= 1 + (exact >> 22);
+}
+
+void test_matches_float_exhaustive_low_range(void) {
+  uint32_t us;
+  for (us = 1; us < EXHAUSTIVE_LIMIT_US; us++) {
+    if (!within_float_error(us)) {
+      char msg[64];
+      snprintf(msg, sizeof(msg), "mismatch at %u us", us);
+      TEST_FAIL_MESSAGE(msg);
+    }
+  }
+}
+
+void test_matches_float_sampled_high_range(void) {
+  uint32_t us;
+  for (us = EXHAUSTIVE_LIMIT_US; us < UINT32_MAX - SAMPLE_STRIDE_US; us += SAMPLE_STRIDE_US) {
+    if (!within_float_error(us)) {
+      char msg[64];
+      snprintf(msg, sizeof(msg), "mismatch at %u us", us);
+      TEST_FAIL_MESSAGE(msg);
+    }
+  }
+  TEST_ASSERT_TRUE(within_float_error(UINT32_MAX));
+}
+
+void test_exact_values(void) {
+  // 60e9 mrev/min / 23 teeth = 2608695652.17
+  TEST_ASSERT_EQUAL_UINT32(2608695652UL, Transform_click_time_to_mRPM(1));
+  // One revolution per second is 43478.26 us per tooth
+  TEST_ASSERT_EQUAL_UINT32(60000, Transform_click_time_to_mRPM(43478));
+  TEST_ASSERT_EQUAL_UINT32(0, Transform_click_time_to_mRPM(UINT32_MAX));
+  TEST_ASSERT_EQUAL_UINT32(0, Transform_click_time_to_mRPM(0));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_values);
+  RUN_TEST(test_matches_float_exhaustive_low_range);
+  RUN_TEST(test_matches_float_sampled_high_range);
+  return UNITY_END();
+}